@@ -0,0 +1,689 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Measure the BRS serializer and deserializer throughput.
+ *
+ * This tool runs a set of workloads through the serializer and the
+ * deserializer and reports the time spent per field (ns/field) and the
+ * throughput (GB/s) of each one of them. The results are printed in
+ * JSON so they can be saved and compared between releases.
+ *
+ * The workloads cover each scalar type, strings of various lengths,
+ * arrays, maps, and deeply nested brs::recursive fields. The same mixed
+ * workload is also run against each supported sink (a std::stringstream,
+ * a file, and a memory buffer) to compare their overhead.
+ *
+ * Usage:
+ *
+ * \code
+ *     brs_benchmarks [--min-time <ms>] [--output <filename>]
+ * \endcode
+ */
+
+// brs
+//
+#include    <brs/brs.h>
+#include    <brs/version.h>
+
+
+// C++
+//
+#include    <chrono>
+#include    <cstring>
+#include    <fstream>
+#include    <iomanip>
+#include    <iostream>
+#include    <sstream>
+
+
+// C
+//
+#include    <unistd.h>
+
+
+
+namespace
+{
+
+
+
+/** \brief A minimal memory buffer stream.
+ *
+ * This class offers the write(), read(), ignore(), gcount(), and eof()
+ * functions used by the serializer and deserializer templates without
+ * any of the std::iostream machinery. It is used to measure the overhead of the
+ * standard streams against a plain buffer.
+ */
+class buffer_stream
+{
+public:
+    typedef char        char_type;
+
+    void write(char_type const * s, std::size_t size)
+    {
+        f_buffer.insert(f_buffer.end(), s, s + size);
+    }
+
+    buffer_stream & read(char_type * s, std::size_t size)
+    {
+        std::size_t const available(std::min(size, f_buffer.size() - f_pos));
+        memcpy(s, f_buffer.data() + f_pos, available);
+        f_pos += available;
+        f_gcount = available;
+        if(available < size)
+        {
+            f_eof = true;
+        }
+        return *this;
+    }
+
+    buffer_stream & ignore(std::size_t size)
+    {
+        std::size_t const available(std::min(size, f_buffer.size() - f_pos));
+        f_pos += available;
+        f_gcount = available;
+        if(available < size)
+        {
+            f_eof = true;
+        }
+        return *this;
+    }
+
+    std::streamsize gcount() const
+    {
+        return f_gcount;
+    }
+
+    bool eof() const
+    {
+        return f_eof;
+    }
+
+    explicit operator bool () const
+    {
+        return !f_eof;
+    }
+
+    bool operator ! () const
+    {
+        return f_eof;
+    }
+
+    void rewind_output()
+    {
+        f_buffer.clear();
+    }
+
+    void rewind_input()
+    {
+        f_pos = 0;
+        f_gcount = 0;
+        f_eof = false;
+    }
+
+private:
+    std::vector<char_type>  f_buffer = std::vector<char_type>();
+    std::size_t             f_pos = 0;
+    std::size_t             f_gcount = 0;
+    bool                    f_eof = false;
+};
+
+
+void rewind_output(std::stringstream & s)
+{
+    s.str(std::string());
+    s.clear();
+}
+
+
+void rewind_output(std::fstream & s)
+{
+    // the file workload always writes the same number of bytes so we
+    // can overwrite the previous message without truncating the file
+    //
+    s.clear();
+    s.seekp(0);
+}
+
+
+void rewind_input(std::iostream & s)
+{
+    s.clear();
+    s.seekg(0);
+}
+
+
+void rewind_output(buffer_stream & s)
+{
+    s.rewind_output();
+}
+
+
+void rewind_input(buffer_stream & s)
+{
+    s.rewind_input();
+}
+
+
+void flush_output(std::iostream & s)
+{
+    s.flush();
+}
+
+
+void flush_output(buffer_stream & s)
+{
+    static_cast<void>(s);
+}
+
+
+
+struct result_t
+{
+    std::string                 f_name = std::string();
+    std::string                 f_sink = std::string();
+    std::string                 f_operation = std::string();
+    std::size_t                 f_fields = 0;
+    std::size_t                 f_bytes = 0;
+    std::size_t                 f_iterations = 0;
+    std::chrono::nanoseconds    f_duration = std::chrono::nanoseconds();
+};
+
+typedef std::vector<result_t>   result_vector_t;
+
+
+/** \brief One workload to run against a sink.
+ *
+ * The serialize function writes one message and the process_hunk
+ * function reads it back. The f_fields parameter is the number of
+ * fields (hunks) found in one message.
+ */
+template<typename S>
+struct workload_t
+{
+    std::string                                     f_name = std::string();
+    std::size_t                                     f_fields = 0;
+    std::function<void(brs::serializer<S> &)>       f_serialize = std::function<void(brs::serializer<S> &)>();
+    typename brs::deserializer<S>::process_hunk_t   f_process_hunk = typename brs::deserializer<S>::process_hunk_t();
+};
+
+
+std::chrono::milliseconds       g_min_time = std::chrono::milliseconds(200);
+volatile std::size_t            g_checksum = 0;    // avoid optimizing reads away
+
+
+template<typename S>
+void run_workload(
+      workload_t<S> & w
+    , S & stream
+    , std::string const & sink
+    , result_vector_t & results)
+{
+    typedef std::chrono::steady_clock   clock_t;
+
+    // determine the message size once
+    //
+    rewind_output(stream);
+    {
+        brs::serializer<S> out(stream);
+        w.f_serialize(out);
+    }
+    flush_output(stream);
+
+    std::size_t bytes(0);
+    {
+        rewind_input(stream);
+        char buf[64 * 1024];
+        for(;;)
+        {
+            stream.read(buf, sizeof(buf));
+            bytes += stream.gcount();
+            if(stream.gcount() != sizeof(buf))
+            {
+                break;
+            }
+        }
+    }
+
+    result_t write_result;
+    write_result.f_name = w.f_name;
+    write_result.f_sink = sink;
+    write_result.f_operation = "serialize";
+    write_result.f_fields = w.f_fields;
+    write_result.f_bytes = bytes;
+    clock_t::time_point start(clock_t::now());
+    do
+    {
+        rewind_output(stream);
+        brs::serializer<S> out(stream);
+        w.f_serialize(out);
+        flush_output(stream);
+        ++write_result.f_iterations;
+        write_result.f_duration = clock_t::now() - start;
+    }
+    while(write_result.f_duration < g_min_time
+       || write_result.f_iterations < 3);
+    results.push_back(write_result);
+
+    result_t read_result;
+    read_result.f_name = w.f_name;
+    read_result.f_sink = sink;
+    read_result.f_operation = "deserialize";
+    read_result.f_fields = w.f_fields;
+    read_result.f_bytes = bytes;
+    start = clock_t::now();
+    do
+    {
+        rewind_input(stream);
+        brs::deserializer<S> in(stream);
+        if(!in.deserialize(w.f_process_hunk))
+        {
+            std::cerr << "error: deserialization of \"" << w.f_name << "\" failed.\n";
+            exit(1);
+        }
+        ++read_result.f_iterations;
+        read_result.f_duration = clock_t::now() - start;
+    }
+    while(read_result.f_duration < g_min_time
+       || read_result.f_iterations < 3);
+    results.push_back(read_result);
+}
+
+
+template<typename S, typename T>
+workload_t<S> scalar_workload(std::string const & type_name)
+{
+    std::size_t const count(10'000);
+
+    workload_t<S> w;
+    w.f_name = "scalar/" + type_name;
+    w.f_fields = count;
+    w.f_serialize = [count](brs::serializer<S> & out)
+        {
+            for(std::size_t idx(0); idx < count; ++idx)
+            {
+                out.add_value("value", static_cast<T>(idx));
+            }
+        };
+    w.f_process_hunk = [](brs::deserializer<S> & in, brs::field_t const & field)
+        {
+            static_cast<void>(field);
+            T value;
+            in.read_data(value);
+            g_checksum += static_cast<std::size_t>(value);
+            return true;
+        };
+    return w;
+}
+
+
+template<typename S>
+workload_t<S> string_workload(std::size_t length)
+{
+    std::size_t const count(std::max(static_cast<std::size_t>(16), std::min(static_cast<std::size_t>(10'000), 4 * 1024 * 1024 / length)));
+    std::string const str(length, 'x');
+
+    workload_t<S> w;
+    w.f_name = "string/" + std::to_string(length);
+    w.f_fields = count;
+    w.f_serialize = [count, str](brs::serializer<S> & out)
+        {
+            for(std::size_t idx(0); idx < count; ++idx)
+            {
+                out.add_value("value", str);
+            }
+        };
+    w.f_process_hunk = [](brs::deserializer<S> & in, brs::field_t const & field)
+        {
+            static_cast<void>(field);
+            std::string value;
+            in.read_data(value);
+            g_checksum += value.length();
+            return true;
+        };
+    return w;
+}
+
+
+template<typename S>
+workload_t<S> array_workload()
+{
+    std::size_t const count(10'000);
+
+    workload_t<S> w;
+    w.f_name = "array/double";
+    w.f_fields = count;
+    w.f_serialize = [count](brs::serializer<S> & out)
+        {
+            for(std::size_t idx(0); idx < count; ++idx)
+            {
+                out.add_value("array", static_cast<int>(idx), static_cast<double>(idx));
+            }
+        };
+    w.f_process_hunk = [](brs::deserializer<S> & in, brs::field_t const & field)
+        {
+            double value;
+            in.read_data(value);
+            g_checksum += field.f_index;
+            return true;
+        };
+    return w;
+}
+
+
+template<typename S>
+workload_t<S> map_workload()
+{
+    std::size_t const count(10'000);
+
+    workload_t<S> w;
+    w.f_name = "map/string";
+    w.f_fields = count;
+    w.f_serialize = [count](brs::serializer<S> & out)
+        {
+            for(std::size_t idx(0); idx < count; ++idx)
+            {
+                out.add_value("map", "key" + std::to_string(idx), "value" + std::to_string(idx));
+            }
+        };
+    w.f_process_hunk = [](brs::deserializer<S> & in, brs::field_t const & field)
+        {
+            std::string value;
+            in.read_data(value);
+            g_checksum += field.f_sub_name.length() + value.length();
+            return true;
+        };
+    return w;
+}
+
+
+template<typename S>
+void nest(brs::serializer<S> & out, int depth)
+{
+    brs::recursive<S> r(out, "level");
+    out.add_value("depth", depth);
+    if(depth > 1)
+    {
+        nest(out, depth - 1);
+    }
+}
+
+
+template<typename S>
+bool process_nested_hunk(
+      brs::deserializer<S> & in
+    , brs::field_t const & field)
+{
+    if(field.f_name == "level")
+    {
+        typename brs::deserializer<S>::process_hunk_t func(&process_nested_hunk<S>);
+        return in.deserialize(func);
+    }
+
+    int value;
+    in.read_data(value);
+    g_checksum += value;
+    return true;
+}
+
+
+template<typename S>
+workload_t<S> recursive_workload(int depth)
+{
+    std::size_t const count(100);
+
+    workload_t<S> w;
+    w.f_name = "recursive/" + std::to_string(depth);
+    w.f_fields = count * depth * 3;     // start, value, end
+    w.f_serialize = [count, depth](brs::serializer<S> & out)
+        {
+            for(std::size_t idx(0); idx < count; ++idx)
+            {
+                nest(out, depth);
+            }
+        };
+    w.f_process_hunk = &process_nested_hunk<S>;
+    return w;
+}
+
+
+template<typename S>
+workload_t<S> mixed_workload()
+{
+    std::size_t const count(1'000);
+
+    workload_t<S> w;
+    w.f_name = "mixed";
+    w.f_fields = count * 5;
+    w.f_serialize = [count](brs::serializer<S> & out)
+        {
+            for(std::size_t idx(0); idx < count; ++idx)
+            {
+                out.add_value("id", static_cast<std::int64_t>(idx));
+                out.add_value("ratio", idx / 3.0);
+                out.add_value("label", std::string("label number ") + std::to_string(idx));
+                out.add_value("flags", static_cast<int>(idx), static_cast<std::uint32_t>(idx));
+                out.add_value("attribute", "name", std::string("attribute value"));
+            }
+        };
+    w.f_process_hunk = [](brs::deserializer<S> & in, brs::field_t const & field)
+        {
+            if(field.f_name == "id")
+            {
+                std::int64_t value;
+                in.read_data(value);
+                g_checksum += value;
+            }
+            else if(field.f_name == "ratio")
+            {
+                double value;
+                in.read_data(value);
+                g_checksum += static_cast<std::size_t>(value);
+            }
+            else if(field.f_name == "flags")
+            {
+                std::uint32_t value;
+                in.read_data(value);
+                g_checksum += value;
+            }
+            else
+            {
+                std::string value;
+                in.read_data(value);
+                g_checksum += value.length();
+            }
+            return true;
+        };
+    return w;
+}
+
+
+template<typename S>
+void run_all_workloads(S & stream, std::string const & sink, result_vector_t & results)
+{
+    std::vector<workload_t<S>> workloads;
+
+    workloads.push_back(scalar_workload<S, char>("char"));
+    workloads.push_back(scalar_workload<S, std::int8_t>("int8"));
+    workloads.push_back(scalar_workload<S, std::uint8_t>("uint8"));
+    workloads.push_back(scalar_workload<S, std::int16_t>("int16"));
+    workloads.push_back(scalar_workload<S, std::uint16_t>("uint16"));
+    workloads.push_back(scalar_workload<S, std::int32_t>("int32"));
+    workloads.push_back(scalar_workload<S, std::uint32_t>("uint32"));
+    workloads.push_back(scalar_workload<S, std::int64_t>("int64"));
+    workloads.push_back(scalar_workload<S, std::uint64_t>("uint64"));
+    workloads.push_back(scalar_workload<S, float>("float"));
+    workloads.push_back(scalar_workload<S, double>("double"));
+    workloads.push_back(scalar_workload<S, long double>("long_double"));
+
+    for(std::size_t length : { 8, 64, 512, 4096, 65536 })
+    {
+        workloads.push_back(string_workload<S>(length));
+    }
+
+    workloads.push_back(array_workload<S>());
+    workloads.push_back(map_workload<S>());
+
+    for(int depth : { 1, 10, 100 })
+    {
+        workloads.push_back(recursive_workload<S>(depth));
+    }
+
+    workloads.push_back(mixed_workload<S>());
+
+    for(auto & w : workloads)
+    {
+        run_workload(w, stream, sink, results);
+    }
+}
+
+
+void output_json(std::ostream & out, result_vector_t const & results)
+{
+    out << "{\n"
+        << "  \"library\": \"brs\",\n"
+        << "  \"version\": \"" << BRS_VERSION_STRING << "\",\n"
+        << "  \"results\": [\n";
+
+    char const * sep("");
+    for(auto const & r : results)
+    {
+        double const ns(static_cast<double>(r.f_duration.count()));
+        double const ns_per_field(ns / static_cast<double>(r.f_fields * r.f_iterations));
+        double const gb_per_second(static_cast<double>(r.f_bytes * r.f_iterations) / ns);
+
+        out << sep
+            << "    {\n"
+            << "      \"name\": \"" << r.f_name << "\",\n"
+            << "      \"sink\": \"" << r.f_sink << "\",\n"
+            << "      \"operation\": \"" << r.f_operation << "\",\n"
+            << "      \"fields\": " << r.f_fields << ",\n"
+            << "      \"bytes\": " << r.f_bytes << ",\n"
+            << "      \"iterations\": " << r.f_iterations << ",\n"
+            << "      \"ns_per_field\": " << std::fixed << std::setprecision(3) << ns_per_field << ",\n"
+            << "      \"gb_per_second\": " << std::fixed << std::setprecision(6) << gb_per_second << "\n"
+            << "    }";
+        sep = ",\n";
+    }
+
+    out << "\n  ]\n"
+        << "}\n";
+}
+
+
+void usage()
+{
+    std::cout << "Usage: brs_benchmarks [--opts]\n"
+                 "where --opts is one or more of:\n"
+                 "  --help | -h          print out this help screen\n"
+                 "  --min-time <ms>      minimum time to spend on each benchmark (default 200)\n"
+                 "  --output <filename>  save the JSON results to this file instead of stdout\n";
+}
+
+
+
+} // no name namespace
+
+
+
+int main(int argc, char * argv[])
+{
+    std::string output_filename;
+    for(int i(1); i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--help") == 0
+        || strcmp(argv[i], "-h") == 0)
+        {
+            usage();
+            return 0;
+        }
+        if(strcmp(argv[i], "--min-time") == 0)
+        {
+            ++i;
+            if(i >= argc)
+            {
+                std::cerr << "error: --min-time expects a number of milliseconds.\n";
+                return 1;
+            }
+            g_min_time = std::chrono::milliseconds(std::stol(argv[i]));
+        }
+        else if(strcmp(argv[i], "--output") == 0)
+        {
+            ++i;
+            if(i >= argc)
+            {
+                std::cerr << "error: --output expects a filename.\n";
+                return 1;
+            }
+            output_filename = argv[i];
+        }
+        else
+        {
+            std::cerr << "error: unknown command line option \"" << argv[i] << "\".\n";
+            return 1;
+        }
+    }
+
+    result_vector_t results;
+
+    {
+        std::stringstream stream;
+        run_all_workloads(stream, "stringstream", results);
+    }
+
+    {
+        std::string const filename("/tmp/brs_benchmarks-" + std::to_string(getpid()) + ".brs");
+        std::fstream stream(filename, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+        if(!stream.is_open())
+        {
+            std::cerr << "error: could not create \"" << filename << "\".\n";
+            return 1;
+        }
+        workload_t<std::fstream> w(mixed_workload<std::fstream>());
+        run_workload(w, stream, "file", results);
+        stream.close();
+        unlink(filename.c_str());
+    }
+
+    {
+        buffer_stream stream;
+        workload_t<buffer_stream> w(mixed_workload<buffer_stream>());
+        run_workload(w, stream, "buffer", results);
+    }
+
+    if(output_filename.empty())
+    {
+        output_json(std::cout, results);
+    }
+    else
+    {
+        std::ofstream out(output_filename);
+        output_json(out, results);
+        if(!out)
+        {
+            std::cerr << "error: could not save results to \"" << output_filename << "\".\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// vim: ts=4 sw=4 et
@@ -26,17 +26,31 @@
 
 // snapdev
 //
-#include    <snapdev/is_vector.h>
+#include    <snapdev/not_used.h>
 
 
 // C++
 //
+#include    <algorithm>
+#include    <chrono>
+#include    <cstring>
+#include    <deque>
 #include    <functional>
+#include    <ios>
+#include    <limits>
 #include    <map>
 #include    <memory>
+#include    <ostream>
+#include    <string_view>
+#include    <type_traits>
 #include    <vector>
 
 
+// C
+//
+#include    <sys/uio.h>
+
+
 
 namespace brs
 {
@@ -50,6 +64,9 @@ DECLARE_OUT_OF_RANGE(brs_out_of_range);
 DECLARE_MAIN_EXCEPTION(brs_error);
 
 DECLARE_EXCEPTION(brs_error, brs_cannot_be_empty);
+DECLARE_EXCEPTION(brs_error, brs_invalid_hunk);
+DECLARE_EXCEPTION(brs_error, brs_io_error);
+DECLARE_EXCEPTION(brs_error, brs_limit_exceeded);
 DECLARE_EXCEPTION(brs_error, brs_magic_missing);
 DECLARE_EXCEPTION(brs_error, brs_magic_unsupported);
 DECLARE_EXCEPTION(brs_error, brs_map_name_cannot_be_empty);
@@ -66,6 +83,28 @@ typedef std::uint32_t               type_t;
 constexpr type_t const              TYPE_FIELD = 0;     // regular name=value
 constexpr type_t const              TYPE_ARRAY = 1;     // item in an array (includes a 16 bit index)
 constexpr type_t const              TYPE_MAP = 2;       // item in a map (includes a second name)
+constexpr type_t const              TYPE_EXTENDED = 3;  // extended hunk (includes an 8 bit EXTENSION_...)
+
+typedef std::uint8_t                extension_t;
+
+constexpr extension_t const         EXTENSION_ARRAY32 = 0;      // item in an array (includes a 32 bit index)
+constexpr extension_t const         EXTENSION_ARRAY_RUN = 1;    // consecutive items of an array (includes a 32 bit index and a 32 bit count)
+constexpr extension_t const         EXTENSION_SUBFIELD = 2;     // start of a sub-field (no data)
+constexpr extension_t const         EXTENSION_PADDING = 3;      // padding (no name, data is ignored)
+constexpr extension_t const         EXTENSION_COMPRESSED = 4;   // compressed field (includes an 8 bit CODEC_... and the 32 bit uncompressed size)
+
+typedef std::uint8_t                codec_t;
+
+constexpr codec_t const             CODEC_ZSTD = 1;             // see brs::zstd_codec in brs/compress.h
+
+constexpr std::size_t const         COMPRESSION_THRESHOLD = 1024;   // default size of the smallest payloads to compress
+constexpr std::uint32_t const       MAX_UNCOMPRESSED_SIZE = 0x7FFFFF;   // compressed payloads are never larger than a hunk once decompressed
+
+constexpr std::size_t const         LARGE_PAYLOAD_SIZE = 256;       // payloads this size or more...
+constexpr std::size_t const         LARGE_PAYLOAD_ALIGNMENT = 64;   // ...get aligned to a cache line
+
+constexpr std::size_t const         BATCH_SIZE = 256;               // default maximum number of records per batch (see deserializer::deserialize_batch())
+constexpr std::size_t const         BATCH_DATA_SIZE = 64 * 1024;    // size of the buffer holding the data of one batch
 
 struct hunk_sizes_t
 {
@@ -76,28 +115,361 @@ struct hunk_sizes_t
 
 
 constexpr version_t const       BRS_ROOT = 0;       // indicate root buffer
-constexpr version_t const       BRS_VERSION = 1;    // version of the format
+constexpr version_t const       BRS_VERSION_1 = 1;  // sub-fields start with a field without data, no TYPE_EXTENDED hunks
+constexpr version_t const       BRS_VERSION = 2;    // version of the format
 
 
-constexpr magic_t build_magic(char endian)
+/** \brief Build a magic code.
+ *
+ * The magic code is composed of 'B', a format character, the endianness
+ * ('B' or 'L'), and the version. The format character is 'R' for a
+ * regular BRS buffer. Other formats built on top of BRS hunks (such as
+ * deltas) use a different character so they cannot be mistaken for a
+ * regular buffer.
+ *
+ * \param[in] endian  The endianness, 'B' or 'L'.
+ * \param[in] format  The format character.
+ * \param[in] version  The version of the format.
+ *
+ * \return The magic code as it appears in memory.
+ */
+constexpr magic_t build_magic(char endian, char format = 'R', version_t version = BRS_VERSION)
 {
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-    return ('B' << 24) | ('R' << 16) | (endian <<  8) | (static_cast<unsigned char>(BRS_VERSION) <<  0);
+    return ('B' << 24) | (format << 16) | (endian <<  8) | (static_cast<unsigned char>(version) <<  0);
 #else
-    return ('B' <<  0) | ('R' <<  8) | (endian << 16) | (static_cast<unsigned char>(BRS_VERSION) << 24);
+    return ('B' <<  0) | (format <<  8) | (endian << 16) | (static_cast<unsigned char>(version) << 24);
 #endif
 }
 
 constexpr magic_t const         BRS_MAGIC_BIG_ENDIAN    = build_magic('B');
 constexpr magic_t const         BRS_MAGIC_LITTLE_ENDIAN = build_magic('L');
 
+constexpr magic_t const         BRS_MAGIC_V1_BIG_ENDIAN    = build_magic('B', 'R', BRS_VERSION_1);
+constexpr magic_t const         BRS_MAGIC_V1_LITTLE_ENDIAN = build_magic('L', 'R', BRS_VERSION_1);
+
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 constexpr magic_t const         BRS_MAGIC = BRS_MAGIC_BIG_ENDIAN;
+constexpr magic_t const         BRS_MAGIC_V1 = BRS_MAGIC_V1_BIG_ENDIAN;
 #else
 constexpr magic_t const         BRS_MAGIC = BRS_MAGIC_LITTLE_ENDIAN;
+constexpr magic_t const         BRS_MAGIC_V1 = BRS_MAGIC_V1_LITTLE_ENDIAN;
 #endif
 
 
+/** \brief Errors reported without exceptions.
+ *
+ * By default, the serializer and the deserializer throw an exception
+ * when something goes wrong. Decoding untrusted input with many
+ * malformed buffers is faster without exceptions. The
+ * serializer::set_exceptions() and deserializer::try_deserialize()
+ * functions instead save the first error in a result_t. Only programming
+ * errors (i.e. calling reset() from a callback) still throw.
+ */
+typedef std::uint8_t                error_code_t;
+
+constexpr error_code_t const        ERROR_NONE = 0;
+constexpr error_code_t const        ERROR_TRUNCATED = 1;            // input ends in the middle of a hunk
+constexpr error_code_t const        ERROR_MAGIC_MISSING = 2;        // input too small to include the magic
+constexpr error_code_t const        ERROR_MAGIC_UNSUPPORTED = 3;    // not a BRS buffer or wrong endianness
+constexpr error_code_t const        ERROR_UNKNOWN_TYPE = 4;         // unknown hunk type or extension
+constexpr error_code_t const        ERROR_INVALID_HUNK = 5;         // i.e. a map item without a sub-name
+constexpr error_code_t const        ERROR_LIMIT_EXCEEDED = 6;       // one of the limits_t was reached
+constexpr error_code_t const        ERROR_INVALID_DATA = 7;         // data does not match what is being read
+constexpr error_code_t const        ERROR_CALLBACK = 8;             // a callback returned false
+constexpr error_code_t const        ERROR_EMPTY_NAME = 9;           // name or sub-name is empty
+constexpr error_code_t const        ERROR_OUT_OF_RANGE = 10;        // name, index, or data too large
+
+
+inline char const * error_name(error_code_t code)
+{
+    switch(code)
+    {
+    case ERROR_NONE:                return "none";
+    case ERROR_TRUNCATED:           return "truncated";
+    case ERROR_MAGIC_MISSING:       return "magic missing";
+    case ERROR_MAGIC_UNSUPPORTED:   return "magic unsupported";
+    case ERROR_UNKNOWN_TYPE:        return "unknown type";
+    case ERROR_INVALID_HUNK:        return "invalid hunk";
+    case ERROR_LIMIT_EXCEEDED:      return "limit exceeded";
+    case ERROR_INVALID_DATA:        return "invalid data";
+    case ERROR_CALLBACK:            return "callback failed";
+    case ERROR_EMPTY_NAME:          return "empty name";
+    case ERROR_OUT_OF_RANGE:        return "out of range";
+    default:                        return "unknown error";
+    }
+}
+
+
+/** \brief The result of an operation which does not throw.
+ *
+ * The f_offset is the offset of the hunk being read or written when
+ * the error occurred, from the start of the stream (the magic code
+ * included).
+ */
+struct result_t
+{
+    explicit operator bool () const
+    {
+        return f_error == ERROR_NONE;
+    }
+
+    error_code_t    f_error = ERROR_NONE;
+    std::size_t     f_offset = 0;
+};
+
+
+
+struct field_t;
+
+
+/** \brief Statistics gathered by an instrumented serializer or deserializer.
+ *
+ * When the BRS_INSTRUMENTATION macro is defined before including this
+ * header, the serializer and the deserializer gather statistics about
+ * the hunks they write and read. The statistics are available through
+ * their get_stats() function.
+ *
+ * The f_hunks and f_bytes arrays are indexed by type (TYPE_FIELD,
+ * TYPE_ARRAY, TYPE_MAP, TYPE_EXTENDED). The f_bytes counters include the hunk header,
+ * the index or sub-name, the name, and the data. The end of a sub-field
+ * is counted as a TYPE_FIELD hunk without a name.
+ *
+ * The f_callback_time and f_parse_time are only used by the deserializer.
+ * The callback time excludes the time spent parsing sub-fields from
+ * within your callback; that time is added to the parse time instead.
+ *
+ * \warning
+ * The macro must be defined the same way in all the compilation units
+ * that instantiate the same serializer<S> or deserializer<S> type.
+ */
+struct stats_t
+{
+    void reset()
+    {
+        *this = stats_t();
+    }
+
+    void add_hunk(
+          type_t type
+        , name_t const & name
+        , std::size_t header_size
+        , std::size_t data_size)
+    {
+        std::size_t const size(header_size + name.length() + data_size);
+        ++f_hunks[type];
+        f_bytes[type] += size;
+        if(!name.empty())
+        {
+            f_field_bytes[name] += size;
+        }
+    }
+
+    std::size_t                         f_hunks[4] = {};
+    std::size_t                         f_bytes[4] = {};
+    std::map<name_t, std::size_t>       f_field_bytes = std::map<name_t, std::size_t>();
+    std::chrono::nanoseconds            f_callback_time = std::chrono::nanoseconds();
+    std::chrono::nanoseconds            f_parse_time = std::chrono::nanoseconds();
+    std::size_t                         f_depth = 0;
+    std::size_t                         f_max_depth = 0;
+};
+
+
+/** \brief Hooks called by an instrumented serializer or deserializer.
+ *
+ * Derive from this class and override the functions you are interested
+ * in, then call set_hooks() on your serializer or deserializer. The
+ * hooks are only called when BRS_INSTRUMENTATION is defined.
+ *
+ * The \p header_size parameter of the on_hunk() function is the size of
+ * the hunk header including the array index or map sub-name, but not
+ * including the name.
+ *
+ * The depth passed to on_start_subfield() and on_end_subfield() is the
+ * depth of the sub-field, the root being at depth 0.
+ */
+class instrumentation_hooks
+{
+public:
+    virtual             ~instrumentation_hooks() {}
+
+    virtual void        on_hunk(
+                              type_t type
+                            , name_t const & name
+                            , std::size_t header_size
+                            , std::size_t data_size)
+                        {
+                            snapdev::NOT_USED(type, name, header_size, data_size);
+                        }
+
+    virtual void        on_start_subfield(name_t const & name, std::size_t depth)
+                        {
+                            snapdev::NOT_USED(name, depth);
+                        }
+
+    virtual void        on_end_subfield(std::size_t depth)
+                        {
+                            snapdev::NOT_USED(depth);
+                        }
+
+    virtual void        on_callback(field_t const & field, std::chrono::nanoseconds duration)
+                        {
+                            snapdev::NOT_USED(field, duration);
+                        }
+};
+
+
+/** \brief Compress and decompress the data of large fields.
+ *
+ * A serializer with a codec (see serializer::set_compression()) saves
+ * the data of large fields compressed in an EXTENSION_COMPRESSED hunk.
+ * A deserializer with a codec of the same type decompresses that data
+ * when your callback reads it, so the callback does not change.
+ *
+ * The library offers the brs::zstd_codec (see brs/compress.h).
+ */
+class payload_codec
+{
+public:
+    virtual             ~payload_codec() {}
+
+    /** \brief The identifier of this codec, one of the CODEC_... values.
+     *
+     * \return The identifier saved in the compressed hunks.
+     */
+    virtual codec_t     id() const = 0;
+
+    /** \brief Compress \p size bytes of \p data.
+     *
+     * \param[in] data  The data to compress.
+     * \param[in] size  The size of \p data.
+     * \param[out] compressed  The compressed data.
+     *
+     * \return false if the data could not be compressed; it then gets
+     * saved as is.
+     */
+    virtual bool        compress(void const * data, std::size_t size, std::string & compressed) = 0;
+
+    /** \brief Decompress the data of a hunk.
+     *
+     * \param[in] compressed  The compressed data.
+     * \param[in] compressed_size  The size of \p compressed.
+     * \param[out] data  The buffer receiving the decompressed data.
+     * \param[in] size  The exact size of the decompressed data.
+     *
+     * \return true if exactly \p size bytes were decompressed.
+     */
+    virtual bool        decompress(void const * compressed, std::size_t compressed_size, void * data, std::size_t size) = 0;
+};
+
+
+/** \brief Describe one column of a vector of records.
+ *
+ * The serializer add_columns() and deserializer read_columns() functions
+ * save and restore a vector of records one member at a time. Each member
+ * is described by a column: the name of the hunk and a pointer to the
+ * member. Use the column() function to create columns.
+ *
+ * Only members of trivially copyable types can be saved in a column.
+ *
+ * \tparam R  The type of the records.
+ * \tparam M  The type of the member.
+ */
+template<typename R, typename M>
+struct column_t
+{
+    static_assert(std::is_trivially_copyable<M>::value
+                , "columns only support trivially copyable members.");
+    static_assert(!std::is_same<M, bool>::value
+                , "columns do not support bool members (std::vector<bool> has no data()), use std::uint8_t instead.");
+
+    name_t          f_name = name_t();
+    M R::*          f_member = nullptr;
+};
+
+
+template<typename R, typename M>
+column_t<R, M> column(name_t const & name, M R::* member)
+{
+    return column_t<R, M>{ name, member };
+}
+
+
+/** \brief Check whether an output stream supports gathered writes.
+ *
+ * An output stream with a `writev(iovec const * fragments, int count)`
+ * function receives the fragments of a value saved with the serializer
+ * add_value(name, fragments, count) function as is. The stream must
+ * write them after any data it received through write() so far, which
+ * allows a file descriptor based stream to send its pending data and
+ * the fragments with a single writev(2) call.
+ *
+ * Other streams receive each fragment with one write() call.
+ *
+ * \tparam S  The type of output stream.
+ */
+template<typename S, typename = void>
+struct has_writev
+    : public std::false_type
+{
+};
+
+
+template<typename S>
+struct has_writev<S, std::void_t<decltype(std::declval<S &>().writev(std::declval<iovec const *>(), 0))>>
+    : public std::true_type
+{
+};
+
+
+
+/** \brief Output stream which only counts bytes.
+ *
+ * Use this class as the stream of a serializer to compute the exact size
+ * of a buffer without writing anything. You can then reserve that exact
+ * amount of memory (or allocate a shared memory segment of that size)
+ * and serialize your data for real.
+ *
+ * \code
+ *     brs::size_counter counter;
+ *     brs::serializer out(counter);
+ *     my_object.serialize(out);
+ *
+ *     std::vector<char> buffer;
+ *     buffer.reserve(counter.size());
+ *     ...
+ * \endcode
+ *
+ * Your serialization code has to be a template (or use `auto` as the
+ * type of the serializer parameter) so it can be used with this
+ * counter and your real output stream. See also brs::measure().
+ */
+class size_counter
+{
+public:
+    typedef char        char_type;
+
+    size_counter & write(char_type const * s, std::streamsize count)
+    {
+        snapdev::NOT_USED(s);
+        f_size += count;
+        return *this;
+    }
+
+    std::size_t size() const
+    {
+        return f_size;
+    }
+
+    void reset()
+    {
+        f_size = 0;
+    }
+
+private:
+    std::size_t         f_size = 0;
+};
+
 
 /** \brief Class to serialize your data.
  *
@@ -136,22 +508,147 @@ public:
     /** \brief Initialize the stream with the magic header.
      *
      * This function adds the magic header at the beginning of your file.
+     *
+     * When the hunks are embedded in another format which already
+     * includes its own magic code (i.e. the records of a
+     * brs::record_writer), set \p include_magic to false.
+     *
+     * \param[in] output  The stream where the data gets written.
+     * \param[in] include_magic  Whether to write the magic code.
      */
-    serializer(S & output)
-        : f_output(output)
+    serializer(S & output, bool include_magic = true)
+        : f_output(&output)
     {
-        magic_t const magic(BRS_MAGIC);
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(&magic)
-                , sizeof(magic));
+        if(include_magic)
+        {
+            write_magic();
+        }
+    }
+
+
+    /** \brief Start a new buffer.
+     *
+     * This function binds the serializer to a new \p output stream and
+     * writes the magic header, as the constructor does. This allows you
+     * to keep one serializer per thread and reuse it for each message
+     * instead of creating a new serializer each time.
+     *
+     * When compiled with BRS_INSTRUMENTATION, the statistics are not
+     * reset by this function. Call reset_stats() if you want per message
+     * statistics.
+     *
+     * \param[in] output  The stream where the data gets written.
+     * \param[in] include_magic  Whether to write the magic code.
+     */
+    void reset(S & output, bool include_magic = true)
+    {
+        f_output = &output;
+        f_offset = 0;
+        if(include_magic)
+        {
+            write_magic();
+        }
+    }
+
+
+
+    /** \brief Report errors without exceptions.
+     *
+     * By default, the serializer throws an exception when a name is
+     * empty or a name, index, or value is too large. After calling this
+     * function with false, the hunk is not written instead and the first
+     * error is saved in the result returned by get_result().
+     *
+     * \param[in] exceptions  Whether errors are reported with exceptions.
+     */
+    void set_exceptions(bool exceptions)
+    {
+        f_exceptions = exceptions;
+    }
+
+
+    /** \brief Get the first error.
+     *
+     * When exceptions are turned off, this result holds the first error
+     * that occurred since the serializer was created or clear_result()
+     * was last called.
+     *
+     * \return The result of the serialization so far.
+     */
+    result_t const & get_result() const
+    {
+        return f_result;
+    }
+
+
+    void clear_result()
+    {
+        f_result = result_t();
+    }
+
+
+    /** \brief Align the payloads in memory.
+     *
+     * By default, the data of a hunk directly follows its name so a
+     * double saved in a buffer is rarely aligned. In aligned mode, the
+     * serializer adds padding hunks so that each payload starts at the
+     * natural alignment of its type. Payloads of LARGE_PAYLOAD_SIZE
+     * bytes or more are aligned to LARGE_PAYLOAD_ALIGNMENT (a cache
+     * line) so arrays can directly be used with SIMD instructions.
+     * Strings and other byte payloads are never padded.
+     *
+     * The alignment is relative to the start of the output (i.e. the
+     * magic code). The buffer must itself be loaded at an address
+     * aligned to LARGE_PAYLOAD_ALIGNMENT for the payloads to be aligned
+     * in memory. Then node::view() (see brs/document.h) gives you typed
+     * access to the arrays without copying them.
+     *
+     * The deserializer and the document skip the padding hunks.
+     *
+     * \param[in] aligned  Whether payloads get aligned.
+     */
+    void set_aligned(bool aligned)
+    {
+        f_aligned = aligned;
+    }
+
+
+    bool is_aligned() const
+    {
+        return f_aligned;
+    }
+
+
+    /** \brief Compress the data of large fields.
+     *
+     * Once a \p codec is set, the data of fields saved with
+     * add_value(name, ...) is compressed when it is at least
+     * \p threshold bytes. The data is saved compressed only if that
+     * makes the hunk smaller. Smaller fields, array items, map items,
+     * and values saved from fragments are never compressed, so the
+     * cost of small numeric fields does not change.
+     *
+     * The deserializer reading the buffer needs a codec of the same type
+     * (see deserializer::set_compression()). The codec is not owned by
+     * the serializer. Pass nullptr to stop compressing.
+     *
+     * \param[in] codec  The codec used to compress the data.
+     * \param[in] threshold  The size of the smallest payload to compress.
+     */
+    void set_compression(payload_codec * codec, std::size_t threshold = COMPRESSION_THRESHOLD)
+    {
+        f_codec = codec;
+        f_compression_threshold = threshold;
     }
 
+
     template<typename T>
     void add_value(name_t name, T const * ptr, std::size_t size)
     {
         if(name.length() == 0)
         {
-            throw brs_cannot_be_empty("name cannot be an empty string");
+            error<brs_cannot_be_empty>(ERROR_EMPTY_NAME, "name cannot be an empty string");
+            return;
         }
 
 #pragma GCC diagnostic push
@@ -166,20 +663,94 @@ public:
         if(hunk_sizes.f_name != name.length()
         || hunk_sizes.f_hunk != size)
         {
-            throw brs_out_of_range("name or hunk too large");
+            error<brs_out_of_range>(ERROR_OUT_OF_RANGE, "name or hunk too large");
+            return;
+        }
+
+        if(f_codec != nullptr
+        && size >= f_compression_threshold
+        && add_compressed(name, ptr, size))
+        {
+            return;
+        }
+
+        align<T>(sizeof(hunk_sizes) + hunk_sizes.f_name, size);
+        write(&hunk_sizes, sizeof(hunk_sizes));
+        write(name.c_str(), hunk_sizes.f_name);
+        write(ptr, size);
+
+        instrument_hunk(TYPE_FIELD, name, sizeof(hunk_sizes), size);
+    }
+
+    /** \brief Save a value found in multiple fragments.
+     *
+     * When a value is spread in multiple buffers (a rope, a list of
+     * network buffers), this function saves all the fragments in a
+     * single hunk without first concatenating them. The hunk is the same
+     * as the one created by add_value(name, ptr, size) with the
+     * concatenated data.
+     *
+     * If the output stream supports gathered writes (see has_writev),
+     * the fragments are passed to its writev() function without being
+     * copied.
+     *
+     * \param[in] name  The name of the field to be saved.
+     * \param[in] fragments  The fragments of the value.
+     * \param[in] count  The number of fragments.
+     */
+    void add_value(name_t name, iovec const * fragments, std::size_t count)
+    {
+        if(name.length() == 0)
+        {
+            error<brs_cannot_be_empty>(ERROR_EMPTY_NAME, "name cannot be an empty string");
+            return;
+        }
+
+        std::size_t size(0);
+        for(std::size_t idx(0); idx < count; ++idx)
+        {
+            size += fragments[idx].iov_len;
+        }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+        hunk_sizes_t const hunk_sizes = {
+            .f_type = TYPE_FIELD,
+            .f_name = static_cast<std::uint8_t>(name.length()),
+            .f_hunk = static_cast<std::uint32_t>(size & 0x00FFFFFF),
+        };
+#pragma GCC diagnostic pop
+
+        if(hunk_sizes.f_name != name.length()
+        || hunk_sizes.f_hunk != size
+        || count > static_cast<std::size_t>(std::numeric_limits<int>::max()))
+        {
+            error<brs_out_of_range>(ERROR_OUT_OF_RANGE, "name or hunk too large");
+            return;
+        }
+
+        write(&hunk_sizes, sizeof(hunk_sizes));
+        write(name.c_str(), hunk_sizes.f_name);
+        if constexpr (has_writev<S>::value)
+        {
+            f_output->writev(fragments, static_cast<int>(count));
+            f_offset += size;
+        }
+        else
+        {
+            for(std::size_t idx(0); idx < count; ++idx)
+            {
+                write(fragments[idx].iov_base, fragments[idx].iov_len);
+            }
         }
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(&hunk_sizes)
-                , sizeof(hunk_sizes));
+        instrument_hunk(TYPE_FIELD, name, sizeof(hunk_sizes), size);
+    }
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(name.c_str())
-                , hunk_sizes.f_name);
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(ptr)
-                , size);
+    void add_value(name_t name, std::vector<iovec> const & fragments)
+    {
+        add_value(name, fragments.data(), fragments.size());
     }
 
     template<typename T>
@@ -187,7 +758,14 @@ public:
     {
         if(name.length() == 0)
         {
-            throw brs_cannot_be_empty("name cannot be an empty string");
+            error<brs_cannot_be_empty>(ERROR_EMPTY_NAME, "name cannot be an empty string");
+            return;
+        }
+
+        if(index > 0xFFFF)
+        {
+            add_run(name, EXTENSION_ARRAY32, index, 1, ptr, size);
+            return;
         }
 
 #pragma GCC diagnostic push
@@ -204,24 +782,17 @@ public:
         || hunk_sizes.f_hunk != size
         || index != idx)
         {
-            throw brs_out_of_range("name, index, or hunk too large");
+            error<brs_out_of_range>(ERROR_OUT_OF_RANGE, "name, index, or hunk too large");
+            return;
         }
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(&hunk_sizes)
-                , sizeof(hunk_sizes));
-
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(&idx)
-                , sizeof(idx));
+        align<T>(sizeof(hunk_sizes) + sizeof(idx) + hunk_sizes.f_name, size);
+        write(&hunk_sizes, sizeof(hunk_sizes));
+        write(&idx, sizeof(idx));
+        write(name.c_str(), hunk_sizes.f_name);
+        write(ptr, size);
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(name.c_str())
-                , hunk_sizes.f_name);
-
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(ptr)
-                , size);
+        instrument_hunk(TYPE_ARRAY, name, sizeof(hunk_sizes) + sizeof(idx), size);
     }
 
     template<typename T>
@@ -229,12 +800,14 @@ public:
     {
         if(name.empty())
         {
-            throw brs_cannot_be_empty("name cannot be an empty string");
+            error<brs_cannot_be_empty>(ERROR_EMPTY_NAME, "name cannot be an empty string");
+            return;
         }
 
         if(sub_name.empty())
         {
-            throw brs_cannot_be_empty("sub-name cannot be an empty string");
+            error<brs_cannot_be_empty>(ERROR_EMPTY_NAME, "sub-name cannot be an empty string");
+            return;
         }
 
 #pragma GCC diagnostic push
@@ -251,28 +824,18 @@ public:
         || hunk_sizes.f_hunk != size
         || sub_name.length() >= (1 << 8))
         {
-            throw brs_out_of_range("name, sub-name, or hunk too large");
+            error<brs_out_of_range>(ERROR_OUT_OF_RANGE, "name, sub-name, or hunk too large");
+            return;
         }
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(&hunk_sizes)
-                , sizeof(hunk_sizes));
-
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(&len)
-                , sizeof(len));
+        align<T>(sizeof(hunk_sizes) + sizeof(len) + len + hunk_sizes.f_name, size);
+        write(&hunk_sizes, sizeof(hunk_sizes));
+        write(&len, sizeof(len));
+        write(sub_name.c_str(), len);
+        write(name.c_str(), hunk_sizes.f_name);
+        write(ptr, size);
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(sub_name.c_str())
-                , len);
-
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(name.c_str())
-                , hunk_sizes.f_name);
-
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(ptr)
-                , size);
+        instrument_hunk(TYPE_MAP, name, sizeof(hunk_sizes) + sizeof(len) + len, size);
     }
 
     /** \brief Save a basic type or struct of basic types.
@@ -290,6 +853,9 @@ public:
     template<typename T>
     void add_value(name_t name, T const & value)
     {
+        static_assert(std::is_trivially_copyable<T>::value
+                    , "values must be trivially copyable.");
+
         add_value(name, &value, sizeof(value));
     }
 
@@ -346,43 +912,164 @@ public:
     }
 
 
+    /** \brief Save a whole vector in one hunk.
+     *
+     * The items of the vector are saved as is, one after the other, in a
+     * single hunk. The size of the hunk is the number of items times the
+     * size of one item. Read the vector back with read_data(), which
+     * resizes it and fills it with one read.
+     *
+     * Only vectors of trivially copyable items (basic types and structures
+     * of basic types) are supported.
+     *
+     * \exception brs_out_of_range
+     * The name or the vector is too large.
+     *
+     * \tparam T  The type of the items.
+     * \param[in] name  The name of the field.
+     * \param[in] value  The vector to save.
+     */
     template<typename T>
-    typename std::enable_if<snapdev::is_vector<T>::value
+    typename std::enable_if<std::is_trivially_copyable<T>::value
             , void>::type
-    add_value(name_t name, std::vector<T> & value)
+    add_value(name_t name, std::vector<T> const & value)
     {
-        add_value(name, value.data(), value.size());
+        add_value(name, value.data(), value.size() * sizeof(T));
     }
 
 
-    void start_subfield(name_t name)
+    /** \brief Save consecutive items of an array.
+     *
+     * This function saves \p count items starting at array index
+     * \p first_index. The items are saved in runs: one hunk with the
+     * index of the first item, the number of items, and all the items.
+     * This avoids writing one header and one index per item. When the
+     * items do not fit in one hunk, the array is automatically split in
+     * multiple runs.
+     *
+     * Your callback receives one call per run. The field f_index is the
+     * index of the first item and f_count is the number of items in the
+     * run. Use the read_data() function with a vector to read all the
+     * items at once.
+     *
+     * Items saved one at a time with add_value(name, index, value) remain
+     * the most compact for sparse arrays. Indexes larger than 65535 are
+     * supported by both functions.
+     *
+     * \exception brs_out_of_range
+     * The name is too long, an index is out of range, or a single item
+     * does not fit in a hunk.
+     *
+     * \tparam T  The type of the items, which must be trivially copyable.
+     * \param[in] name  The name of the array.
+     * \param[in] values  A pointer to the items.
+     * \param[in] count  The number of items to save.
+     * \param[in] first_index  The index of the first item.
+     */
+    template<typename T>
+    void add_array(name_t name, T const * values, std::size_t count, int first_index = 0)
     {
+        static_assert(std::is_trivially_copyable<T>::value
+                    , "array items must be trivially copyable.");
+
         if(name.empty())
         {
-            throw brs_cannot_be_empty("name cannot be an empty string");
+            error<brs_cannot_be_empty>(ERROR_EMPTY_NAME, "name cannot be an empty string");
+            return;
         }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wpedantic"
-        hunk_sizes_t const hunk_sizes = {
-            .f_type = TYPE_FIELD,
+        std::size_t const max_items(0x007FFFFF / sizeof(T));
+        if(first_index < 0
+        || count > static_cast<std::size_t>(std::numeric_limits<int>::max() - first_index)
+        || max_items == 0)
+        {
+            error<brs_out_of_range>(ERROR_OUT_OF_RANGE, "index or item too large");
+            return;
+        }
+
+        while(count > 0)
+        {
+            std::size_t const run(std::min(count, max_items));
+            add_run(name, EXTENSION_ARRAY_RUN, first_index, run, values, run * sizeof(T));
+            values += run;
+            first_index += static_cast<int>(run);
+            count -= run;
+        }
+    }
+
+
+    template<typename T>
+    void add_array(name_t name, std::vector<T> const & values, int first_index = 0)
+    {
+        add_array(name, values.data(), values.size(), first_index);
+    }
+
+
+    /** \brief Save a whole map in one hunk.
+     *
+     * This function saves all the entries of \p container in a single
+     * hunk named \p name. This is much more compact than saving each
+     * entry with add_value(name, sub_name, value) since the name and
+     * header are written once and the keys are not limited to 255
+     * characters. Read the map back with the deserializer read_map()
+     * function.
+     *
+     * The keys and values must be std::string or trivially copyable
+     * types. Strings are saved with a 32 bit size followed by their
+     * characters and other types are saved as is. The data starts with
+     * the 32 bit number of entries.
+     *
+     * \exception brs_out_of_range
+     * The resulting hunk is too large.
+     *
+     * \tparam C  The type of container (i.e. std::map, std::unordered_map).
+     * \param[in] name  The name of the field to be saved.
+     * \param[in] container  The map to be saved.
+     */
+    template<typename C>
+    void add_map(name_t name, C const & container)
+    {
+        std::string packed;
+        append_map_item(packed, static_cast<std::uint32_t>(container.size()));
+        for(auto const & entry : container)
+        {
+            append_map_item(packed, entry.first);
+            append_map_item(packed, entry.second);
+        }
+        add_value(name, packed.data(), packed.length());
+    }
+
+
+    void start_subfield(name_t name)
+    {
+        if(name.empty())
+        {
+            error<brs_cannot_be_empty>(ERROR_EMPTY_NAME, "name cannot be an empty string");
+            return;
+        }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+        hunk_sizes_t const hunk_sizes = {
+            .f_type = TYPE_EXTENDED,
             .f_name = static_cast<std::uint8_t>(name.length()),
             .f_hunk = 0,
         };
 #pragma GCC diagnostic pop
+        extension_t const extension(EXTENSION_SUBFIELD);
 
         if(hunk_sizes.f_name != name.length())
         {
-            throw brs_out_of_range("name too large");
+            error<brs_out_of_range>(ERROR_OUT_OF_RANGE, "name too large");
+            return;
         }
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(&hunk_sizes)
-                , sizeof(hunk_sizes));
+        write(&hunk_sizes, sizeof(hunk_sizes));
+        write(&extension, sizeof(extension));
+        write(name.c_str(), hunk_sizes.f_name);
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(name.c_str())
-                , hunk_sizes.f_name);
+        instrument_hunk(TYPE_EXTENDED, name, sizeof(hunk_sizes) + sizeof(extension), 0);
+        instrument_start_subfield(name);
     }
 
 
@@ -397,234 +1084,2366 @@ public:
         };
 #pragma GCC diagnostic pop
 
-        f_output.write(
-                  reinterpret_cast<typename S::char_type const *>(&hunk_sizes)
-                , sizeof(hunk_sizes));
+        write(&hunk_sizes, sizeof(hunk_sizes));
+
+        instrument_end_subfield();
     }
 
 
-private:
-    S &         f_output = S();
-};
+    /** \brief Save a vector of records in columns.
+     *
+     * Instead of saving each record in its own sub-field, this function
+     * saves each member of the records in one hunk (a column) with all
+     * the values of that member. This avoids repeating the names and
+     * headers of each record and keeps the values of a member contiguous.
+     *
+     * The columns are saved in a sub-field named \p name. Read them back
+     * with the deserializer read_columns() function.
+     *
+     * \code
+     *     out.add_columns(
+     *               "points"
+     *             , f_points
+     *             , brs::column("x", &point::f_x)
+     *             , brs::column("y", &point::f_y));
+     * \endcode
+     *
+     * \tparam R  The type of the records.
+     * \tparam M  The types of the members.
+     * \param[in] name  The name of the sub-field.
+     * \param[in] records  The records to save.
+     * \param[in] columns  The description of the members to save.
+     */
+    template<typename R, typename ...M>
+    void add_columns(
+          name_t name
+        , std::vector<R> const & records
+        , column_t<R, M> const & ... columns)
+    {
+        start_subfield(name);
+        if(!records.empty())
+        {
+            (add_column(records, columns), ...);
+        }
+        end_subfield();
+    }
 
 
-template<typename S>
-class recursive
-{
-public:
-    recursive(serializer<S> & s, name_t name)
-        : f_serializer(s)
+#ifdef BRS_INSTRUMENTATION
+    stats_t const & get_stats() const
     {
-        f_serializer.start_subfield(name);
+        return f_stats;
     }
 
-    ~recursive()
+
+    void reset_stats()
     {
-        f_serializer.end_subfield();
+        f_stats.reset();
+    }
+
+
+    void set_hooks(instrumentation_hooks * hooks)
+    {
+        f_hooks = hooks;
     }
+#endif
+
 
 private:
-    serializer<S> &     f_serializer;
-};
+    template<typename T>
+    void add_run(
+          name_t const & name
+        , extension_t extension
+        , int index
+        , std::size_t count
+        , T const * ptr
+        , std::size_t size)
+    {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+        hunk_sizes_t const hunk_sizes = {
+            .f_type = TYPE_EXTENDED,
+            .f_name = static_cast<std::uint8_t>(name.length()),
+            .f_hunk = static_cast<std::uint32_t>(size & 0x00FFFFFF),
+        };
+#pragma GCC diagnostic pop
 
+        if(hunk_sizes.f_name != name.length()
+        || hunk_sizes.f_hunk != size
+        || index < 0)
+        {
+            error<brs_out_of_range>(ERROR_OUT_OF_RANGE, "name, index, or hunk too large");
+            return;
+        }
 
+        std::uint32_t const idx(index);
+        std::uint32_t const cnt(count);
+        std::size_t header_size(sizeof(hunk_sizes) + sizeof(extension) + sizeof(idx));
+        if(extension == EXTENSION_ARRAY_RUN)
+        {
+            header_size += sizeof(cnt);
+        }
 
+        align<T>(header_size + hunk_sizes.f_name, size);
+        write(&hunk_sizes, sizeof(hunk_sizes));
+        write(&extension, sizeof(extension));
+        write(&idx, sizeof(idx));
 
+        if(extension == EXTENSION_ARRAY_RUN)
+        {
+            write(&cnt, sizeof(cnt));
+        }
 
+        write(name.c_str(), hunk_sizes.f_name);
+        write(ptr, size);
 
+        instrument_hunk(TYPE_EXTENDED, name, header_size, size);
+    }
 
 
-/** \brief When deserializing, the data is saved in a field.
- *
- * This field holds the data of one field.
- */
-struct field_t
-{
-    void reset()
+    template<typename E>
+    void error(error_code_t code, char const * message)
     {
-        f_name.clear();
-        f_sub_name.clear();
-        f_index = -1;
-        f_size = 0;
+        if(f_exceptions)
+        {
+            throw E(message);
+        }
+        if(f_result)
+        {
+            f_result.f_error = code;
+            f_result.f_offset = f_offset;
+        }
     }
 
-    std::string     f_name = std::string();
-    std::string     f_sub_name = std::string();
-    int             f_index = -1;
-    std::size_t     f_size = 0;         // size of the data (still in stream)
-};
 
+    /** \brief Save a field with its data compressed.
+     *
+     * \return false if the data did not get smaller, in which case
+     * nothing was written.
+     */
+    bool add_compressed(name_t const & name, void const * ptr, std::size_t size)
+    {
+        std::uint32_t const uncompressed_size(static_cast<std::uint32_t>(size));
+        codec_t const codec(f_codec->id());
+        std::size_t const extra(sizeof(extension_t) + sizeof(codec) + sizeof(uncompressed_size));
+        if(!f_codec->compress(ptr, size, f_compressed)
+        || f_compressed.length() + extra >= size)
+        {
+            return false;
+        }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+        hunk_sizes_t const hunk_sizes = {
+            .f_type = TYPE_EXTENDED,
+            .f_name = static_cast<std::uint8_t>(name.length()),
+            .f_hunk = static_cast<std::uint32_t>(f_compressed.length()),
+        };
+#pragma GCC diagnostic pop
+        extension_t const extension(EXTENSION_COMPRESSED);
+
+        write(&hunk_sizes, sizeof(hunk_sizes));
+        write(&extension, sizeof(extension));
+        write(&codec, sizeof(codec));
+        write(&uncompressed_size, sizeof(uncompressed_size));
+        write(name.c_str(), hunk_sizes.f_name);
+        write(f_compressed.data(), f_compressed.length());
+
+        instrument_hunk(TYPE_EXTENDED, name, sizeof(hunk_sizes) + extra, f_compressed.length());
+        return true;
+    }
 
-/** \brief Unserialize the specified buffer.
- *
- * This function reads each hunk and calls the specified \p callback
- * with them. You can then save the data in your object fields.
- *
- * The root buffer is expected to include the magic code at the start.
- * Set the \p include_magic to true in that case to verify that it
- * is indeed set and valid. If you do not do that, the unserialization
- * will fail since everything will be off by sizeof(magic_t).
- *
- * \param[in] buffer  The buffer to unserialize.
- * \param[in] callback  The callback manager used to store the callbacks to
- * call on each hunk.
- * \param[in] includes_magic  Whether \p buffer includes the a magic code
- * at the start or not. The top buffer is expected to include a magic
- * code. Sub-buffers should not include the magic code.
- *
- * \return true if the unserialization succeeded, false otherwise.
- */
-template<typename S>
-class deserializer
-{
-public:
-    typedef std::function<bool(deserializer<S> &, field_t const &)>    process_hunk_t;
 
-    deserializer(S & input)
-        : f_input(input)
+    void write(void const * data, std::size_t size)
     {
-        magic_t magic = {};
-        f_input.read(reinterpret_cast<typename S::char_type *>(&magic), sizeof(magic));
-        if(!f_input || f_input.gcount() != sizeof(magic))
+        f_output->write(reinterpret_cast<typename S::char_type const *>(data), size);
+        f_offset += size;
+    }
+
+
+    /** \brief Add a padding hunk if the next payload is not aligned.
+     *
+     * \tparam T  The type of the payload.
+     * \param[in] header_size  The size of the next hunk header and name.
+     * \param[in] size  The size of the next payload.
+     */
+    template<typename T>
+    void align(std::size_t header_size, std::size_t size)
+    {
+        std::size_t alignment(alignof(T));
+        if(!f_aligned
+        || alignment == 1)
+        {
+            return;
+        }
+        if(size >= LARGE_PAYLOAD_SIZE)
         {
-            throw brs_magic_missing("magic missing from the start of the buffer.");
+            alignment = std::max(alignment, LARGE_PAYLOAD_ALIGNMENT);
+        }
+        if((f_offset + header_size) % alignment == 0)
+        {
+            return;
         }
 
-        // once we have multiple versions, this is where we'll start splitting
-        // hairs to make it all work; for now, we have one so it's easy
-        //
-        if(magic != BRS_MAGIC)
+        std::size_t const padding_header(sizeof(hunk_sizes_t) + sizeof(extension_t));
+        std::size_t const padding((alignment - (f_offset + padding_header + header_size) % alignment) % alignment);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+        hunk_sizes_t const hunk_sizes = {
+            .f_type = TYPE_EXTENDED,
+            .f_name = 0,
+            .f_hunk = static_cast<std::uint32_t>(padding),
+        };
+#pragma GCC diagnostic pop
+        extension_t const extension(EXTENSION_PADDING);
+
+        write(&hunk_sizes, sizeof(hunk_sizes));
+        write(&extension, sizeof(extension));
+        char const zeroes[LARGE_PAYLOAD_ALIGNMENT] = {};
+        for(std::size_t left(padding); left > 0;)
         {
-            throw brs_magic_unsupported("magic unsupported.");
+            std::size_t const n(std::min(left, sizeof(zeroes)));
+            write(zeroes, n);
+            left -= n;
         }
+
+        instrument_hunk(TYPE_EXTENDED, name_t(), padding_header, padding);
     }
 
 
-    bool deserialize(process_hunk_t & callback)
+    template<typename T>
+    static void append_map_item(std::string & packed, T const & value)
     {
-        for(;;)
-        {
-            hunk_sizes_t hunk_sizes = {};
-            f_input.read(reinterpret_cast<typename S::char_type *>(&hunk_sizes), sizeof(hunk_sizes));
-            if(!f_input || f_input.gcount() != sizeof(hunk_sizes))
-            {
-                return f_input.eof() && f_input.gcount() == 0;
-            }
+        static_assert(std::is_trivially_copyable<T>::value
+                    , "map keys and values must be std::string or trivially copyable.");
 
-            f_field.reset();
-            f_field.f_size = hunk_sizes.f_hunk;
-
-            switch(hunk_sizes.f_type)
-            {
-            case TYPE_FIELD:
-                if(hunk_sizes.f_name == 0
-                && hunk_sizes.f_hunk == 0)
-                {
-                    // we found an "end sub-field" entry
-                    //
-                    return true;
-                }
-                break;
+        packed.append(reinterpret_cast<char const *>(&value), sizeof(value));
+    }
 
-            case TYPE_ARRAY:
-                {
-                    std::uint16_t idx(0);
-                    f_input.read(reinterpret_cast<typename S::char_type *>(&idx), sizeof(idx));
-                    if(!f_input || f_input.gcount() != sizeof(idx))
-                    {
-                        return false;
-                    }
-                    f_field.f_index = idx;
-                }
-                break;
 
-            case TYPE_MAP:
-                {
-                    std::uint8_t len(0);
-                    f_input.read(reinterpret_cast<typename S::char_type *>(&len), sizeof(len));
-                    if(!f_input || f_input.gcount() != sizeof(len))
-                    {
-                        return false;
-                    }
-                    if(len == 0)
-                    {
-                        throw brs_map_name_cannot_be_empty("the length of a map's field name cannot be zero.");
-                    }
-                    f_field.f_sub_name.resize(len);
-                    f_input.read(reinterpret_cast<typename S::char_type *>(f_field.f_sub_name.data()), len);
-                    if(!f_input || f_input.gcount() != len)
-                    {
-                        return false;
-                    }
-                }
-                break;
+    static void append_map_item(std::string & packed, std::string const & value)
+    {
+        append_map_item(packed, static_cast<std::uint32_t>(value.length()));
+        packed.append(value);
+    }
 
-            default:
-                throw brs_unknown_type("read a field with an unknown type.");
 
-            }
+    void write_magic()
+    {
+        magic_t const magic(BRS_MAGIC);
+        write(&magic, sizeof(magic));
+    }
 
-            f_field.f_name.resize(hunk_sizes.f_name);
-            f_input.read(reinterpret_cast<typename S::char_type *>(f_field.f_name.data()), hunk_sizes.f_name);
-            if(!f_input || f_input.gcount() != hunk_sizes.f_name)
-            {
-                return false;
-            }
 
-            callback(*this, f_field);
+    template<typename R, typename M>
+    void add_column(std::vector<R> const & records, column_t<R, M> const & c)
+    {
+        std::vector<M> values;
+        values.reserve(records.size());
+        for(auto const & r : records)
+        {
+            values.push_back(r.*(c.f_member));
         }
+        add_value(c.f_name, values.data(), values.size() * sizeof(M));
     }
 
-    template<typename T>
-    bool read_data(T & data)
+
+    void instrument_hunk(
+          type_t type
+        , name_t const & name
+        , std::size_t header_size
+        , std::size_t data_size)
     {
-        if(f_field.f_size != sizeof(data))
+#ifdef BRS_INSTRUMENTATION
+        f_stats.add_hunk(type, name, header_size, data_size);
+        if(f_hooks != nullptr)
         {
-            throw brs_logic_error(
-                      "hunk size is "
-                    + std::to_string(f_field.f_size)
-                    + ", but you are trying to read "
-                    + std::to_string(sizeof(data))
-                    + '.');
+            f_hooks->on_hunk(type, name, header_size, data_size);
         }
-
-        f_input.read(reinterpret_cast<typename S::char_type *>(&data), sizeof(data));
-        return verify_size(sizeof(data));
+#else
+        snapdev::NOT_USED(type, name, header_size, data_size);
+#endif
     }
 
-    bool read_data(std::string & data)
+
+    void instrument_start_subfield(name_t const & name)
     {
-        data.resize(f_field.f_size);
-        f_input.read(reinterpret_cast<typename S::char_type *>(data.data()), f_field.f_size);
-        return verify_size(f_field.f_size);
+#ifdef BRS_INSTRUMENTATION
+        ++f_stats.f_depth;
+        f_stats.f_max_depth = std::max(f_stats.f_max_depth, f_stats.f_depth);
+        if(f_hooks != nullptr)
+        {
+            f_hooks->on_start_subfield(name, f_stats.f_depth);
+        }
+#else
+        snapdev::NOT_USED(name);
+#endif
     }
 
-    template<typename T>
-    bool read_data(std::vector<T> & data)
+
+    void instrument_end_subfield()
     {
-        if(f_field.f_size % sizeof(data.value_type) != 0)
+#ifdef BRS_INSTRUMENTATION
+        instrument_hunk(TYPE_FIELD, name_t(), sizeof(hunk_sizes_t), 0);
+        if(f_hooks != nullptr)
         {
-            throw brs_logic_error(
-                      "hunk size ("
-                    + std::to_string(f_field.f_size)
-                    + ") is not a multiple of the vector item size: "
-                    + std::to_string(sizeof(data.value_type))
-                    + '.');
+            f_hooks->on_end_subfield(f_stats.f_depth);
+        }
+        if(f_stats.f_depth > 0)
+        {
+            --f_stats.f_depth;
         }
+#endif
+    }
+
 
-        data.resize(f_field.f_size / sizeof(data.value_type));
-        f_input.read(reinterpret_cast<typename S::char_type *>(data.data()), f_field.f_size);
-        return verify_size(f_field.f_size);
+    S *         f_output = nullptr;
+    std::size_t f_offset = 0;
+    bool        f_aligned = false;
+    bool        f_exceptions = true;
+    result_t    f_result = result_t();
+    payload_codec * f_codec = nullptr;
+    std::size_t f_compression_threshold = COMPRESSION_THRESHOLD;
+    std::string f_compressed = std::string();
+#ifdef BRS_INSTRUMENTATION
+    stats_t                     f_stats = stats_t();
+    instrumentation_hooks *     f_hooks = nullptr;
+#endif
+};
+
+
+/** \brief Compute the size of a buffer.
+ *
+ * This function calls \p f with a serializer writing to a
+ * brs::size_counter and returns the number of bytes that \p f would
+ * have written, including the magic code when \p include_magic is true.
+ *
+ * \code
+ *     auto serialize = [&](auto & out)
+ *         {
+ *             out.add_value("name", f_name);
+ *             out.add_value("size", f_size);
+ *         };
+ *     std::string buffer;
+ *     buffer.reserve(brs::measure(serialize));
+ * \endcode
+ *
+ * \param[in] f  A function accepting a brs::serializer<brs::size_counter> &.
+ * \param[in] include_magic  Whether to count the magic code.
+ *
+ * \return The size of the serialized data in bytes.
+ */
+template<typename F>
+std::size_t measure(F const & f, bool include_magic = true)
+{
+    size_counter counter;
+    serializer<size_counter> out(counter, include_magic);
+    f(out);
+    return counter.size();
+}
+
+
+template<typename S>
+class recursive
+{
+public:
+    recursive(serializer<S> & s, name_t name)
+        : f_serializer(s)
+    {
+        f_serializer.start_subfield(name);
     }
 
-private:
-    bool verify_size(std::size_t expected_size)
+    ~recursive()
     {
-        return f_input && static_cast<ssize_t>(expected_size) != f_input.gcount();
+        f_serializer.end_subfield();
     }
 
-    S &         f_input;
-    field_t     f_field = field_t();
+private:
+    serializer<S> &     f_serializer;
+};
+
+
+
+
+
+
+
+
+/** \brief A string with inline storage.
+ *
+ * The names of the hunks are limited by the format (127 characters for
+ * a name and 255 for a map sub-name). The deserializer saves them in
+ * this fixed size buffer instead of an std::string so reading hunks
+ * with long names never allocates memory.
+ *
+ * The string can be used as an std::string_view and it gets converted
+ * to an std::string when required (i.e. to save it in a container).
+ *
+ * \tparam N  The maximum number of characters.
+ */
+template<std::size_t N>
+class fixed_string
+{
+public:
+                        fixed_string() = default;
+
+                        fixed_string(std::string_view value)
+                        {
+                            resize(value.length());
+                            memcpy(f_data, value.data(), value.length());
+                        }
+
+    static constexpr std::size_t capacity() { return N; }
+
+    std::size_t         length() const { return f_length; }
+    std::size_t         size() const { return f_length; }
+    bool                empty() const { return f_length == 0; }
+    char *              data() { return f_data; }
+    char const *        data() const { return f_data; }
+    char const *        c_str() const { return f_data; }
+    char const *        begin() const { return f_data; }
+    char const *        end() const { return f_data + f_length; }
+
+    void clear()
+    {
+        f_length = 0;
+        f_data[0] = '\0';
+    }
+
+    void resize(std::size_t length)
+    {
+        if(length > N)
+        {
+            throw brs_out_of_range("string too large");
+        }
+        f_length = static_cast<std::uint16_t>(length);
+        f_data[length] = '\0';
+    }
+
+    operator std::string_view () const
+    {
+        return std::string_view(f_data, f_length);
+    }
+
+    operator std::string () const
+    {
+        return std::string(f_data, f_length);
+    }
+
+    friend bool operator == (fixed_string const & lhs, std::string_view rhs)
+    {
+        return std::string_view(lhs) == rhs;
+    }
+
+    friend bool operator == (std::string_view lhs, fixed_string const & rhs)
+    {
+        return lhs == std::string_view(rhs);
+    }
+
+    friend bool operator != (fixed_string const & lhs, std::string_view rhs)
+    {
+        return std::string_view(lhs) != rhs;
+    }
+
+    friend bool operator != (std::string_view lhs, fixed_string const & rhs)
+    {
+        return lhs != std::string_view(rhs);
+    }
+
+    friend bool operator < (fixed_string const & lhs, fixed_string const & rhs)
+    {
+        return std::string_view(lhs) < std::string_view(rhs);
+    }
+
+    friend std::string operator + (std::string_view lhs, fixed_string const & rhs)
+    {
+        std::string result(lhs);
+        result.append(rhs.f_data, rhs.f_length);
+        return result;
+    }
+
+    friend std::string operator + (fixed_string const & lhs, std::string_view rhs)
+    {
+        std::string result(lhs.f_data, lhs.f_length);
+        result.append(rhs);
+        return result;
+    }
+
+    friend std::ostream & operator << (std::ostream & out, fixed_string const & value)
+    {
+        return out << std::string_view(value);
+    }
+
+private:
+    std::uint16_t       f_length = 0;
+    char                f_data[N + 1] = {};
+};
+
+
+constexpr std::size_t const         MAX_NAME_LENGTH = 127;      // see hunk_sizes_t::f_name
+constexpr std::size_t const         MAX_SUB_NAME_LENGTH = 255;  // 8 bit length
+
+typedef fixed_string<MAX_NAME_LENGTH>       field_name_t;
+typedef fixed_string<MAX_SUB_NAME_LENGTH>   field_sub_name_t;
+
+
+/** \brief When deserializing, the data is saved in a field.
+ *
+ * This field holds the data of one field. The names are saved inline
+ * (see fixed_string) so a field_t never allocates memory.
+ */
+struct field_t
+{
+    void reset()
+    {
+        f_name.clear();
+        f_sub_name.clear();
+        f_index = -1;
+        f_count = 1;
+        f_size = 0;
+        f_header_size = 0;
+        f_compressed_size = 0;
+        f_compressed = false;
+        f_subfield = false;
+    }
+
+    field_name_t        f_name = field_name_t();
+    field_sub_name_t    f_sub_name = field_sub_name_t();
+    int             f_index = -1;
+    std::size_t     f_count = 1;        // number of array items (see add_array())
+    std::size_t     f_size = 0;         // size of the data (still in stream)
+    std::size_t     f_header_size = 0;  // size of the hunk header, without the name
+    std::size_t     f_compressed_size = 0;  // size of the data in the stream when compressed (f_size is the uncompressed size)
+    bool            f_compressed = false;   // data is compressed (EXTENSION_COMPRESSED)
+    bool            f_subfield = false; // start of a sub-field (see start_subfield())
+};
+
+
+/** \brief One field of a batch.
+ *
+ * The deserialize_batch() function hands your callback an array of
+ * these records. The names and the data point to a buffer owned by the
+ * deserializer which remains valid until your callback returns. The
+ * data is never compressed; compressed hunks get decompressed before
+ * the batch is delivered.
+ *
+ * A record with f_subfield set to true is always alone and last in its
+ * batch. It has no data. Your callback is expected to read it with
+ * deserialize() or deserialize_batch(), or skip it with skip_field(),
+ * as with a regular callback.
+ */
+struct field_record_t
+{
+    std::string_view    f_name = std::string_view();
+    std::string_view    f_sub_name = std::string_view();
+    int                 f_index = -1;
+    std::size_t         f_count = 1;        // number of array items (see add_array())
+    char const *        f_data = nullptr;
+    std::size_t         f_size = 0;
+    bool                f_subfield = false;
+};
+
+
+/** \brief Resource limits applied while deserializing.
+ *
+ * A buffer received from an untrusted source can declare many large
+ * hunks or nest sub-fields very deeply. These limits are checked by the
+ * deserializer as it reads each hunk header, before the name, sub-name,
+ * or data gets allocated, and a brs_limit_exceeded exception is raised
+ * if one of them is reached.
+ *
+ * \li f_max_total_bytes -- the total number of bytes of all the hunks
+ * read so far (headers, names, and data); the magic is not included;
+ * \li f_max_field_size -- the maximum size of the data of one hunk;
+ * \li f_max_hunks -- the maximum number of hunks, including the
+ * sub-field start and end markers;
+ * \li f_max_depth -- the maximum number of nested sub-fields, that is,
+ * how many times your callbacks can recursively call deserialize().
+ *
+ * By default, all the limits are set to the maximum so nothing gets
+ * limited.
+ */
+struct limits_t
+{
+    std::size_t     f_max_total_bytes = std::numeric_limits<std::size_t>::max();
+    std::size_t     f_max_field_size = std::numeric_limits<std::size_t>::max();
+    std::size_t     f_max_hunks = std::numeric_limits<std::size_t>::max();
+    std::size_t     f_max_depth = std::numeric_limits<std::size_t>::max();
+};
+
+
+/** \brief Unserialize the specified buffer.
+ *
+ * This function reads each hunk and calls the specified \p callback
+ * with them. You can then save the data in your object fields.
+ *
+ * The root buffer is expected to include the magic code at the start.
+ * Set the \p include_magic to true in that case to verify that it
+ * is indeed set and valid. If you do not do that, the unserialization
+ * will fail since everything will be off by sizeof(magic_t).
+ *
+ * The constructor accepts an \p include_magic parameter. It is true by
+ * default. Hunks embedded in another format, such as the records of a
+ * brs::record_reader, do not include the magic code.
+ *
+ * \param[in] input  The stream to unserialize.
+ * \param[in] include_magic  Whether \p input includes the a magic code
+ * at the start or not. The top buffer is expected to include a magic
+ * code. Sub-buffers should not include the magic code.
+ */
+template<typename S>
+class deserializer
+{
+public:
+    typedef std::function<bool(deserializer<S> &, field_t const &)>    process_hunk_t;
+    typedef std::function<bool(deserializer<S> &, field_record_t const *, std::size_t)>  process_batch_t;
+
+    deserializer(S & input, bool include_magic = true)
+        : f_input(&input)
+    {
+        if(include_magic)
+        {
+            read_magic();
+        }
+    }
+
+
+    /** \brief Start reading a new buffer.
+     *
+     * This function binds the deserializer to a new \p input stream and
+     * verifies its magic code, as the constructor does. The limits are
+     * kept and the counters used to verify them are reset. The memory
+     * already allocated by the deserializer (i.e. the field names) is
+     * kept, so a deserializer reused for each message does not need to
+     * allocate anything once it handled a few messages.
+     *
+     * This function cannot be called while deserialize() is running.
+     *
+     * \param[in] input  The stream to unserialize.
+     * \param[in] include_magic  Whether \p input includes the a magic code.
+     */
+    void reset(S & input, bool include_magic = true)
+    {
+        if(f_depth != 0)
+        {
+            throw brs_logic_error("reset() cannot be called while deserializing.");
+        }
+
+        f_input = &input;
+        f_field.reset();
+        f_result = result_t();
+        f_hunks = 0;
+        f_total_bytes = 0;
+        f_start = 0;
+        f_hunk_offset = 0;
+        f_version = BRS_VERSION;
+        if(include_magic)
+        {
+            read_magic();
+        }
+    }
+
+
+    /** \brief Start reading a new buffer without exceptions.
+     *
+     * This function is the same as reset() except that an invalid magic
+     * code is reported in the returned result instead of an exception.
+     * To avoid exceptions altogether, create the deserializer with
+     * \p include_magic set to false, then call this function.
+     *
+     * \param[in] input  The stream to unserialize.
+     * \param[in] include_magic  Whether \p input includes the a magic code.
+     *
+     * \return The result, ERROR_MAGIC_MISSING or ERROR_MAGIC_UNSUPPORTED
+     * if the magic code is not valid.
+     */
+    result_t try_reset(S & input, bool include_magic = true)
+    {
+        exceptions_guard guard(*this);
+        f_result = result_t();
+        reset(input, include_magic);
+        return f_result;
+    }
+
+
+    /** \brief Change the resource limits.
+     *
+     * By default the deserializer accepts any number of hunks of any
+     * size. When reading data from an untrusted source, you want to
+     * set limits so a crafted buffer cannot make you allocate huge
+     * amounts of memory or recurse too deeply.
+     *
+     * The limits can be changed at any time. The counters are not reset
+     * by this function.
+     *
+     * \param[in] limits  The new limits.
+     */
+    void set_limits(limits_t const & limits)
+    {
+        f_limits = limits;
+    }
+
+
+    limits_t const & get_limits() const
+    {
+        return f_limits;
+    }
+
+
+    /** \brief Set the codec used to decompress compressed fields.
+     *
+     * Fields saved by a serializer with a codec may be compressed (see
+     * serializer::set_compression()). With a codec of the same type,
+     * the read_data() and other read functions decompress the data
+     * transparently. The data is only decompressed if your callback
+     * reads it; skipped fields are not decompressed.
+     *
+     * Such fields have f_compressed set to true, their f_size is the
+     * uncompressed size and f_compressed_size is the size of the data
+     * in the stream. The uncompressed size is also verified against the
+     * f_max_field_size limit. The codec is not owned by the deserializer.
+     *
+     * \param[in] codec  The codec used to decompress the data.
+     */
+    void set_compression(payload_codec * codec)
+    {
+        f_codec = codec;
+    }
+
+
+    bool deserialize(process_hunk_t & callback)
+    {
+        if(!verify_depth())
+        {
+            return false;
+        }
+        depth_guard guard(*this);
+
+        for(;;)
+        {
+            switch(next_hunk())
+            {
+            case next_hunk_t::NEXT_HUNK_EOF:
+            case next_hunk_t::NEXT_HUNK_END:
+                return true;
+
+            case next_hunk_t::NEXT_HUNK_ERROR:
+                return false;
+
+            case next_hunk_t::NEXT_HUNK_FIELD:
+                if(!deliver(callback))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                throw brs_logic_error("unexpected next_hunk() result.");
+
+            }
+        }
+    }
+
+
+    /** \brief Deserialize without exceptions.
+     *
+     * This function works like deserialize() except that errors found
+     * in the input are returned instead of being thrown. This includes
+     * errors found by the functions called from your callbacks, such as
+     * read_data() with a type which does not match the size of the hunk
+     * (they return false instead of throwing).
+     *
+     * Contrary to deserialize(), the value returned by your callbacks is
+     * used: returning false stops the deserialization. If the callback
+     * returned false because of an error detected by the deserializer,
+     * that error is returned, otherwise the error is ERROR_CALLBACK.
+     *
+     * A callback receiving a sub-field can call either deserialize() or
+     * try_deserialize(); neither throws while a try_deserialize() is
+     * running.
+     *
+     * \param[in] callback  The function called for each hunk.
+     *
+     * \return The result with the first error and the offset of the
+     * hunk where it occurred.
+     */
+    result_t try_deserialize(process_hunk_t & callback)
+    {
+        exceptions_guard guard(*this);
+        if(f_depth == 0)
+        {
+            f_result = result_t();
+        }
+        if(!deserialize(callback)
+        && f_result)
+        {
+            fail(ERROR_TRUNCATED);
+        }
+        return f_result;
+    }
+
+
+    /** \brief Deserialize hunks in batches.
+     *
+     * This function works like deserialize() except that it reads up to
+     * \p batch_size hunks ahead, with their data, and then calls your
+     * \p callback once with an array of records (see field_record_t).
+     * For flat messages made of many small fields, this avoids one
+     * callback call per hunk and lets you process the fields in a tight
+     * loop.
+     *
+     * A batch also ends when its data fills BATCH_DATA_SIZE bytes, at the
+     * end of the input, and before a sub-field. A field larger than that
+     * buffer gets delivered in a batch of its own.
+     *
+     * The buffers holding the records and their data belong to the
+     * deserializer, one set per depth, and get reused by the following
+     * calls, including after a reset().
+     *
+     * The read_data() and other read functions cannot be used on the
+     * records since their data was already read. They are only useful
+     * with a sub-field record, which is always last.
+     *
+     * Version 1 buffers do not mark their sub-fields, so this function
+     * fails with brs_magic_unsupported on them.
+     *
+     * \code
+     *     brs::deserializer<std::stringstream>::process_batch_t func(
+     *         [&](brs::deserializer<std::stringstream> & in
+     *           , brs::field_record_t const * records
+     *           , std::size_t count)
+     *         {
+     *             for(std::size_t idx(0); idx < count; ++idx)
+     *             {
+     *                 ...handle records[idx]...
+     *             }
+     *             return true;
+     *         });
+     *     in.deserialize_batch(func);
+     * \endcode
+     *
+     * \param[in] callback  The function called with each batch.
+     * \param[in] batch_size  The maximum number of records per batch.
+     *
+     * \return true if the data was read successfully.
+     */
+    bool deserialize_batch(process_batch_t & callback, std::size_t batch_size = BATCH_SIZE)
+    {
+        if(f_version == BRS_VERSION_1)
+        {
+            return error<brs_magic_unsupported>(ERROR_MAGIC_UNSUPPORTED, "batches cannot be used with version 1 buffers.");
+        }
+        if(!verify_depth())
+        {
+            return false;
+        }
+        depth_guard guard(*this);
+
+        // the buffers are kept per depth and reused by the following
+        // calls; the deque does not move them when a nested call adds
+        // a depth
+        //
+        if(f_batches.size() < f_depth)
+        {
+            f_batches.resize(f_depth);
+        }
+        batch_t & batch(f_batches[f_depth - 1]);
+        std::vector<field_record_t> & records(batch.f_records);
+        std::string & data(batch.f_data);
+        records.clear();
+        data.clear();
+        records.reserve(std::max(batch_size, static_cast<std::size_t>(1)));
+        data.reserve(BATCH_DATA_SIZE);
+
+        for(;;)
+        {
+            switch(next_hunk())
+            {
+            case next_hunk_t::NEXT_HUNK_EOF:
+            case next_hunk_t::NEXT_HUNK_END:
+                return deliver_batch(callback, records, data);
+
+            case next_hunk_t::NEXT_HUNK_ERROR:
+                return false;
+
+            case next_hunk_t::NEXT_HUNK_FIELD:
+                if(f_field.f_subfield
+                && !deliver_batch(callback, records, data))
+                {
+                    return false;
+                }
+                if(!add_record(callback, records, data))
+                {
+                    return false;
+                }
+                if((f_field.f_subfield
+                        || records.size() >= batch_size
+                        || data.length() >= BATCH_DATA_SIZE)
+                && !deliver_batch(callback, records, data))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                throw brs_logic_error("unexpected next_hunk() result.");
+
+            }
+        }
+    }
+
+
+    /** \brief Deserialize hunks in batches without exceptions.
+     *
+     * This function is to deserialize_batch() what try_deserialize() is
+     * to deserialize().
+     *
+     * \param[in] callback  The function called with each batch.
+     * \param[in] batch_size  The maximum number of records per batch.
+     *
+     * \return The result with the first error and the offset of the
+     * hunk where it occurred.
+     */
+    result_t try_deserialize_batch(process_batch_t & callback, std::size_t batch_size = BATCH_SIZE)
+    {
+        exceptions_guard guard(*this);
+        if(f_depth == 0)
+        {
+            f_result = result_t();
+        }
+        if(!deserialize_batch(callback, batch_size)
+        && f_result)
+        {
+            fail(ERROR_TRUNCATED);
+        }
+        return f_result;
+    }
+
+
+    /** \brief Deserialize only the fields matching a projection.
+     *
+     * This function works like deserialize() except that the \p callback
+     * only gets called for the hunks matching one of the paths of the
+     * \p paths projection (see brs/projection.h). The data of all the
+     * other hunks is skipped without being copied and the sub-fields
+     * which are not part of any path are skipped as a whole.
+     *
+     * The sub-fields found along the paths are handled internally. Your
+     * callback only sees the leaves, with f_field.f_name set to the name
+     * of the last segment. Use matched_path() to know which path matched.
+     * If a path ends on a sub-field, the callback is called with it and
+     * it is expected to call deserialize() as usual.
+     *
+     * Only the explicit sub-field markers (see start_subfield()) can be
+     * skipped. Version 1 buffers, written before those markers were
+     * introduced, must be read with the plain deserialize() function;
+     * this function fails with brs_magic_unsupported on them.
+     *
+     * \tparam P  The projection type, brs::projection.
+     * \param[in] callback  The function called for each matching hunk.
+     * \param[in] paths  The compiled paths of the fields to deliver.
+     *
+     * \return true if the data was read successfully.
+     */
+    template<typename P>
+    bool deserialize(process_hunk_t & callback, P const & paths)
+    {
+        if(f_version == BRS_VERSION_1)
+        {
+            return error<brs_magic_unsupported>(ERROR_MAGIC_UNSUPPORTED, "projections cannot be used with version 1 buffers.");
+        }
+        return deserialize_projection(callback, paths, P::ROOT);
+    }
+
+
+    /** \brief Skip the current field.
+     *
+     * A callback which is not interested in a field can call this function
+     * instead of reading its data. If the field is the start of a
+     * sub-field, the whole sub-field is skipped. The limits still apply
+     * to the skipped hunks. If part of the data was already read with
+     * read_partial(), only the rest gets skipped.
+     *
+     * \return true if the field was skipped, false if the input is
+     * truncated.
+     */
+    bool skip_field()
+    {
+        return skip_hunk();
+    }
+
+
+    /** \brief Return the version of the buffer being read.
+     *
+     * Buffers written by version 1 of the library start sub-fields with
+     * a field without data (f_subfield is false). Your callback must
+     * know which fields are sub-fields and call deserialize() on them
+     * as it did with that version. The projected deserialize() and
+     * deserialize_batch() need the sub-field hunks, so they refuse
+     * version 1 buffers.
+     *
+     * A buffer read without a magic code is expected to use the current
+     * version.
+     *
+     * \return BRS_VERSION or BRS_VERSION_1.
+     */
+    version_t get_version() const
+    {
+        return f_version;
+    }
+
+
+    /** \brief Return the number of the path that matched.
+     *
+     * While your callback is called by the projected deserialize(), this
+     * function returns the number of the path that matched the current
+     * hunk. Paths are numbered in the order they were added to the
+     * projection.
+     *
+     * \return The number of the matching path.
+     */
+    std::size_t matched_path() const
+    {
+        return f_matched_path;
+    }
+
+
+#ifdef BRS_INSTRUMENTATION
+    stats_t const & get_stats() const
+    {
+        return f_stats;
+    }
+
+
+    void reset_stats()
+    {
+        f_stats.reset();
+    }
+
+
+    void set_hooks(instrumentation_hooks * hooks)
+    {
+        f_hooks = hooks;
+    }
+#endif
+
+    template<typename T>
+    bool read_data(T & data)
+    {
+        if(f_field.f_size != sizeof(data))
+        {
+            if(f_exceptions)
+            {
+                throw brs_logic_error(
+                          "hunk size is "
+                        + std::to_string(f_field.f_size)
+                        + ", but you are trying to read "
+                        + std::to_string(sizeof(data))
+                        + '.');
+            }
+            return fail(ERROR_INVALID_DATA);
+        }
+        if(!verify_unread())
+        {
+            return false;
+        }
+
+        f_data_read = f_field.f_size;
+        return read_payload(&data, sizeof(data));
+    }
+
+    bool read_data(std::string & data)
+    {
+        if(!verify_unread())
+        {
+            return false;
+        }
+        data.resize(f_field.f_size);
+        f_data_read = f_field.f_size;
+        return read_payload(data.data(), f_field.f_size);
+    }
+
+    template<typename T>
+    bool read_data(std::vector<T> & data)
+    {
+        static_assert(std::is_trivially_copyable<T>::value
+                    , "vector items must be trivially copyable.");
+
+        if(f_field.f_size % sizeof(T) != 0)
+        {
+            if(f_exceptions)
+            {
+                throw brs_logic_error(
+                          "hunk size ("
+                        + std::to_string(f_field.f_size)
+                        + ") is not a multiple of the vector item size: "
+                        + std::to_string(sizeof(T))
+                        + '.');
+            }
+            return fail(ERROR_INVALID_DATA);
+        }
+        if(!verify_unread())
+        {
+            return false;
+        }
+
+        data.resize(f_field.f_size / sizeof(T));
+        f_data_read = f_field.f_size;
+        return read_payload(data.data(), f_field.f_size);
+    }
+
+
+    /** \brief Read the data directly in your own buffer.
+     *
+     * The other read_data() functions resize their destination first.
+     * This function instead reads the data of the current hunk in a
+     * buffer you already allocated, such as a slot of a memory pool or
+     * a ring buffer. The number of bytes read is f_size of the field
+     * (minus what was already read with read_partial()).
+     *
+     * \exception brs_logic_error
+     * The data does not fit in \p size bytes.
+     *
+     * \param[out] ptr  The buffer receiving the data.
+     * \param[in] size  The size of that buffer in bytes.
+     *
+     * \return true if the data was read.
+     */
+    bool read_into(void * ptr, std::size_t size)
+    {
+        std::size_t const remaining(remaining_data());
+        if(remaining > size)
+        {
+            if(f_exceptions)
+            {
+                throw brs_logic_error(
+                          "hunk size is "
+                        + std::to_string(remaining)
+                        + ", but the buffer only has "
+                        + std::to_string(size)
+                        + " bytes.");
+            }
+            return fail(ERROR_INVALID_DATA);
+        }
+
+        f_data_read += remaining;
+        return read_payload(ptr, remaining);
+    }
+
+
+    /** \brief Read the data of a hunk in chunks.
+     *
+     * This function reads up to \p size bytes of the data of the current
+     * hunk in \p ptr. Call it in a loop until remaining_data() returns 0
+     * to stream a large payload to its destination (i.e. a file) with a
+     * small buffer.
+     *
+     * \code
+     *     while(in.remaining_data() > 0)
+     *     {
+     *         std::size_t size(sizeof(buf));
+     *         if(!in.read_partial(buf, size))
+     *         {
+     *             return false;
+     *         }
+     *         out.write(buf, size);
+     *     }
+     * \endcode
+     *
+     * If you stop before the end, call skip_field() to skip the rest of
+     * the data. The read_data() and read_map() functions cannot be used
+     * on a hunk once read_partial() read some of its data.
+     *
+     * \param[out] ptr  The buffer receiving the data.
+     * \param[in,out] size  The size of the buffer on entry, the number of
+     * bytes read on return.
+     *
+     * \return true if the data was read, false if the input is truncated.
+     */
+    bool read_partial(void * ptr, std::size_t & size)
+    {
+        size = std::min(size, remaining_data());
+        f_data_read += size;
+        return read_payload(ptr, size);
+    }
+
+
+    /** \brief Take the data of a hunk in a newly allocated buffer.
+     *
+     * This function allocates a buffer of the size of the data of the
+     * current hunk and reads the data in it. Contrary to
+     * read_data(std::string &), the buffer is not cleared first. You
+     * become the owner of the buffer.
+     *
+     * \param[out] data  The buffer receiving the data. Its size is f_size
+     * of the field.
+     *
+     * \return true if the data was read.
+     */
+    bool take_data(std::unique_ptr<char[]> & data)
+    {
+        if(!verify_codec())
+        {
+            return false;
+        }
+        std::size_t const remaining(remaining_data());
+        data.reset(new char[remaining]);
+        return read_into(data.get(), remaining);
+    }
+
+
+    /** \brief Number of bytes of data not read yet.
+     *
+     * This is the size of the data of the current hunk minus the bytes
+     * already read. It is 0 once read_data() or read_map() read the hunk.
+     *
+     * \return The number of bytes left in the current hunk.
+     */
+    std::size_t remaining_data() const
+    {
+        return f_field.f_size - f_data_read;
+    }
+
+
+    /** \brief Read a map saved with add_map().
+     *
+     * Call this function from your callback when you receive the field
+     * saved with the serializer add_map() function. The entries are
+     * added to \p container. Existing entries with the same keys are
+     * replaced.
+     *
+     * \exception brs_logic_error
+     * The data does not match the layout of a map with these key and
+     * value types.
+     *
+     * \tparam C  The type of container (i.e. std::map, std::unordered_map).
+     * \param[out] container  The map receiving the entries.
+     *
+     * \return true if the data was read.
+     */
+    template<typename C>
+    bool read_map(C & container)
+    {
+        if(!verify_unread())
+        {
+            return false;
+        }
+        std::string packed(f_field.f_size, '\0');
+        f_data_read = f_field.f_size;
+        if(!read_payload(packed.data(), f_field.f_size))
+        {
+            return false;
+        }
+
+        char const * ptr(packed.data());
+        char const * const end(ptr + packed.length());
+        std::uint32_t count(0);
+        if(!read_map_item(ptr, end, count))
+        {
+            return false;
+        }
+        for(; count > 0; --count)
+        {
+            typename C::key_type key;
+            typename C::mapped_type value;
+            if(!read_map_item(ptr, end, key)
+            || !read_map_item(ptr, end, value))
+            {
+                return false;
+            }
+            container.insert_or_assign(std::move(key), std::move(value));
+        }
+        if(ptr != end)
+        {
+            return error<brs_logic_error>(ERROR_INVALID_DATA, "map data has extra bytes after the last entry.");
+        }
+
+        return true;
+    }
+
+
+    /** \brief Read a vector of records saved in columns.
+     *
+     * Call this function from your callback when you receive the
+     * sub-field saved with the serializer add_columns() function. It
+     * reads the sub-field and saves each column it finds in the
+     * corresponding member of the records.
+     *
+     * The \p records vector is resized to the number of records found
+     * in the columns. You do not have to list all the columns that were
+     * saved; the data of the other columns is skipped.
+     *
+     * \exception brs_logic_error
+     * The size of a column is not a multiple of its member's size or
+     * the number of values differs between columns.
+     *
+     * \tparam R  The type of the records.
+     * \tparam M  The types of the members.
+     * \param[out] records  The vector of records to fill.
+     * \param[in] columns  The description of the members to read.
+     *
+     * \return The result of the sub-field deserialization.
+     */
+    template<typename R, typename ...M>
+    bool read_columns(std::vector<R> & records, column_t<R, M> const & ... columns)
+    {
+        records.clear();
+        process_hunk_t func([&records, &columns...](deserializer<S> & in, field_t const & field)
+            {
+                if(!(in.read_column(records, field, columns) || ...))
+                {
+                    in.skip_field();
+                }
+                return static_cast<bool>(in.f_result);
+            });
+        return deserialize(func);
+    }
+
+private:
+    enum class next_hunk_t
+    {
+        NEXT_HUNK_EOF,          // no more hunks
+        NEXT_HUNK_ERROR,        // input is truncated
+        NEXT_HUNK_END,          // end of the current sub-field
+        NEXT_HUNK_FIELD,        // f_field is ready, data is next in f_input
+    };
+
+
+    /** \brief Read the next hunk header.
+     *
+     * This function reads the header, index or sub-name, and name of the
+     * next hunk in f_field. The data is left in the input stream. Padding
+     * hunks (see serializer::set_aligned()) are skipped.
+     *
+     * \return The type of hunk that was read.
+     */
+    next_hunk_t next_hunk()
+    {
+        for(;;)
+        {
+            bool padding(false);
+            next_hunk_t const result(read_next_hunk(padding));
+            if(result == next_hunk_t::NEXT_HUNK_ERROR)
+            {
+                fail(ERROR_TRUNCATED);
+                return result;
+            }
+            if(!padding)
+            {
+                return result;
+            }
+            if(!skip_data(f_field.f_size))
+            {
+                return next_hunk_t::NEXT_HUNK_ERROR;
+            }
+        }
+    }
+
+
+    next_hunk_t read_next_hunk(bool & padding)
+    {
+        f_hunk_offset = f_start + f_total_bytes;
+        f_data_read = 0;
+        f_payload_offset = 0;
+        f_payload_loaded = false;
+
+        hunk_sizes_t hunk_sizes = {};
+        f_input->read(reinterpret_cast<typename S::char_type *>(&hunk_sizes), sizeof(hunk_sizes));
+        if(!*f_input || f_input->gcount() != sizeof(hunk_sizes))
+        {
+            return f_input->eof() && f_input->gcount() == 0
+                        ? next_hunk_t::NEXT_HUNK_EOF
+                        : next_hunk_t::NEXT_HUNK_ERROR;
+        }
+
+        if(!verify_limits(hunk_sizes))
+        {
+            return next_hunk_t::NEXT_HUNK_ERROR;
+        }
+
+        f_field.reset();
+        f_field.f_size = hunk_sizes.f_hunk;
+        std::size_t header_size(sizeof(hunk_sizes));
+
+        switch(hunk_sizes.f_type)
+        {
+        case TYPE_FIELD:
+            if(hunk_sizes.f_name == 0
+            && hunk_sizes.f_hunk == 0)
+            {
+                // we found an "end sub-field" entry
+                //
+                instrument_hunk(TYPE_FIELD, f_field.f_name, header_size, 0);
+                return next_hunk_t::NEXT_HUNK_END;
+            }
+            break;
+
+        case TYPE_ARRAY:
+            {
+                std::uint16_t idx(0);
+                f_input->read(reinterpret_cast<typename S::char_type *>(&idx), sizeof(idx));
+                if(!*f_input || f_input->gcount() != sizeof(idx))
+                {
+                    return next_hunk_t::NEXT_HUNK_ERROR;
+                }
+                f_field.f_index = idx;
+                header_size += sizeof(idx);
+            }
+            break;
+
+        case TYPE_MAP:
+            {
+                std::uint8_t len(0);
+                f_input->read(reinterpret_cast<typename S::char_type *>(&len), sizeof(len));
+                if(!*f_input || f_input->gcount() != sizeof(len))
+                {
+                    return next_hunk_t::NEXT_HUNK_ERROR;
+                }
+                if(len == 0)
+                {
+                    error<brs_map_name_cannot_be_empty>(ERROR_INVALID_HUNK, "the length of a map's field name cannot be zero.");
+                    return next_hunk_t::NEXT_HUNK_ERROR;
+                }
+                if(!add_total_bytes(len))
+                {
+                    return next_hunk_t::NEXT_HUNK_ERROR;
+                }
+                f_field.f_sub_name.resize(len);
+                f_input->read(reinterpret_cast<typename S::char_type *>(f_field.f_sub_name.data()), len);
+                if(!*f_input || f_input->gcount() != len)
+                {
+                    return next_hunk_t::NEXT_HUNK_ERROR;
+                }
+                header_size += sizeof(len) + len;
+            }
+            break;
+
+        case TYPE_EXTENDED:
+            if(f_version == BRS_VERSION_1)
+            {
+                error<brs_unknown_type>(ERROR_UNKNOWN_TYPE, "read a field with an unknown type.");
+                return next_hunk_t::NEXT_HUNK_ERROR;
+            }
+            {
+                extension_t extension(0);
+                if(!read_extension(header_size, extension))
+                {
+                    return next_hunk_t::NEXT_HUNK_ERROR;
+                }
+                if(extension == EXTENSION_PADDING)
+                {
+                    if(hunk_sizes.f_name != 0)
+                    {
+                        error<brs_invalid_hunk>(ERROR_INVALID_HUNK, "a padding hunk cannot have a name.");
+                        return next_hunk_t::NEXT_HUNK_ERROR;
+                    }
+                    instrument_hunk(TYPE_EXTENDED, f_field.f_name, header_size, f_field.f_size);
+                    padding = true;
+                    return next_hunk_t::NEXT_HUNK_FIELD;
+                }
+            }
+            break;
+
+        default:
+            error<brs_unknown_type>(ERROR_UNKNOWN_TYPE, "read a field with an unknown type.");
+            return next_hunk_t::NEXT_HUNK_ERROR;
+
+        }
+
+        f_field.f_name.resize(hunk_sizes.f_name);
+        f_input->read(reinterpret_cast<typename S::char_type *>(f_field.f_name.data()), hunk_sizes.f_name);
+        if(!*f_input || f_input->gcount() != hunk_sizes.f_name)
+        {
+            return next_hunk_t::NEXT_HUNK_ERROR;
+        }
+
+        f_field.f_header_size = header_size;
+        instrument_hunk(hunk_sizes.f_type, f_field.f_name, header_size, hunk_sizes.f_hunk);
+        return next_hunk_t::NEXT_HUNK_FIELD;
+    }
+
+
+    template<typename P>
+    bool deserialize_projection(process_hunk_t & callback, P const & paths, std::size_t step)
+    {
+        if(!verify_depth())
+        {
+            return false;
+        }
+        depth_guard guard(*this);
+
+        for(;;)
+        {
+            switch(next_hunk())
+            {
+            case next_hunk_t::NEXT_HUNK_EOF:
+            case next_hunk_t::NEXT_HUNK_END:
+                return true;
+
+            case next_hunk_t::NEXT_HUNK_ERROR:
+                return false;
+
+            case next_hunk_t::NEXT_HUNK_FIELD:
+                {
+                    std::size_t const next(paths.match(step, f_field));
+                    if(next == P::NO_MATCH)
+                    {
+                        if(!skip_hunk())
+                        {
+                            return false;
+                        }
+                    }
+                    else if(paths.is_leaf(next))
+                    {
+                        f_matched_path = paths.path(next);
+                        if(!deliver(callback))
+                        {
+                            return false;
+                        }
+                    }
+                    else if(f_field.f_subfield)
+                    {
+                        if(!deserialize_projection(callback, paths, next))
+                        {
+                            return false;
+                        }
+                    }
+                    else if(!skip_payload())
+                    {
+                        return false;
+                    }
+                }
+                break;
+
+            default:
+                throw brs_logic_error("unexpected next_hunk() result.");
+
+            }
+        }
+    }
+
+
+    /** \brief Skip the hunk in f_field.
+     *
+     * The data of the hunk is skipped. If the hunk is the start of a
+     * sub-field, all the hunks up to the corresponding end marker are
+     * skipped too. The limits still apply to the skipped hunks.
+     *
+     * \return true if the hunk was skipped, false if the input is
+     * truncated.
+     */
+    bool skip_hunk()
+    {
+        if(!f_field.f_subfield)
+        {
+            return skip_payload();
+        }
+
+        for(std::size_t depth(1); depth > 0;)
+        {
+            switch(next_hunk())
+            {
+            case next_hunk_t::NEXT_HUNK_EOF:
+            case next_hunk_t::NEXT_HUNK_ERROR:
+                return false;
+
+            case next_hunk_t::NEXT_HUNK_END:
+                --depth;
+                break;
+
+            case next_hunk_t::NEXT_HUNK_FIELD:
+                if(f_field.f_subfield)
+                {
+                    ++depth;
+                }
+                else if(!skip_payload())
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                throw brs_logic_error("unexpected next_hunk() result.");
+
+            }
+        }
+
+        return true;
+    }
+
+
+    /** \brief Skip the data of the current hunk not read yet.
+     *
+     * Compressed data is read all at once, so once decompressed there is
+     * nothing left to skip in the input.
+     */
+    bool skip_payload()
+    {
+        if(!f_field.f_compressed)
+        {
+            return skip_data(remaining_data());
+        }
+        return f_payload_loaded || skip_data(f_field.f_compressed_size);
+    }
+
+
+    bool read_payload(void * ptr, std::size_t size)
+    {
+        if(!f_field.f_compressed)
+        {
+            f_input->read(reinterpret_cast<typename S::char_type *>(ptr), size);
+            return verify_size(size);
+        }
+
+        if(!f_payload_loaded
+        && !load_payload())
+        {
+            return false;
+        }
+        if(size > f_payload.length() - f_payload_offset)
+        {
+            return fail(ERROR_TRUNCATED);
+        }
+        memcpy(ptr, f_payload.data() + f_payload_offset, size);
+        f_payload_offset += size;
+        return true;
+    }
+
+
+    /** \brief Make sure a compressed hunk can be decompressed.
+     *
+     * This is checked before any buffer gets allocated for the
+     * uncompressed data so an unsupported codec does not cost an
+     * allocation of f_size bytes.
+     */
+    bool verify_codec()
+    {
+        if(!f_field.f_compressed
+        || f_payload_loaded
+        || (f_codec != nullptr && f_codec->id() == f_hunk_codec))
+        {
+            return true;
+        }
+        return error<brs_unknown_type>(ERROR_UNKNOWN_TYPE, "the data is compressed with an unsupported codec.");
+    }
+
+
+    /** \brief Make sure none of the data of the hunk was read yet.
+     *
+     * The read_data() and read_map() functions read the whole hunk, so
+     * they cannot be used after read_partial() or read_into() consumed
+     * some of the data. The codec gets verified too (see verify_codec()).
+     */
+    bool verify_unread()
+    {
+        if(f_data_read != 0)
+        {
+            return error<brs_logic_error>(ERROR_INVALID_DATA, "the data of this hunk was already read.");
+        }
+        return verify_codec();
+    }
+
+
+    bool load_payload()
+    {
+        if(!verify_codec())
+        {
+            return false;
+        }
+
+        f_compressed.resize(f_field.f_compressed_size);
+        f_input->read(reinterpret_cast<typename S::char_type *>(f_compressed.data()), f_compressed.length());
+        if(!verify_size(f_compressed.length()))
+        {
+            return false;
+        }
+        f_payload_loaded = true;
+
+        f_payload.resize(f_field.f_size);
+        if(!f_codec->decompress(f_compressed.data(), f_compressed.length(), f_payload.data(), f_payload.length()))
+        {
+            return error<brs_invalid_hunk>(ERROR_INVALID_DATA, "the compressed data is invalid.");
+        }
+        return true;
+    }
+
+
+    bool skip_data(std::size_t size)
+    {
+        if(size == 0)
+        {
+            return true;
+        }
+        f_input->ignore(size);
+        if(*f_input && static_cast<std::size_t>(f_input->gcount()) == size)
+        {
+            return true;
+        }
+        return fail(ERROR_TRUNCATED);
+    }
+
+
+    bool read_extension(std::size_t & header_size, extension_t & extension)
+    {
+        std::uint32_t idx[2] = {};
+        f_input->read(reinterpret_cast<typename S::char_type *>(&extension), sizeof(extension));
+        if(!*f_input || f_input->gcount() != sizeof(extension))
+        {
+            return false;
+        }
+
+        std::size_t size(0);
+        switch(extension)
+        {
+        case EXTENSION_ARRAY32:
+            size = sizeof(idx[0]);
+            break;
+
+        case EXTENSION_ARRAY_RUN:
+            size = sizeof(idx);
+            break;
+
+        case EXTENSION_SUBFIELD:
+            if(f_field.f_size != 0)
+            {
+                return error<brs_invalid_hunk>(ERROR_INVALID_HUNK, "the start of a sub-field cannot include data.");
+            }
+            if(!add_total_bytes(sizeof(extension)))
+            {
+                return false;
+            }
+            f_field.f_subfield = true;
+            header_size += sizeof(extension);
+            return true;
+
+        case EXTENSION_PADDING:
+            if(!add_total_bytes(sizeof(extension)))
+            {
+                return false;
+            }
+            header_size += sizeof(extension);
+            return true;
+
+        case EXTENSION_COMPRESSED:
+            return read_compressed(header_size);
+
+        default:
+            return error<brs_unknown_type>(ERROR_UNKNOWN_TYPE, "read a field with an unknown extension.");
+
+        }
+
+        if(!add_total_bytes(sizeof(extension) + size))
+        {
+            return false;
+        }
+        f_input->read(reinterpret_cast<typename S::char_type *>(idx), size);
+        if(!*f_input || static_cast<std::size_t>(f_input->gcount()) != size)
+        {
+            return false;
+        }
+        if(idx[0] > static_cast<std::uint32_t>(std::numeric_limits<int>::max()))
+        {
+            return error<brs_invalid_hunk>(ERROR_INVALID_HUNK, "array index is too large.");
+        }
+        f_field.f_index = static_cast<int>(idx[0]);
+        if(extension == EXTENSION_ARRAY_RUN)
+        {
+            if(idx[1] == 0
+            || f_field.f_size % idx[1] != 0)
+            {
+                return error<brs_invalid_hunk>(ERROR_INVALID_HUNK, "array run size is not a multiple of its number of items.");
+            }
+            f_field.f_count = idx[1];
+        }
+        header_size += sizeof(extension) + size;
+
+        return true;
+    }
+
+
+    bool read_compressed(std::size_t & header_size)
+    {
+        std::uint32_t uncompressed_size(0);
+        std::size_t const size(sizeof(extension_t) + sizeof(f_hunk_codec) + sizeof(uncompressed_size));
+        if(!add_total_bytes(size))
+        {
+            return false;
+        }
+        f_input->read(reinterpret_cast<typename S::char_type *>(&f_hunk_codec), sizeof(f_hunk_codec));
+        f_input->read(reinterpret_cast<typename S::char_type *>(&uncompressed_size), sizeof(uncompressed_size));
+        if(!*f_input || f_input->gcount() != sizeof(uncompressed_size))
+        {
+            return false;
+        }
+        if(uncompressed_size > MAX_UNCOMPRESSED_SIZE)
+        {
+            return error<brs_invalid_hunk>(ERROR_INVALID_HUNK, "the uncompressed size of a compressed hunk is too large.");
+        }
+        if(uncompressed_size > f_limits.f_max_field_size)
+        {
+            if(!f_exceptions)
+            {
+                return fail(ERROR_LIMIT_EXCEEDED);
+            }
+            throw brs_limit_exceeded(
+                      "uncompressed hunk size is "
+                    + std::to_string(uncompressed_size)
+                    + ", which is more than the limit of "
+                    + std::to_string(f_limits.f_max_field_size)
+                    + '.');
+        }
+        if(f_field.f_size == 0)
+        {
+            return error<brs_invalid_hunk>(ERROR_INVALID_HUNK, "a compressed hunk cannot be empty.");
+        }
+        f_field.f_compressed_size = f_field.f_size;
+        f_field.f_compressed = true;
+        f_field.f_size = uncompressed_size;
+        header_size += size;
+        return true;
+    }
+
+
+    template<typename T>
+    bool read_map_item(char const * & ptr, char const * end, T & value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value
+                    , "map keys and values must be std::string or trivially copyable.");
+
+        if(static_cast<std::size_t>(end - ptr) < sizeof(value))
+        {
+            return error<brs_logic_error>(ERROR_INVALID_DATA, "map data is truncated.");
+        }
+        memcpy(&value, ptr, sizeof(value));
+        ptr += sizeof(value);
+        return true;
+    }
+
+
+    bool read_map_item(char const * & ptr, char const * end, std::string & value)
+    {
+        std::uint32_t length(0);
+        if(!read_map_item(ptr, end, length))
+        {
+            return false;
+        }
+        if(static_cast<std::size_t>(end - ptr) < length)
+        {
+            return error<brs_logic_error>(ERROR_INVALID_DATA, "map data is truncated.");
+        }
+        value.assign(ptr, length);
+        ptr += length;
+        return true;
+    }
+
+
+    bool read_magic()
+    {
+        magic_t magic = {};
+        f_input->read(reinterpret_cast<typename S::char_type *>(&magic), sizeof(magic));
+        if(!*f_input || f_input->gcount() != sizeof(magic))
+        {
+            return error<brs_magic_missing>(ERROR_MAGIC_MISSING, "magic missing from the start of the buffer.");
+        }
+
+        // version 1 buffers have no TYPE_EXTENDED hunks and start
+        // sub-fields with a field without data, which only the callbacks
+        // can recognize (see get_version())
+        //
+        if(magic == BRS_MAGIC)
+        {
+            f_version = BRS_VERSION;
+        }
+        else if(magic == BRS_MAGIC_V1)
+        {
+            f_version = BRS_VERSION_1;
+        }
+        else
+        {
+            return error<brs_magic_unsupported>(ERROR_MAGIC_UNSUPPORTED, "magic unsupported.");
+        }
+
+        f_start = sizeof(magic);
+        return true;
+    }
+
+
+    template<typename R, typename M>
+    bool read_column(std::vector<R> & records, field_t const & field, column_t<R, M> const & c)
+    {
+        if(field.f_name != c.f_name)
+        {
+            return false;
+        }
+
+        std::vector<M> values;
+        if(!read_data(values))
+        {
+            // the error is in f_result, leave the records alone
+            //
+            return true;
+        }
+        if(records.empty())
+        {
+            records.resize(values.size());
+        }
+        else if(records.size() != values.size())
+        {
+            if(!f_exceptions)
+            {
+                fail(ERROR_INVALID_DATA);
+                return true;
+            }
+            throw brs_logic_error(
+                      "column \""
+                    + c.f_name
+                    + "\" has "
+                    + std::to_string(values.size())
+                    + " values, expected "
+                    + std::to_string(records.size())
+                    + '.');
+        }
+
+        for(std::size_t idx(0); idx < values.size(); ++idx)
+        {
+            records[idx].*(c.f_member) = values[idx];
+        }
+
+        return true;
+    }
+
+
+    /** \brief The buffers of the deserialize_batch() call at one depth.
+     *
+     * A batch callback can call deserialize_batch() again on a sub-field
+     * so each depth needs its own buffers; the pending records of the
+     * parent still point to its data.
+     */
+    struct batch_t
+    {
+        std::vector<field_record_t> f_records = std::vector<field_record_t>();
+        std::string                 f_data = std::string();
+    };
+
+
+    /** \brief Track the depth of one deserialize() call.
+     *
+     * The deserialize() function gets called recursively by your callbacks
+     * when a sub-field is found. This guard keeps track of the depth and,
+     * when instrumented, closes the current parse time segment on exit,
+     * whether the function returns or throws. The depth limit is verified
+     * by verify_depth() before the guard gets created.
+     */
+    class depth_guard
+    {
+    public:
+        depth_guard(deserializer<S> & d)
+            : f_deserializer(d)
+        {
+            f_deserializer.instrument_enter();
+            ++f_deserializer.f_depth;
+        }
+
+        ~depth_guard()
+        {
+            --f_deserializer.f_depth;
+            f_deserializer.instrument_leave();
+        }
+
+    private:
+        deserializer<S> &       f_deserializer;
+    };
+
+
+    /** \brief Turn exceptions off while a try_...() function runs.
+     *
+     * The previous state is restored on exit so a try_deserialize() called
+     * from a callback of another try_deserialize() does not turn the
+     * exceptions back on too early.
+     */
+    class exceptions_guard
+    {
+    public:
+        exceptions_guard(deserializer<S> & d)
+            : f_deserializer(d)
+            , f_exceptions(d.f_exceptions)
+        {
+            f_deserializer.f_exceptions = false;
+        }
+
+        ~exceptions_guard()
+        {
+            f_deserializer.f_exceptions = f_exceptions;
+        }
+
+    private:
+        deserializer<S> &       f_deserializer;
+        bool                    f_exceptions = true;
+    };
+
+
+    bool verify_depth()
+    {
+        if(f_depth <= f_limits.f_max_depth)
+        {
+            return true;
+        }
+        if(f_exceptions)
+        {
+            throw brs_limit_exceeded(
+                      "sub-field depth is limited to "
+                    + std::to_string(f_limits.f_max_depth)
+                    + '.');
+        }
+        return fail(ERROR_LIMIT_EXCEEDED);
+    }
+
+
+    bool verify_limits(hunk_sizes_t const & hunk_sizes)
+    {
+        if(f_hunks >= f_limits.f_max_hunks)
+        {
+            if(f_exceptions)
+            {
+                throw brs_limit_exceeded(
+                          "number of hunks is limited to "
+                        + std::to_string(f_limits.f_max_hunks)
+                        + '.');
+            }
+            return fail(ERROR_LIMIT_EXCEEDED);
+        }
+        ++f_hunks;
+
+        if(hunk_sizes.f_hunk > f_limits.f_max_field_size)
+        {
+            if(!f_exceptions)
+            {
+                return fail(ERROR_LIMIT_EXCEEDED);
+            }
+            throw brs_limit_exceeded(
+                      "hunk size is "
+                    + std::to_string(hunk_sizes.f_hunk)
+                    + ", which is more than the limit of "
+                    + std::to_string(f_limits.f_max_field_size)
+                    + '.');
+        }
+
+        std::size_t size(sizeof(hunk_sizes) + hunk_sizes.f_name + hunk_sizes.f_hunk);
+        switch(hunk_sizes.f_type)
+        {
+        case TYPE_ARRAY:
+            size += sizeof(std::uint16_t);
+            break;
+
+        case TYPE_MAP:
+            size += sizeof(std::uint8_t);   // the sub-name gets added once read
+            break;
+
+        default:
+            // fields and extended hunks have no extra header data
+            break;
+
+        }
+        return add_total_bytes(size);
+    }
+
+
+    bool add_total_bytes(std::size_t size)
+    {
+        if(size > f_limits.f_max_total_bytes
+        || f_total_bytes > f_limits.f_max_total_bytes - size)
+        {
+            if(!f_exceptions)
+            {
+                return fail(ERROR_LIMIT_EXCEEDED);
+            }
+            throw brs_limit_exceeded(
+                      "total size of the hunks is limited to "
+                    + std::to_string(f_limits.f_max_total_bytes)
+                    + " bytes.");
+        }
+        f_total_bytes += size;
+        return true;
+    }
+
+
+#ifdef BRS_INSTRUMENTATION
+    typedef std::chrono::steady_clock       clock_t;
+
+    void instrument_enter()
+    {
+        if(f_depth > 0)
+        {
+            ++f_stats.f_depth;
+            f_stats.f_max_depth = std::max(f_stats.f_max_depth, f_stats.f_depth);
+            if(f_hooks != nullptr)
+            {
+                f_hooks->on_start_subfield(f_field.f_name, f_stats.f_depth);
+            }
+        }
+        f_segment_start = clock_t::now();
+    }
+
+
+    void instrument_leave()
+    {
+        f_stats.f_parse_time += clock_t::now() - f_segment_start;
+        if(f_depth > 0)
+        {
+            if(f_hooks != nullptr)
+            {
+                f_hooks->on_end_subfield(f_stats.f_depth);
+            }
+            --f_stats.f_depth;
+        }
+    }
+#else
+    void instrument_enter()
+    {
+    }
+
+
+    void instrument_leave()
+    {
+    }
+#endif
+
+
+    void instrument_hunk(
+          type_t type
+        , std::string_view name
+        , std::size_t header_size
+        , std::size_t data_size)
+    {
+#ifdef BRS_INSTRUMENTATION
+        name_t const n(name);
+        f_stats.add_hunk(type, n, header_size, data_size);
+        if(f_hooks != nullptr)
+        {
+            f_hooks->on_hunk(type, n, header_size, data_size);
+        }
+#else
+        snapdev::NOT_USED(type, name, header_size, data_size);
+#endif
+    }
+
+
+    bool call(process_hunk_t & callback)
+    {
+#ifdef BRS_INSTRUMENTATION
+        // the callback may call deserialize() recursively, the time spent
+        // in there gets removed from the callback time
+        //
+        clock_t::time_point const start(clock_t::now());
+        f_stats.f_parse_time += start - f_segment_start;
+        std::chrono::nanoseconds const before(f_stats.f_parse_time + f_stats.f_callback_time);
+        field_t field;
+        if(f_hooks != nullptr)
+        {
+            field = f_field;
+        }
+
+        bool const result(callback(*this, f_field));
+
+        clock_t::time_point const end(clock_t::now());
+        std::chrono::nanoseconds const nested(f_stats.f_parse_time + f_stats.f_callback_time - before);
+        std::chrono::nanoseconds const duration(end - start - nested);
+        f_stats.f_callback_time += duration;
+        f_segment_start = end;
+        if(f_hooks != nullptr)
+        {
+            f_hooks->on_callback(field, duration);
+        }
+        return result;
+#else
+        return callback(*this, f_field);
+#endif
+    }
+
+
+    /** \brief Call the callback and check its result.
+     *
+     * When exceptions are turned off, a callback returning false stops
+     * the deserialization. If the deserializer did not record an error
+     * already, ERROR_CALLBACK gets recorded.
+     *
+     * An error recorded while the callback ran (i.e. the data of the hunk
+     * is truncated) always stops the deserialization, even when the
+     * callback ignores the value returned by read_data().
+     */
+    bool deliver(process_hunk_t & callback)
+    {
+        bool const result(call(callback));
+        if(!f_result)
+        {
+            return false;
+        }
+        if(result
+        || f_exceptions)
+        {
+            return true;
+        }
+        return fail(ERROR_CALLBACK);
+    }
+
+
+    /** \brief Add the current hunk to a batch.
+     *
+     * The names and the data of the hunk are appended to \p data. That
+     * buffer never grows while it holds records: the pending batch gets
+     * delivered first when the hunk does not fit, so the pointers saved
+     * in the records remain valid.
+     */
+    bool add_record(
+          process_batch_t & callback
+        , std::vector<field_record_t> & records
+        , std::string & data)
+    {
+        if(!verify_codec())
+        {
+            return false;
+        }
+        std::size_t const size(f_field.f_name.length() + f_field.f_sub_name.length() + f_field.f_size);
+        if(data.length() + size > data.capacity())
+        {
+            if(!deliver_batch(callback, records, data))
+            {
+                return false;
+            }
+            data.reserve(size);
+        }
+
+        char * ptr(data.data() + data.length());
+        data.resize(data.length() + size);
+
+        field_record_t record;
+        memcpy(ptr, f_field.f_name.data(), f_field.f_name.length());
+        record.f_name = std::string_view(ptr, f_field.f_name.length());
+        ptr += f_field.f_name.length();
+        memcpy(ptr, f_field.f_sub_name.data(), f_field.f_sub_name.length());
+        record.f_sub_name = std::string_view(ptr, f_field.f_sub_name.length());
+        ptr += f_field.f_sub_name.length();
+        record.f_index = f_field.f_index;
+        record.f_count = f_field.f_count;
+        record.f_data = ptr;
+        record.f_size = f_field.f_size;
+        record.f_subfield = f_field.f_subfield;
+        if(!f_field.f_subfield
+        && !read_payload(ptr, f_field.f_size))
+        {
+            return false;
+        }
+        records.push_back(record);
+
+        return true;
+    }
+
+
+    /** \brief Call the batch callback with the pending records.
+     *
+     * The records and their data are cleared, whether the callback
+     * succeeds or not. Nothing happens if no records are pending.
+     */
+    bool deliver_batch(
+          process_batch_t & callback
+        , std::vector<field_record_t> & records
+        , std::string & data)
+    {
+        if(records.empty())
+        {
+            return true;
+        }
+
+#ifdef BRS_INSTRUMENTATION
+        clock_t::time_point const start(clock_t::now());
+        f_stats.f_parse_time += start - f_segment_start;
+        std::chrono::nanoseconds const before(f_stats.f_parse_time + f_stats.f_callback_time);
+
+        bool const result(callback(*this, records.data(), records.size()));
+
+        clock_t::time_point const end(clock_t::now());
+        std::chrono::nanoseconds const nested(f_stats.f_parse_time + f_stats.f_callback_time - before);
+        std::chrono::nanoseconds const duration(end - start - nested);
+        f_stats.f_callback_time += duration;
+        f_segment_start = end;
+#else
+        bool const result(callback(*this, records.data(), records.size()));
+#endif
+
+        records.clear();
+        data.clear();
+
+        if(!f_result)
+        {
+            return false;
+        }
+        if(result
+        || f_exceptions)
+        {
+            return true;
+        }
+        return fail(ERROR_CALLBACK);
+    }
+
+
+    bool verify_size(std::size_t expected_size)
+    {
+        if(*f_input
+        && static_cast<std::size_t>(f_input->gcount()) == expected_size)
+        {
+            return true;
+        }
+        return fail(ERROR_TRUNCATED);
+    }
+
+
+    bool fail(error_code_t code)
+    {
+        if(f_result)
+        {
+            f_result.f_error = code;
+            f_result.f_offset = f_hunk_offset;
+        }
+        return false;
+    }
+
+
+    template<typename E>
+    bool error(error_code_t code, char const * message)
+    {
+        if(f_exceptions)
+        {
+            throw E(message);
+        }
+        return fail(code);
+    }
+
+    S *         f_input = nullptr;
+    field_t     f_field = field_t();
+    limits_t    f_limits = limits_t();
+    std::size_t f_depth = 0;
+    std::size_t f_hunks = 0;
+    std::size_t f_total_bytes = 0;
+    std::size_t f_matched_path = 0;
+    std::size_t f_start = 0;
+    std::size_t f_hunk_offset = 0;
+    std::size_t f_data_read = 0;
+    version_t   f_version = BRS_VERSION;
+    payload_codec * f_codec = nullptr;
+    codec_t     f_hunk_codec = 0;
+    bool        f_payload_loaded = false;
+    std::size_t f_payload_offset = 0;
+    std::string f_payload = std::string();
+    std::string f_compressed = std::string();
+    bool        f_exceptions = true;
+    result_t    f_result = result_t();
+    std::deque<batch_t> f_batches = std::deque<batch_t>();
+#ifdef BRS_INSTRUMENTATION
+    stats_t                     f_stats = stats_t();
+    instrumentation_hooks *     f_hooks = nullptr;
+    clock_t::time_point         f_segment_start = clock_t::time_point();
+#endif
 };
 
 
@@ -0,0 +1,437 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the dictionary compression.
+ *
+ * The zstd library does all the work. The dictionary object prepares
+ * the zstd compression and decompression dictionaries once so each
+ * message only pays for the compression itself. The compressor and
+ * decompressor each keep one zstd context which gets reused for all
+ * the messages; use one of each per thread.
+ */
+
+// self
+//
+#include    "brs/compress.h"
+
+
+// C++
+//
+#include    <cstring>
+
+
+// zstd
+//
+#include    <zdict.h>
+#include    <zstd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace brs
+{
+
+
+
+/** \brief Load a trained dictionary.
+ *
+ * The \p data is a dictionary as returned by train(). The dictionary
+ * identifier saved in the compressed buffers is the one zstd saved in
+ * the dictionary when it was trained.
+ *
+ * \exception brs_compression_error
+ * The data is not a trained dictionary or zstd could not load it.
+ *
+ * \param[in] data  The trained dictionary.
+ * \param[in] level  The compression level used by the compressors.
+ */
+dictionary::dictionary(std::string const & data, int level)
+    : f_data(data)
+    , f_id(ZDICT_getDictID(data.data(), data.length()))
+{
+    if(f_id == 0)
+    {
+        throw brs_compression_error("the dictionary data is not a trained dictionary.");
+    }
+
+    f_cdict = ZSTD_createCDict(f_data.data(), f_data.length(), level);
+    f_ddict = ZSTD_createDDict(f_data.data(), f_data.length());
+    if(f_cdict == nullptr
+    || f_ddict == nullptr)
+    {
+        ZSTD_freeCDict(f_cdict);
+        ZSTD_freeDDict(f_ddict);
+        throw brs_compression_error("the dictionary could not be loaded.");
+    }
+}
+
+
+dictionary::~dictionary()
+{
+    ZSTD_freeCDict(f_cdict);
+    ZSTD_freeDDict(f_ddict);
+}
+
+
+/** \brief Train a dictionary from sample messages.
+ *
+ * The \p samples should be a few hundred or thousand messages
+ * representative of the messages to be compressed. The resulting
+ * dictionary is at most \p max_size bytes. Save it along your
+ * application; the same dictionary is required to decompress the
+ * messages.
+ *
+ * \exception brs_compression_error
+ * The training failed, usually because there are not enough samples.
+ *
+ * \param[in] samples  The sample messages.
+ * \param[in] max_size  The maximum size of the dictionary.
+ *
+ * \return The trained dictionary.
+ */
+std::string dictionary::train(
+      std::vector<std::string> const & samples
+    , std::size_t max_size)
+{
+    std::string buffer;
+    std::vector<std::size_t> sizes;
+    sizes.reserve(samples.size());
+    for(auto const & s : samples)
+    {
+        buffer += s;
+        sizes.push_back(s.length());
+    }
+
+    std::string result(max_size, '\0');
+    std::size_t const size(ZDICT_trainFromBuffer(
+              result.data()
+            , result.length()
+            , buffer.data()
+            , sizes.data()
+            , static_cast<unsigned>(sizes.size())));
+    if(ZDICT_isError(size))
+    {
+        throw brs_compression_error(
+                  std::string("dictionary training failed: ")
+                + ZDICT_getErrorName(size)
+                + '.');
+    }
+    result.resize(size);
+
+    return result;
+}
+
+
+dictionary_id_t dictionary::id() const
+{
+    return f_id;
+}
+
+
+std::string const & dictionary::data() const
+{
+    return f_data;
+}
+
+
+
+compressor::compressor(dictionary::pointer_t dict)
+    : f_dictionary(dict)
+    , f_context(ZSTD_createCCtx())
+{
+    if(f_dictionary == nullptr)
+    {
+        throw brs_logic_error("a compressor requires a dictionary.");
+    }
+    if(f_context == nullptr)
+    {
+        throw brs_compression_error("could not allocate a compression context.");
+    }
+}
+
+
+compressor::~compressor()
+{
+    ZSTD_freeCCtx(f_context);
+}
+
+
+/** \brief Compress one buffer.
+ *
+ * The result includes the compressed header (see brs/compress.h)
+ * followed by the zstd frame.
+ *
+ * \exception brs_out_of_range
+ * The buffer is 4Gb or more.
+ *
+ * \param[in] buffer  The buffer to compress, usually a whole serialized
+ * message including its magic code.
+ * \param[in] size  The size of \p buffer.
+ *
+ * \return The compressed buffer.
+ */
+std::string compressor::compress(char const * buffer, std::size_t size)
+{
+    std::uint32_t const original_size(static_cast<std::uint32_t>(size));
+    if(original_size != size)
+    {
+        throw brs_out_of_range("a compressed buffer is limited to 4Gb.");
+    }
+
+    std::string result(COMPRESSED_HEADER_SIZE + ZSTD_compressBound(size), '\0');
+    char * ptr(result.data());
+    magic_t const magic(BRS_COMPRESSED_MAGIC);
+    dictionary_id_t const id(f_dictionary->id());
+    memcpy(ptr, &magic, sizeof(magic));
+    ptr += sizeof(magic);
+    memcpy(ptr, &id, sizeof(id));
+    ptr += sizeof(id);
+    memcpy(ptr, &original_size, sizeof(original_size));
+
+    std::size_t const compressed_size(ZSTD_compress_usingCDict(
+              f_context
+            , result.data() + COMPRESSED_HEADER_SIZE
+            , result.length() - COMPRESSED_HEADER_SIZE
+            , buffer
+            , size
+            , f_dictionary->f_cdict));
+    if(ZSTD_isError(compressed_size))
+    {
+        throw brs_compression_error(
+                  std::string("compression failed: ")
+                + ZSTD_getErrorName(compressed_size)
+                + '.');
+    }
+    result.resize(COMPRESSED_HEADER_SIZE + compressed_size);
+
+    return result;
+}
+
+
+std::string compressor::compress(std::string const & buffer)
+{
+    return compress(buffer.data(), buffer.length());
+}
+
+
+
+/** \brief Initialize a decompressor.
+ *
+ * The \p max_size parameter limits the size of the decompressed
+ * buffers. The size found in the header gets allocated before the data
+ * is decompressed, so a small crafted buffer could otherwise make you
+ * allocate a huge amount of memory.
+ *
+ * \param[in] max_size  The maximum size of a decompressed buffer.
+ */
+decompressor::decompressor(std::size_t max_size)
+    : f_max_size(max_size)
+    , f_context(ZSTD_createDCtx())
+{
+    if(f_context == nullptr)
+    {
+        throw brs_compression_error("could not allocate a decompression context.");
+    }
+}
+
+
+decompressor::~decompressor()
+{
+    ZSTD_freeDCtx(f_context);
+}
+
+
+/** \brief Add a dictionary to the decompressor.
+ *
+ * Add all the dictionaries that may have been used to compress the
+ * buffers you want to decompress. The identifier found in each buffer
+ * selects the dictionary.
+ *
+ * \param[in] dict  The dictionary to add.
+ */
+void decompressor::add_dictionary(dictionary::pointer_t dict)
+{
+    if(dict == nullptr)
+    {
+        throw brs_logic_error("cannot add a null dictionary.");
+    }
+    f_dictionaries[dict->id()] = dict;
+}
+
+
+/** \brief Decompress one buffer.
+ *
+ * \exception brs_magic_missing
+ * The buffer is too small to include the compressed header.
+ *
+ * \exception brs_magic_unsupported
+ * The buffer does not start with BRS_COMPRESSED_MAGIC.
+ *
+ * \exception brs_compression_error
+ * The dictionary is unknown, the size is over the limit, or the data
+ * is invalid.
+ *
+ * \param[in] buffer  The compressed buffer.
+ * \param[in] size  The size of \p buffer.
+ *
+ * \return The decompressed buffer.
+ */
+std::string decompressor::decompress(char const * buffer, std::size_t size)
+{
+    if(size < COMPRESSED_HEADER_SIZE)
+    {
+        throw brs_magic_missing("compressed header missing from the start of the buffer.");
+    }
+
+    magic_t magic(0);
+    dictionary_id_t id(0);
+    std::uint32_t original_size(0);
+    memcpy(&magic, buffer, sizeof(magic));
+    memcpy(&id, buffer + sizeof(magic), sizeof(id));
+    memcpy(&original_size, buffer + sizeof(magic) + sizeof(id), sizeof(original_size));
+    if(magic != BRS_COMPRESSED_MAGIC)
+    {
+        throw brs_magic_unsupported("compressed magic unsupported.");
+    }
+
+    auto const it(f_dictionaries.find(id));
+    if(it == f_dictionaries.end())
+    {
+        throw brs_compression_error(
+                  "unknown dictionary "
+                + std::to_string(id)
+                + '.');
+    }
+
+    if(original_size > f_max_size)
+    {
+        throw brs_compression_error(
+                  "decompressed size is "
+                + std::to_string(original_size)
+                + ", which is more than the limit of "
+                + std::to_string(f_max_size)
+                + '.');
+    }
+
+    std::string result(original_size, '\0');
+    std::size_t const decompressed_size(ZSTD_decompress_usingDDict(
+              f_context
+            , result.data()
+            , result.length()
+            , buffer + COMPRESSED_HEADER_SIZE
+            , size - COMPRESSED_HEADER_SIZE
+            , it->second->f_ddict));
+    if(ZSTD_isError(decompressed_size))
+    {
+        throw brs_compression_error(
+                  std::string("decompression failed: ")
+                + ZSTD_getErrorName(decompressed_size)
+                + '.');
+    }
+    if(decompressed_size != original_size)
+    {
+        throw brs_compression_error("decompressed size does not match the size in the header.");
+    }
+
+    return result;
+}
+
+
+std::string decompressor::decompress(std::string const & buffer)
+{
+    return decompress(buffer.data(), buffer.length());
+}
+
+
+
+/** \brief Initialize a zstd codec.
+ *
+ * The codec compresses the data of large hunks on its own (see
+ * serializer::set_compression()). The zstd contexts are allocated once
+ * and reused for all the hunks, so use one codec per thread.
+ *
+ * \param[in] level  The zstd compression level.
+ */
+zstd_codec::zstd_codec(int level)
+    : f_level(level)
+    , f_compress_context(ZSTD_createCCtx())
+    , f_decompress_context(ZSTD_createDCtx())
+{
+    if(f_compress_context == nullptr
+    || f_decompress_context == nullptr)
+    {
+        ZSTD_freeCCtx(f_compress_context);
+        ZSTD_freeDCtx(f_decompress_context);
+        throw brs_compression_error("could not allocate the zstd contexts.");
+    }
+}
+
+
+zstd_codec::~zstd_codec()
+{
+    ZSTD_freeCCtx(f_compress_context);
+    ZSTD_freeDCtx(f_decompress_context);
+}
+
+
+codec_t zstd_codec::id() const
+{
+    return CODEC_ZSTD;
+}
+
+
+bool zstd_codec::compress(void const * data, std::size_t size, std::string & compressed)
+{
+    compressed.resize(ZSTD_compressBound(size));
+    std::size_t const compressed_size(ZSTD_compressCCtx(
+              f_compress_context
+            , compressed.data()
+            , compressed.length()
+            , data
+            , size
+            , f_level));
+    if(ZSTD_isError(compressed_size))
+    {
+        return false;
+    }
+    compressed.resize(compressed_size);
+    return true;
+}
+
+
+bool zstd_codec::decompress(void const * compressed, std::size_t compressed_size, void * data, std::size_t size)
+{
+    std::size_t const decompressed_size(ZSTD_decompressDCtx(
+              f_decompress_context
+            , data
+            , size
+            , compressed
+            , compressed_size));
+    return !ZSTD_isError(decompressed_size)
+        && decompressed_size == size;
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,182 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Compress small BRS buffers with a trained dictionary.
+ *
+ * Small messages (a few hundred bytes) do not compress well on their
+ * own because the compressor has no history to work with. However,
+ * messages of the same kind repeat the same field names and many of the
+ * same values. A zstd dictionary trained from a sample of such messages
+ * gives the compressor that history.
+ *
+ * Train a dictionary once with dictionary::train(), save it, and load it
+ * in a dictionary object in the writers and the readers. Loading a
+ * dictionary is costly so the dictionary object keeps the prepared zstd
+ * dictionaries and gets shared by all the compressors and decompressors.
+ *
+ * A compressed buffer starts with its own header:
+ *
+ * \code
+ *     magic       (BRS_COMPRESSED_MAGIC)
+ *     dictionary  (32 bits, identifier of the dictionary)
+ *     size        (32 bits, size of the uncompressed buffer)
+ *     data        (a zstd frame)
+ * \endcode
+ *
+ * The decompressor uses the identifier to find the dictionary among the
+ * ones it knows about, so dictionaries can be replaced over time while
+ * older messages can still be read.
+ *
+ * For large fields, the zstd_codec compresses the data of each hunk on
+ * its own instead (see serializer::set_compression()).
+ */
+
+// self
+//
+#include    <brs/brs.h>
+
+
+// C++
+//
+#include    <map>
+
+
+
+// zstd
+//
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+
+
+namespace brs
+{
+
+
+
+DECLARE_EXCEPTION(brs_error, brs_compression_error);
+
+
+constexpr magic_t const         BRS_COMPRESSED_MAGIC_BIG_ENDIAN    = build_magic('B', 'Z');
+constexpr magic_t const         BRS_COMPRESSED_MAGIC_LITTLE_ENDIAN = build_magic('L', 'Z');
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr magic_t const         BRS_COMPRESSED_MAGIC = BRS_COMPRESSED_MAGIC_BIG_ENDIAN;
+#else
+constexpr magic_t const         BRS_COMPRESSED_MAGIC = BRS_COMPRESSED_MAGIC_LITTLE_ENDIAN;
+#endif
+
+typedef std::uint32_t           dictionary_id_t;
+
+constexpr std::size_t const     COMPRESSED_HEADER_SIZE = sizeof(magic_t) + sizeof(dictionary_id_t) + sizeof(std::uint32_t);
+constexpr int const             DEFAULT_COMPRESSION_LEVEL = 3;
+
+
+class dictionary
+{
+public:
+    typedef std::shared_ptr<dictionary>     pointer_t;
+
+                        dictionary(std::string const & data, int level = DEFAULT_COMPRESSION_LEVEL);
+                        dictionary(dictionary const &) = delete;
+                        ~dictionary();
+    dictionary &        operator = (dictionary const &) = delete;
+
+    static std::string  train(
+                              std::vector<std::string> const & samples
+                            , std::size_t max_size = 16 * 1024);
+
+    dictionary_id_t     id() const;
+    std::string const & data() const;
+
+private:
+    friend class compressor;
+    friend class decompressor;
+
+    std::string         f_data = std::string();
+    dictionary_id_t     f_id = 0;
+    ZSTD_CDict_s *      f_cdict = nullptr;
+    ZSTD_DDict_s *      f_ddict = nullptr;
+};
+
+
+class compressor
+{
+public:
+                        compressor(dictionary::pointer_t dict);
+                        compressor(compressor const &) = delete;
+                        ~compressor();
+    compressor &        operator = (compressor const &) = delete;
+
+    std::string         compress(char const * buffer, std::size_t size);
+    std::string         compress(std::string const & buffer);
+
+private:
+    dictionary::pointer_t   f_dictionary = dictionary::pointer_t();
+    ZSTD_CCtx_s *           f_context = nullptr;
+};
+
+
+class decompressor
+{
+public:
+                        decompressor(std::size_t max_size = 64 * 1024 * 1024);
+                        decompressor(decompressor const &) = delete;
+                        ~decompressor();
+    decompressor &      operator = (decompressor const &) = delete;
+
+    void                add_dictionary(dictionary::pointer_t dict);
+    std::string         decompress(char const * buffer, std::size_t size);
+    std::string         decompress(std::string const & buffer);
+
+private:
+    typedef std::map<dictionary_id_t, dictionary::pointer_t>    dictionary_map_t;
+
+    dictionary_map_t        f_dictionaries = dictionary_map_t();
+    std::size_t             f_max_size = 0;
+    ZSTD_DCtx_s *           f_context = nullptr;
+};
+
+
+class zstd_codec
+    : public payload_codec
+{
+public:
+                        zstd_codec(int level = DEFAULT_COMPRESSION_LEVEL);
+                        zstd_codec(zstd_codec const &) = delete;
+    virtual             ~zstd_codec() override;
+    zstd_codec &        operator = (zstd_codec const &) = delete;
+
+    virtual codec_t     id() const override;
+    virtual bool        compress(void const * data, std::size_t size, std::string & compressed) override;
+    virtual bool        decompress(void const * compressed, std::size_t compressed_size, void * data, std::size_t size) override;
+
+private:
+    int                     f_level = DEFAULT_COMPRESSION_LEVEL;
+    ZSTD_CCtx_s *           f_compress_context = nullptr;
+    ZSTD_DCtx_s *           f_decompress_context = nullptr;
+};
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,460 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the BRS deltas.
+ *
+ * The delta is computed on the hunks of the two buffers. Each hunk is
+ * identified by a key composed of its type, index or sub-name, and name.
+ * The algorithm walks the current buffer and tries to match each hunk
+ * with the next hunk of the base buffer. When the keys do not match, it
+ * searches for the key further in the base buffer and, if found, marks
+ * the base hunks in between as removed. Otherwise the current hunk gets
+ * inserted.
+ */
+
+// self
+//
+#include    "brs/delta.h"
+
+#include    "brs/hunk.h"
+
+
+// C++
+//
+#include    <string_view>
+#include    <unordered_map>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace brs
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief How far to look ahead in the current buffer.
+ *
+ * When a hunk of the current buffer matches a hunk further in the base
+ * buffer, we first check whether the base hunk we would skip appears
+ * within the next few hunks of the current buffer. If so, the current
+ * hunk is considered inserted instead of the base hunks being removed.
+ */
+constexpr std::size_t const     LOOKAHEAD = 16;
+
+
+typedef std::vector<hunk_t>     hunk_vector_t;
+
+
+struct key_t
+{
+    bool operator == (key_t const & rhs) const
+    {
+        return f_type == rhs.f_type
+            && f_index == rhs.f_index
+            && f_sub_name == rhs.f_sub_name
+            && f_name == rhs.f_name;
+    }
+
+    type_t              f_type = TYPE_FIELD;
+    int                 f_index = -1;
+    std::string_view    f_sub_name = std::string_view();
+    std::string_view    f_name = std::string_view();
+};
+
+
+struct key_hash_t
+{
+    std::size_t operator () (key_t const & key) const noexcept
+    {
+        std::hash<std::string_view> h;
+        return h(key.f_name)
+             ^ (h(key.f_sub_name) << 1)
+             ^ (static_cast<std::size_t>(key.f_index) << 8)
+             ^ key.f_type;
+    }
+};
+
+
+struct positions_t
+{
+    std::vector<std::size_t>    f_positions = std::vector<std::size_t>();
+    std::size_t                 f_next = 0;
+};
+
+
+key_t get_key(std::string const & buffer, hunk_t const & hunk)
+{
+    key_t key;
+    key.f_type = hunk.f_type;
+    key.f_index = hunk.f_index;
+    key.f_sub_name = std::string_view(buffer.data() + hunk.f_sub_name, hunk.f_sub_name_length);
+    key.f_name = std::string_view(buffer.data() + hunk.f_name, hunk.f_name_length);
+    return key;
+}
+
+
+std::uint64_t hash_buffer(std::string const & buffer)
+{
+    std::uint64_t hash(0xcbf29ce484222325ULL);
+    for(char const c : buffer)
+    {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+void verify_magic(std::string const & buffer, std::size_t offset, magic_t expected)
+{
+    magic_t magic(0);
+    if(buffer.length() < offset + sizeof(magic))
+    {
+        throw brs_magic_missing("magic missing from the start of the buffer.");
+    }
+    memcpy(&magic, buffer.data() + offset, sizeof(magic));
+    if(magic != expected)
+    {
+        throw brs_magic_unsupported("magic unsupported.");
+    }
+}
+
+
+hunk_vector_t scan_hunks(std::string const & buffer)
+{
+    hunk_vector_t result;
+    std::size_t offset(sizeof(magic_t));
+    while(offset < buffer.length())
+    {
+        hunk_t hunk;
+        if(!read_hunk(buffer.data(), buffer.length(), offset, hunk))
+        {
+            throw brs_out_of_range(
+                      "hunk at offset "
+                    + std::to_string(offset)
+                    + " goes beyond the end of the buffer.");
+        }
+        result.push_back(hunk);
+        offset = hunk.end();
+    }
+    return result;
+}
+
+
+/** \brief Write the operations of a delta.
+ *
+ * Consecutive operations of the same type get merged into one.
+ */
+class delta_writer
+{
+public:
+    delta_writer(std::string & delta)
+        : f_delta(delta)
+    {
+    }
+
+    void add(delta_op_t op, std::uint32_t count)
+    {
+        if(f_op == op)
+        {
+            std::uint32_t total(0);
+            memcpy(&total, f_delta.data() + f_count_offset, sizeof(total));
+            total += count;
+            memcpy(f_delta.data() + f_count_offset, &total, sizeof(total));
+        }
+        else
+        {
+            f_op = op;
+            f_delta.append(reinterpret_cast<char const *>(&op), sizeof(op));
+            f_count_offset = f_delta.length();
+            f_delta.append(reinterpret_cast<char const *>(&count), sizeof(count));
+        }
+    }
+
+    void insert(std::string const & buffer, hunk_t const & hunk)
+    {
+        add(DELTA_INSERT, 1);
+        f_delta.append(buffer, hunk.f_offset, hunk.end() - hunk.f_offset);
+    }
+
+private:
+    std::string &       f_delta;
+    int                 f_op = -1;
+    std::size_t         f_count_offset = 0;
+};
+
+
+bool same_hunk(
+      std::string const & lhs
+    , hunk_t const & lhs_hunk
+    , std::string const & rhs
+    , hunk_t const & rhs_hunk)
+{
+    std::size_t const size(lhs_hunk.end() - lhs_hunk.f_offset);
+    return size == rhs_hunk.end() - rhs_hunk.f_offset
+        && memcmp(lhs.data() + lhs_hunk.f_offset, rhs.data() + rhs_hunk.f_offset, size) == 0;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \brief Create a delta between \p base and \p current.
+ *
+ * This function compares the hunks of the \p current buffer against the
+ * hunks of the \p base buffer and generates a delta which apply_delta()
+ * can use to regenerate \p current from \p base.
+ *
+ * The size of the delta is proportional to the number of hunks that
+ * changed, not the size of the buffers.
+ *
+ * \exception brs_magic_missing
+ * One of the buffers is too small to include a magic code.
+ *
+ * \exception brs_magic_unsupported
+ * One of the buffers does not start with the BRS_MAGIC code.
+ *
+ * \exception brs_out_of_range
+ * One of the buffers is truncated.
+ *
+ * \param[in] base  The previous snapshot.
+ * \param[in] current  The new snapshot.
+ *
+ * \return The delta.
+ */
+std::string create_delta(std::string const & base, std::string const & current)
+{
+    verify_magic(base, 0, BRS_MAGIC);
+    verify_magic(current, 0, BRS_MAGIC);
+
+    hunk_vector_t const base_hunks(scan_hunks(base));
+    hunk_vector_t const current_hunks(scan_hunks(current));
+
+    std::unordered_map<key_t, positions_t, key_hash_t> positions;
+    for(std::size_t idx(0); idx < base_hunks.size(); ++idx)
+    {
+        positions[get_key(base, base_hunks[idx])].f_positions.push_back(idx);
+    }
+
+    std::string delta;
+    magic_t const magic(BRS_DELTA_MAGIC);
+    delta.append(reinterpret_cast<char const *>(&magic), sizeof(magic));
+    std::uint64_t const base_size(base.length());
+    delta.append(reinterpret_cast<char const *>(&base_size), sizeof(base_size));
+    std::uint64_t const base_hash(hash_buffer(base));
+    delta.append(reinterpret_cast<char const *>(&base_hash), sizeof(base_hash));
+
+    delta_writer writer(delta);
+    std::size_t b(0);
+    for(std::size_t c(0); c < current_hunks.size(); ++c)
+    {
+        hunk_t const & hunk(current_hunks[c]);
+        key_t const key(get_key(current, hunk));
+
+        if(b < base_hunks.size()
+        && !(get_key(base, base_hunks[b]) == key))
+        {
+            // search for this key further in the base buffer
+            //
+            std::size_t found(base_hunks.size());
+            auto it(positions.find(key));
+            if(it != positions.end())
+            {
+                positions_t & p(it->second);
+                while(p.f_next < p.f_positions.size()
+                   && p.f_positions[p.f_next] < b)
+                {
+                    ++p.f_next;
+                }
+                if(p.f_next < p.f_positions.size())
+                {
+                    found = p.f_positions[p.f_next];
+                }
+            }
+
+            bool removed(found < base_hunks.size());
+            if(removed)
+            {
+                // if the base hunk we would remove appears shortly in the
+                // current buffer, then we rather have an insertion
+                //
+                key_t const base_key(get_key(base, base_hunks[b]));
+                std::size_t const max(std::min(current_hunks.size(), c + 1 + LOOKAHEAD));
+                for(std::size_t l(c + 1); l < max; ++l)
+                {
+                    if(get_key(current, current_hunks[l]) == base_key)
+                    {
+                        removed = false;
+                        break;
+                    }
+                }
+            }
+
+            if(!removed)
+            {
+                writer.insert(current, hunk);
+                continue;
+            }
+
+            writer.add(DELTA_REMOVE, found - b);
+            b = found;
+        }
+
+        if(b >= base_hunks.size())
+        {
+            writer.insert(current, hunk);
+        }
+        else
+        {
+            if(same_hunk(base, base_hunks[b], current, hunk))
+            {
+                writer.add(DELTA_COPY, 1);
+            }
+            else
+            {
+                writer.add(DELTA_REMOVE, 1);
+                writer.insert(current, hunk);
+            }
+            ++b;
+        }
+    }
+
+    if(b < base_hunks.size())
+    {
+        writer.add(DELTA_REMOVE, base_hunks.size() - b);
+    }
+
+    return delta;
+}
+
+
+/** \brief Apply a delta to a base buffer.
+ *
+ * This function regenerates the buffer which was used to create the
+ * \p delta with create_delta() from the same \p base buffer.
+ *
+ * \exception brs_invalid_delta
+ * The delta was not created against this \p base buffer or it is
+ * invalid.
+ *
+ * \param[in] base  The base buffer.
+ * \param[in] delta  The delta to apply to \p base.
+ *
+ * \return The resulting BRS buffer.
+ */
+std::string apply_delta(std::string const & base, std::string const & delta)
+{
+    verify_magic(base, 0, BRS_MAGIC);
+    verify_magic(delta, 0, BRS_DELTA_MAGIC);
+
+    std::size_t pos(sizeof(magic_t));
+    std::uint64_t base_size(0);
+    std::uint64_t base_hash(0);
+    if(delta.length() < pos + sizeof(base_size) + sizeof(base_hash))
+    {
+        throw brs_invalid_delta("delta header is truncated.");
+    }
+    memcpy(&base_size, delta.data() + pos, sizeof(base_size));
+    pos += sizeof(base_size);
+    memcpy(&base_hash, delta.data() + pos, sizeof(base_hash));
+    pos += sizeof(base_hash);
+    if(base_size != base.length()
+    || base_hash != hash_buffer(base))
+    {
+        throw brs_invalid_delta("this delta was not created from this base buffer.");
+    }
+
+    hunk_vector_t const base_hunks(scan_hunks(base));
+
+    std::string result(base, 0, sizeof(magic_t));
+    result.reserve(base.length());
+
+    std::size_t b(0);
+    while(pos < delta.length())
+    {
+        delta_op_t op(0);
+        std::uint32_t count(0);
+        if(delta.length() < pos + sizeof(op) + sizeof(count))
+        {
+            throw brs_invalid_delta("delta operation is truncated.");
+        }
+        memcpy(&op, delta.data() + pos, sizeof(op));
+        pos += sizeof(op);
+        memcpy(&count, delta.data() + pos, sizeof(count));
+        pos += sizeof(count);
+
+        switch(op)
+        {
+        case DELTA_COPY:
+        case DELTA_REMOVE:
+            if(count == 0
+            || b + count > base_hunks.size())
+            {
+                throw brs_invalid_delta("delta references hunks beyond the end of the base buffer.");
+            }
+            if(op == DELTA_COPY)
+            {
+                std::size_t const start(base_hunks[b].f_offset);
+                result.append(base, start, base_hunks[b + count - 1].end() - start);
+            }
+            b += count;
+            break;
+
+        case DELTA_INSERT:
+            for(std::uint32_t idx(0); idx < count; ++idx)
+            {
+                hunk_t hunk;
+                if(!read_hunk(delta.data(), delta.length(), pos, hunk))
+                {
+                    throw brs_invalid_delta("inserted hunk is truncated.");
+                }
+                result.append(delta, pos, hunk.end() - pos);
+                pos = hunk.end();
+            }
+            break;
+
+        default:
+            throw brs_invalid_delta("unknown delta operation " + std::to_string(static_cast<int>(op)) + '.');
+
+        }
+    }
+
+    if(b != base_hunks.size())
+    {
+        throw brs_invalid_delta("delta does not cover all the hunks of the base buffer.");
+    }
+
+    return result;
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
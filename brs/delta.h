@@ -0,0 +1,81 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Compute and apply deltas between two BRS buffers.
+ *
+ * When the same object gets serialized over and over again, most of its
+ * hunks do not change between two snapshots. A delta only includes the
+ * hunks that changed along with instructions telling which hunks of the
+ * base buffer to keep and which ones were removed.
+ *
+ * A delta starts with its own magic code (see BRS_DELTA_MAGIC) followed
+ * by the size and a 64 bit FNV-1a hash of the base buffer, so a delta
+ * cannot be applied to the wrong base. Then it includes a list of
+ * operations. Each operation is one byte (DELTA_...) followed by a
+ * 32 bit count:
+ *
+ * \li DELTA_COPY -- copy the next \em count hunks of the base buffer;
+ * \li DELTA_REMOVE -- skip the next \em count hunks of the base buffer
+ * (these are the tombstones of removed or replaced hunks);
+ * \li DELTA_INSERT -- the next \em count hunks are found in the delta
+ * itself and get copied as is.
+ *
+ * Like the regular BRS format, the numbers are saved in the endianness
+ * of the computer that created the delta.
+ */
+
+// self
+//
+#include    <brs/brs.h>
+
+
+
+namespace brs
+{
+
+
+
+DECLARE_EXCEPTION(brs_error, brs_invalid_delta);
+
+
+constexpr magic_t const         BRS_DELTA_MAGIC_BIG_ENDIAN    = build_magic('B', 'D');
+constexpr magic_t const         BRS_DELTA_MAGIC_LITTLE_ENDIAN = build_magic('L', 'D');
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr magic_t const         BRS_DELTA_MAGIC = BRS_DELTA_MAGIC_BIG_ENDIAN;
+#else
+constexpr magic_t const         BRS_DELTA_MAGIC = BRS_DELTA_MAGIC_LITTLE_ENDIAN;
+#endif
+
+
+typedef std::uint8_t            delta_op_t;
+
+constexpr delta_op_t const      DELTA_COPY = 0;     // keep base hunks
+constexpr delta_op_t const      DELTA_REMOVE = 1;   // drop base hunks (tombstones)
+constexpr delta_op_t const      DELTA_INSERT = 2;   // hunks included in the delta
+
+
+std::string         create_delta(std::string const & base, std::string const & current);
+std::string         apply_delta(std::string const & base, std::string const & delta);
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,535 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the BRS document.
+ *
+ * The nodes are saved in one vector. The root node is always the first
+ * entry. When the children of a node are accessed for the first time,
+ * the hunks of that sub-field are scanned and one entry per child is
+ * appended to the vector, so the children of a node are always
+ * consecutive.
+ */
+
+// self
+//
+#include    "brs/document.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace brs
+{
+
+
+
+node::node(document const * doc, std::uint32_t id)
+    : f_document(doc)
+    , f_id(id)
+{
+}
+
+
+/** \brief Check whether this node is valid.
+ *
+ * The find() and child() functions return an invalid node when the
+ * requested child does not exist.
+ *
+ * \return true if the node is attached to a document.
+ */
+node::operator bool () const
+{
+    return f_document != nullptr;
+}
+
+
+hunk_t node::hunk() const
+{
+    if(f_document == nullptr
+    || f_id == 0)
+    {
+        return hunk_t();
+    }
+    return f_document->get_hunk(f_document->f_nodes[f_id].f_offset);
+}
+
+
+/** \brief Get the name of this node.
+ *
+ * \return A view of the name in the buffer, empty for the root node.
+ */
+std::string_view node::name() const
+{
+    hunk_t const h(hunk());
+    if(h.f_name_length == 0)
+    {
+        return std::string_view();
+    }
+    return std::string_view(f_document->f_buffer + h.f_name, h.f_name_length);
+}
+
+
+/** \brief Get the sub-name of a map item.
+ *
+ * \return A view of the sub-name, empty if this node is not a map item.
+ */
+std::string_view node::sub_name() const
+{
+    hunk_t const h(hunk());
+    if(h.f_sub_name_length == 0)
+    {
+        return std::string_view();
+    }
+    return std::string_view(f_document->f_buffer + h.f_sub_name, h.f_sub_name_length);
+}
+
+
+/** \brief Get the index of an array item.
+ *
+ * For a run of array items, this is the index of the first item.
+ *
+ * \return The index or -1 if this node is not an array item.
+ */
+int node::index() const
+{
+    return hunk().f_index;
+}
+
+
+/** \brief Get the number of array items in this node.
+ *
+ * \return The number of items saved in this hunk, 1 unless it is a run.
+ */
+std::size_t node::count() const
+{
+    return hunk().f_count;
+}
+
+
+type_t node::type() const
+{
+    return hunk().f_type;
+}
+
+
+/** \brief Check whether this node is a sub-field.
+ *
+ * The root node is viewed as a sub-field.
+ *
+ * \return true if this node may have children.
+ */
+bool node::is_subfield() const
+{
+    return f_document != nullptr
+        && (f_id == 0 || hunk().f_subfield);
+}
+
+
+/** \brief Check whether the data of this node is compressed.
+ *
+ * Compressed data (see serializer::set_compression()) cannot be viewed
+ * in place. Use a deserializer with a codec to read it.
+ *
+ * \return true if the data of this node is compressed.
+ */
+bool node::is_compressed() const
+{
+    return hunk().f_compressed;
+}
+
+
+/** \brief Get the data of this node.
+ *
+ * \exception brs_logic_error
+ * The data is compressed.
+ *
+ * \return A view of the data in the buffer.
+ */
+std::string_view node::data() const
+{
+    hunk_t const h(hunk());
+    if(h.f_compressed)
+    {
+        throw brs_logic_error(
+                  "data of \""
+                + std::string(name())
+                + "\" is compressed.");
+    }
+    if(h.f_size == 0)
+    {
+        return std::string_view();
+    }
+    return std::string_view(f_document->f_buffer + h.f_data, h.f_size);
+}
+
+
+/** \brief Get the offset of the data of this node.
+ *
+ * \return The offset of the data from the start of the buffer.
+ */
+std::size_t node::data_offset() const
+{
+    return hunk().f_data;
+}
+
+
+/** \brief Get the number of children.
+ *
+ * The first time this function is called on a sub-field, its hunks
+ * get scanned.
+ *
+ * \return The number of children, 0 if this node is not a sub-field.
+ */
+std::size_t node::size() const
+{
+    if(!is_subfield())
+    {
+        return 0;
+    }
+    f_document->expand(f_id);
+    return f_document->f_nodes[f_id].f_child_count;
+}
+
+
+/** \brief Get a child by position.
+ *
+ * \param[in] idx  The position of the child, from 0 to size() - 1.
+ *
+ * \return The child or an invalid node if \p idx is out of range.
+ */
+node node::child(std::size_t idx) const
+{
+    if(idx >= size())
+    {
+        return node();
+    }
+    return node(f_document, f_document->f_nodes[f_id].f_first_child + idx);
+}
+
+
+/** \brief Find the first child with the specified name.
+ *
+ * \param[in] name  The name of the field.
+ *
+ * \return The child or an invalid node if not found.
+ */
+node node::find(std::string_view name) const
+{
+    std::size_t const max(size());
+    for(std::size_t idx(0); idx < max; ++idx)
+    {
+        node const c(child(idx));
+        if(c.name() == name)
+        {
+            return c;
+        }
+    }
+    return node();
+}
+
+
+/** \brief Find an array item.
+ *
+ * When the item was saved in a run (see serializer::add_array()), the
+ * node of the whole run is returned.
+ *
+ * \param[in] name  The name of the array.
+ * \param[in] index  The index of the item.
+ *
+ * \return The child or an invalid node if not found.
+ */
+node node::find(std::string_view name, int index) const
+{
+    std::size_t const max(size());
+    for(std::size_t idx(0); idx < max; ++idx)
+    {
+        node const c(child(idx));
+        hunk_t const h(c.hunk());
+        if(h.f_index >= 0
+        && index >= h.f_index
+        && static_cast<std::size_t>(index - h.f_index) < h.f_count
+        && c.name() == name)
+        {
+            return c;
+        }
+    }
+    return node();
+}
+
+
+/** \brief Find a map item.
+ *
+ * \param[in] name  The name of the map.
+ * \param[in] sub_name  The name of the item.
+ *
+ * \return The child or an invalid node if not found.
+ */
+node node::find(std::string_view name, std::string_view sub_name) const
+{
+    std::size_t const max(size());
+    for(std::size_t idx(0); idx < max; ++idx)
+    {
+        node const c(child(idx));
+        if(c.sub_name() == sub_name
+        && c.name() == name)
+        {
+            return c;
+        }
+    }
+    return node();
+}
+
+
+
+/** \brief Find a node using a path.
+ *
+ * The path is relative to this node. See brs/path.h for the syntax.
+ * A segment with a `*` matches the first array or map item with that
+ * name. A segment with an index matches the run (see
+ * serializer::add_array()) which includes that index.
+ *
+ * \exception brs_invalid_path
+ * The path is not valid.
+ *
+ * \param[in] path  The path to the node.
+ *
+ * \return The node or an invalid node if not found.
+ */
+node node::find_path(std::string_view path) const
+{
+    return find_path(parse_path(path));
+}
+
+
+node node::find_path(path_t const & path) const
+{
+    node result(*this);
+    for(auto const & segment : path)
+    {
+        if(segment.f_any
+        || segment.f_kind == SEGMENT_NAME)
+        {
+            std::size_t const max(result.size());
+            node found;
+            for(std::size_t idx(0); idx < max; ++idx)
+            {
+                node const c(result.child(idx));
+                if(c.name() == segment.f_name
+                && (segment.f_kind != SEGMENT_INDEX || c.index() >= 0)
+                && (segment.f_kind != SEGMENT_MAP || !c.sub_name().empty()))
+                {
+                    found = c;
+                    break;
+                }
+            }
+            result = found;
+        }
+        else if(segment.f_kind == SEGMENT_INDEX)
+        {
+            result = result.find(segment.f_name, segment.f_index);
+        }
+        else
+        {
+            result = result.find(segment.f_name, segment.f_sub_name);
+        }
+        if(!result)
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+
+
+/** \brief Create a document from a buffer.
+ *
+ * The buffer is not copied. It must remain valid as long as the
+ * document and its nodes are used.
+ *
+ * \exception brs_magic_missing
+ * The buffer is too small to include the magic code.
+ *
+ * \exception brs_magic_unsupported
+ * The buffer does not start with the BRS magic code or it is a version 1
+ * buffer. Version 1 buffers start sub-fields with a field without data
+ * so their structure cannot be found without a schema.
+ *
+ * \exception brs_out_of_range
+ * The buffer is 4Gb or more.
+ *
+ * \param[in] buffer  The BRS data.
+ * \param[in] size  The size of \p buffer in bytes.
+ * \param[in] include_magic  Whether \p buffer starts with the magic code.
+ */
+document::document(char const * buffer, std::size_t size, bool include_magic)
+    : f_buffer(buffer)
+    , f_size(size)
+{
+    if(size >= NOT_EXPANDED)
+    {
+        throw brs_out_of_range("a document is limited to 4Gb.");
+    }
+
+    if(include_magic)
+    {
+        magic_t magic = {};
+        if(size < sizeof(magic))
+        {
+            throw brs_magic_missing("magic missing from the start of the buffer.");
+        }
+        memcpy(&magic, buffer, sizeof(magic));
+        if(magic == BRS_MAGIC_V1)
+        {
+            throw brs_magic_unsupported("version 1 buffers cannot be browsed, use a deserializer instead.");
+        }
+        if(magic != BRS_MAGIC)
+        {
+            throw brs_magic_unsupported("magic unsupported.");
+        }
+        f_start = sizeof(magic);
+    }
+
+    f_nodes.emplace_back();
+}
+
+
+document::document(std::string const & buffer, bool include_magic)
+    : document(buffer.data(), buffer.length(), include_magic)
+{
+}
+
+
+node document::root() const
+{
+    return node(this, 0);
+}
+
+
+/** \brief Number of nodes created so far.
+ *
+ * This is mainly useful to verify that only the sub-fields you
+ * accessed were scanned.
+ *
+ * \return The number of entries in the node vector, including the root.
+ */
+std::size_t document::node_count() const
+{
+    return f_nodes.size();
+}
+
+
+hunk_t document::get_hunk(std::size_t offset) const
+{
+    hunk_t h;
+    if(!read_hunk(f_buffer, f_size, offset, h))
+    {
+        throw brs_invalid_hunk("hunk at offset " + std::to_string(offset) + " is truncated.");
+    }
+    return h;
+}
+
+
+void document::expand(std::uint32_t id) const
+{
+    if(f_nodes[id].f_child_count != NOT_EXPANDED)
+    {
+        return;
+    }
+
+    std::size_t offset(id == 0 ? f_start : get_hunk(f_nodes[id].f_offset).end());
+    std::uint32_t const first(static_cast<std::uint32_t>(f_nodes.size()));
+    for(;;)
+    {
+        if(offset >= f_size)
+        {
+            if(id != 0)
+            {
+                throw brs_invalid_hunk("sub-field is missing its end marker.");
+            }
+            break;
+        }
+
+        hunk_t const h(get_hunk(offset));
+        if(h.is_end())
+        {
+            // the deserializer also stops on an end marker at the top level
+            //
+            break;
+        }
+        if(h.f_padding)
+        {
+            offset = h.end();
+            continue;
+        }
+
+        node_t n;
+        n.f_offset = static_cast<std::uint32_t>(offset);
+        if(!h.f_subfield)
+        {
+            n.f_child_count = 0;
+        }
+        f_nodes.push_back(n);
+
+        offset = h.f_subfield ? skip_subfield(h.end()) : h.end();
+    }
+
+    // the vector may have been reallocated, do not keep a reference
+    //
+    f_nodes[id].f_first_child = first;
+    f_nodes[id].f_child_count = static_cast<std::uint32_t>(f_nodes.size()) - first;
+}
+
+
+/** \brief Skip the hunks of a sub-field.
+ *
+ * \param[in] offset  The offset of the first hunk of the sub-field.
+ *
+ * \return The offset right after the end marker of the sub-field.
+ */
+std::size_t document::skip_subfield(std::size_t offset) const
+{
+    std::size_t depth(1);
+    while(depth > 0)
+    {
+        if(offset >= f_size)
+        {
+            throw brs_invalid_hunk("sub-field is missing its end marker.");
+        }
+        hunk_t const h(get_hunk(offset));
+        if(h.is_end())
+        {
+            --depth;
+        }
+        else if(h.f_subfield)
+        {
+            ++depth;
+        }
+        offset = h.end();
+    }
+    return offset;
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,257 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Browse a BRS buffer without a schema.
+ *
+ * The deserializer requires callbacks which know the structure of the
+ * data. Tools such as routers and filters often only need to look at a
+ * few fields of a message. The brs::document class gives them access to
+ * the hunks of a buffer in memory as a tree of nodes.
+ *
+ * The document does not copy the buffer. The children of a node are
+ * found only when first accessed and each node only saves the offset of
+ * its hunk and the position of its children in one vector shared by
+ * the whole document. The names and data are returned as views in the
+ * buffer.
+ *
+ * Sub-fields are recognized by the hunk written by
+ * serializer::start_subfield(). Version 1 buffers, created before that
+ * hunk existed, used a field without data to start a sub-field. Their
+ * structure cannot be found without a schema, so the document refuses
+ * them (and so do locate() and patch()). A buffer without a magic code
+ * is expected to use the current version.
+ */
+
+// self
+//
+#include    <brs/hunk.h>
+#include    <brs/path.h>
+
+
+// C++
+//
+#include    <string_view>
+
+
+
+namespace brs
+{
+
+
+
+class document;
+
+
+/** \brief A typed view of an array in a buffer.
+ *
+ * This is a read-only pointer and number of items, as returned by
+ * node::view(). The items are not copied so the view is only valid
+ * as long as the buffer exists.
+ */
+template<typename T>
+class array_view
+{
+public:
+                        array_view() = default;
+
+                        array_view(T const * data, std::size_t size)
+                            : f_data(data)
+                            , f_size(size)
+                        {
+                        }
+
+    T const *           data() const { return f_data; }
+    std::size_t         size() const { return f_size; }
+    bool                empty() const { return f_size == 0; }
+    T const *           begin() const { return f_data; }
+    T const *           end() const { return f_data + f_size; }
+    T const &           operator [] (std::size_t idx) const { return f_data[idx]; }
+
+private:
+    T const *           f_data = nullptr;
+    std::size_t         f_size = 0;
+};
+
+
+/** \brief One node of a brs::document.
+ *
+ * A node is a small handle (a pointer to the document and a node
+ * number) which can be copied freely. It remains valid as long as the
+ * document and its buffer exist.
+ *
+ * The root node represents the whole buffer. It has no name and its
+ * children are the top level hunks.
+ */
+class node
+{
+public:
+                        node() = default;
+
+    explicit            operator bool () const;
+
+    std::string_view    name() const;
+    std::string_view    sub_name() const;
+    int                 index() const;
+    std::size_t         count() const;
+    type_t              type() const;
+    bool                is_subfield() const;
+    bool                is_compressed() const;
+    std::string_view    data() const;
+    std::size_t         data_offset() const;
+
+    std::size_t         size() const;
+    node                child(std::size_t idx) const;
+    node                find(std::string_view name) const;
+    node                find(std::string_view name, int index) const;
+    node                find(std::string_view name, std::string_view sub_name) const;
+    node                find_path(std::string_view path) const;
+    node                find_path(path_t const & path) const;
+
+    /** \brief Get the data of this node as a basic type.
+     *
+     * \exception brs_logic_error
+     * The size of the data is not sizeof(T).
+     *
+     * \tparam T  The type of the value, which must be trivially copyable.
+     *
+     * \return The value.
+     */
+    template<typename T>
+    T value() const
+    {
+        static_assert(std::is_trivially_copyable<T>::value
+                    , "node values must be trivially copyable.");
+
+        std::string_view const d(data());
+        if(d.length() != sizeof(T))
+        {
+            throw brs_logic_error(
+                      "hunk size is "
+                    + std::to_string(d.length())
+                    + ", but you are trying to read "
+                    + std::to_string(sizeof(T))
+                    + '.');
+        }
+
+        T result;
+        memcpy(&result, d.data(), sizeof(T));
+        return result;
+    }
+
+    /** \brief Get the data of this node as an array without copying it.
+     *
+     * The data must be aligned for type T. This is the case when the
+     * buffer was created with serializer::set_aligned() and the buffer
+     * is loaded at an address aligned to LARGE_PAYLOAD_ALIGNMENT (i.e.
+     * a memory mapped file).
+     *
+     * \exception brs_logic_error
+     * The size of the data is not a multiple of sizeof(T) or the data is
+     * not aligned for type T.
+     *
+     * \tparam T  The type of the items, which must be trivially copyable.
+     *
+     * \return A view of the items in the buffer.
+     */
+    template<typename T>
+    array_view<T> view() const
+    {
+        static_assert(std::is_trivially_copyable<T>::value
+                    , "node views must be of trivially copyable items.");
+
+        std::string_view const d(data());
+        if(d.length() % sizeof(T) != 0)
+        {
+            throw brs_logic_error(
+                      "hunk size is "
+                    + std::to_string(d.length())
+                    + ", which is not a multiple of "
+                    + std::to_string(sizeof(T))
+                    + '.');
+        }
+        if(d.empty())
+        {
+            return array_view<T>();
+        }
+        if(reinterpret_cast<std::uintptr_t>(d.data()) % alignof(T) != 0)
+        {
+            throw brs_logic_error(
+                      "data of \""
+                    + std::string(name())
+                    + "\" is not aligned to "
+                    + std::to_string(alignof(T))
+                    + " bytes.");
+        }
+
+        return array_view<T>(reinterpret_cast<T const *>(d.data()), d.length() / sizeof(T));
+    }
+
+private:
+    friend class document;
+
+                        node(document const * doc, std::uint32_t id);
+
+    hunk_t              hunk() const;
+
+    document const *    f_document = nullptr;
+    std::uint32_t       f_id = 0;
+};
+
+
+class document
+{
+public:
+                        document(char const * buffer, std::size_t size, bool include_magic = true);
+                        document(std::string const & buffer, bool include_magic = true);
+
+                        document(document const &) = delete;
+    document &          operator = (document const &) = delete;
+
+    node                root() const;
+    std::size_t         node_count() const;
+
+private:
+    friend class node;
+
+    static constexpr std::uint32_t const    NOT_EXPANDED = static_cast<std::uint32_t>(-1);
+
+    struct node_t
+    {
+        std::uint32_t   f_offset = 0;                   // offset of the hunk
+        std::uint32_t   f_first_child = 0;              // index in f_nodes
+        std::uint32_t   f_child_count = NOT_EXPANDED;
+    };
+
+    typedef std::vector<node_t>     node_vector_t;
+
+    void                expand(std::uint32_t id) const;
+    std::size_t         skip_subfield(std::size_t offset) const;
+    hunk_t              get_hunk(std::size_t offset) const;
+
+    char const *            f_buffer = nullptr;
+    std::size_t             f_size = 0;
+    std::size_t             f_start = 0;
+    mutable node_vector_t   f_nodes = node_vector_t();
+};
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,399 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the file descriptor streams.
+ *
+ * Only the slow paths live here: the ones that make system calls. The
+ * fast paths, copying data from or to the block buffer, are inline in
+ * the header.
+ */
+
+// self
+//
+#include    "brs/fd_stream.h"
+
+
+// C++
+//
+#include    <cerrno>
+#include    <vector>
+
+
+// C
+//
+#include    <limits.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace brs
+{
+
+
+
+namespace
+{
+
+
+
+void verify_block_size(std::size_t block_size)
+{
+    if(block_size < FD_MIN_BLOCK_SIZE
+    || block_size > FD_MAX_BLOCK_SIZE)
+    {
+        throw brs_out_of_range(
+                  "block size must be between "
+                + std::to_string(FD_MIN_BLOCK_SIZE)
+                + " and "
+                + std::to_string(FD_MAX_BLOCK_SIZE)
+                + " bytes.");
+    }
+}
+
+
+void throw_io_error(std::string const & message)
+{
+    int const e(errno);
+    throw brs_io_error(
+              message
+            + ": "
+            + strerror(e)
+            + '.');
+}
+
+
+
+} // no name namespace
+
+
+
+/** \brief Initialize a sink writing to \p fd.
+ *
+ * \exception brs_out_of_range
+ * The \p block_size is not between FD_MIN_BLOCK_SIZE and
+ * FD_MAX_BLOCK_SIZE.
+ *
+ * \param[in] fd  The file descriptor to write to.
+ * \param[in] block_size  The size of the buffer.
+ */
+fd_sink::fd_sink(int fd, std::size_t block_size)
+    : f_fd(fd)
+    , f_block_size(block_size)
+{
+    verify_block_size(block_size);
+    f_buffer.reset(new char[block_size]);
+}
+
+
+/** \brief Flush the sink.
+ *
+ * Errors cannot be reported from the destructor. Call flush() first if
+ * you need to know whether all the data was written.
+ */
+fd_sink::~fd_sink()
+{
+    try
+    {
+        flush();
+    }
+    catch(brs_io_error const &)
+    {
+    }
+}
+
+
+/** \brief Write fragments to the sink.
+ *
+ * This function is used by the serializer add_value() function saving a
+ * value from fragments (see has_writev). Small fragments get copied to
+ * the buffer. Otherwise the buffer and the fragments are written with
+ * writev(2) so the fragments do not get copied.
+ *
+ * \exception brs_io_error
+ * The data could not be written to the file descriptor.
+ *
+ * \param[in] fragments  The fragments to write.
+ * \param[in] count  The number of fragments.
+ *
+ * \return The number of bytes written.
+ */
+int fd_sink::writev(iovec const * fragments, int count)
+{
+    std::size_t size(0);
+    for(int idx(0); idx < count; ++idx)
+    {
+        size += fragments[idx].iov_len;
+    }
+
+    if(size <= f_block_size - f_used)
+    {
+        for(int idx(0); idx < count; ++idx)
+        {
+            memcpy(f_buffer.get() + f_used, fragments[idx].iov_base, fragments[idx].iov_len);
+            f_used += fragments[idx].iov_len;
+        }
+    }
+    else
+    {
+        std::vector<iovec> all;
+        all.reserve(count + 1);
+        all.push_back(iovec{ f_buffer.get(), f_used });
+        all.insert(all.end(), fragments, fragments + count);
+        write_fragments(all.data(), static_cast<int>(all.size()));
+        f_used = 0;
+    }
+    f_written += size;
+
+    return static_cast<int>(size);
+}
+
+
+/** \brief Write the buffer to the file descriptor.
+ *
+ * \exception brs_io_error
+ * The data could not be written to the file descriptor.
+ */
+void fd_sink::flush()
+{
+    if(f_used > 0)
+    {
+        iovec const buffer{ f_buffer.get(), f_used };
+        f_used = 0;
+        write_fragments(&buffer, 1);
+    }
+}
+
+
+std::size_t fd_sink::block_size() const
+{
+    return f_block_size;
+}
+
+
+/** \brief Number of bytes written to this sink.
+ *
+ * This includes the bytes still in the buffer.
+ *
+ * \return The number of bytes written so far.
+ */
+std::size_t fd_sink::tell() const
+{
+    return f_written;
+}
+
+
+void fd_sink::write_block(char_type const * data, std::size_t size)
+{
+    if(size < f_block_size)
+    {
+        // fill the buffer, write it, and keep the rest
+        //
+        std::size_t const part(f_block_size - f_used);
+        memcpy(f_buffer.get() + f_used, data, part);
+        f_used = f_block_size;
+        flush();
+        memcpy(f_buffer.get(), data + part, size - part);
+        f_used = size - part;
+        return;
+    }
+
+    iovec const fragments[2] = {
+        { f_buffer.get(), f_used },
+        { const_cast<char_type *>(data), size },
+    };
+    f_used = 0;
+    write_fragments(fragments, 2);
+}
+
+
+void fd_sink::write_fragments(iovec const * fragments, int count)
+{
+    std::vector<iovec> left(fragments, fragments + count);
+    std::size_t first(0);
+    while(first < left.size())
+    {
+        if(left[first].iov_len == 0)
+        {
+            ++first;
+            continue;
+        }
+        int const n(static_cast<int>(std::min(left.size() - first, static_cast<std::size_t>(IOV_MAX))));
+        ssize_t r(::writev(f_fd, left.data() + first, n));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            throw_io_error("could not write to file descriptor " + std::to_string(f_fd));
+        }
+        while(r > 0)
+        {
+            std::size_t const used(std::min(static_cast<std::size_t>(r), left[first].iov_len));
+            left[first].iov_base = reinterpret_cast<char *>(left[first].iov_base) + used;
+            left[first].iov_len -= used;
+            r -= used;
+            if(left[first].iov_len == 0)
+            {
+                ++first;
+            }
+        }
+    }
+}
+
+
+
+/** \brief Initialize a source reading from \p fd.
+ *
+ * \exception brs_out_of_range
+ * The \p block_size is not between FD_MIN_BLOCK_SIZE and
+ * FD_MAX_BLOCK_SIZE.
+ *
+ * \param[in] fd  The file descriptor to read from.
+ * \param[in] block_size  The size of the buffer.
+ */
+fd_source::fd_source(int fd, std::size_t block_size)
+    : f_fd(fd)
+    , f_block_size(block_size)
+{
+    verify_block_size(block_size);
+    f_buffer.reset(new char[block_size]);
+}
+
+
+/** \brief Clear the eof() and fail states.
+ *
+ * This is useful to continue reading a pipe or a file which another
+ * process is still writing.
+ */
+void fd_source::clear()
+{
+    f_eof = false;
+    f_fail = false;
+}
+
+
+std::size_t fd_source::block_size() const
+{
+    return f_block_size;
+}
+
+
+void fd_source::read_block(char_type * data, std::size_t size)
+{
+    f_gcount = 0;
+    if(f_fail)
+    {
+        return;
+    }
+
+    while(f_gcount < size)
+    {
+        if(f_available == 0)
+        {
+            std::size_t const left(size - f_gcount);
+            if(left >= f_block_size)
+            {
+                // large reads go directly to the destination
+                //
+                std::size_t const r(read_fd(data + f_gcount, left));
+                if(r == 0)
+                {
+                    break;
+                }
+                f_gcount += r;
+                continue;
+            }
+            if(!fill())
+            {
+                break;
+            }
+        }
+        std::size_t const n(std::min(size - f_gcount, f_available));
+        memcpy(data + f_gcount, f_buffer.get() + f_position, n);
+        f_position += n;
+        f_available -= n;
+        f_gcount += n;
+    }
+
+    if(f_gcount < size)
+    {
+        f_eof = true;
+        f_fail = true;
+    }
+}
+
+
+void fd_source::ignore_block(std::size_t size)
+{
+    f_gcount = 0;
+    if(f_fail)
+    {
+        return;
+    }
+
+    while(f_gcount < size)
+    {
+        if(f_available == 0
+        && !fill())
+        {
+            f_eof = true;
+            return;
+        }
+        std::size_t const n(std::min(size - f_gcount, f_available));
+        f_position += n;
+        f_available -= n;
+        f_gcount += n;
+    }
+}
+
+
+bool fd_source::fill()
+{
+    f_position = 0;
+    f_available = read_fd(f_buffer.get(), f_block_size);
+    return f_available > 0;
+}
+
+
+std::size_t fd_source::read_fd(char * data, std::size_t size)
+{
+    for(;;)
+    {
+        ssize_t const r(::read(f_fd, data, size));
+        if(r >= 0)
+        {
+            return r;
+        }
+        if(errno != EINTR)
+        {
+            throw_io_error("could not read from file descriptor " + std::to_string(f_fd));
+        }
+    }
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,219 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Buffered streams reading and writing a file descriptor.
+ *
+ * The serializer and deserializer work with any type of stream offering
+ * the few functions they use. The standard file streams work, but each
+ * small read of the deserializer goes through the stream buffer, the
+ * sentry and the gcount() bookkeeping, and the buffer is only a few
+ * kilobytes.
+ *
+ * The fd_sink and fd_source classes offer the same functions with
+ * inline fast paths (a memcpy() when the data is in the buffer) and one
+ * large block buffer, between FD_MIN_BLOCK_SIZE and FD_MAX_BLOCK_SIZE
+ * bytes. They work with files, pipes, and sockets.
+ *
+ * \code
+ *     int fd(open("data.brs", O_WRONLY | O_CREAT | O_TRUNC, 0644));
+ *     {
+ *         brs::fd_sink sink(fd);
+ *         brs::serializer out(sink);
+ *         my_object.serialize(out);
+ *     }   // the sink gets flushed here
+ *     close(fd);
+ * \endcode
+ *
+ * The file descriptor is not closed by these classes.
+ */
+
+// self
+//
+#include    <brs/brs.h>
+
+
+// C++
+//
+#include    <cstring>
+
+
+
+namespace brs
+{
+
+
+
+constexpr std::size_t const     FD_MIN_BLOCK_SIZE = 1024 * 1024;
+constexpr std::size_t const     FD_DEFAULT_BLOCK_SIZE = 1024 * 1024;
+constexpr std::size_t const     FD_MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+
+class fd_sink
+{
+public:
+    typedef char        char_type;
+
+                        fd_sink(int fd, std::size_t block_size = FD_DEFAULT_BLOCK_SIZE);
+                        fd_sink(fd_sink const &) = delete;
+                        ~fd_sink();
+    fd_sink &           operator = (fd_sink const &) = delete;
+
+    /** \brief Write data to the sink.
+     *
+     * The data is copied to the block buffer. When the buffer is full,
+     * it gets written to the file descriptor. Data larger than the
+     * buffer is written directly, along with the buffer, in a single
+     * writev(2) call.
+     *
+     * \exception brs_io_error
+     * The data could not be written to the file descriptor.
+     *
+     * \param[in] data  The data to write.
+     * \param[in] size  The size of \p data.
+     *
+     * \return A reference to this sink.
+     */
+    fd_sink &           write(char_type const * data, std::size_t size)
+                        {
+                            if(size <= f_block_size - f_used)
+                            {
+                                memcpy(f_buffer.get() + f_used, data, size);
+                                f_used += size;
+                            }
+                            else
+                            {
+                                write_block(data, size);
+                            }
+                            f_written += size;
+                            return *this;
+                        }
+
+    int                 writev(iovec const * fragments, int count);
+    void                flush();
+    std::size_t         block_size() const;
+    std::size_t         tell() const;
+
+private:
+    void                write_block(char_type const * data, std::size_t size);
+    void                write_fragments(iovec const * fragments, int count);
+
+    int                         f_fd = -1;
+    std::size_t                 f_block_size = 0;
+    std::unique_ptr<char[]>     f_buffer = std::unique_ptr<char[]>();
+    std::size_t                 f_used = 0;
+    std::size_t                 f_written = 0;
+};
+
+
+class fd_source
+{
+public:
+    typedef char        char_type;
+
+                        fd_source(int fd, std::size_t block_size = FD_DEFAULT_BLOCK_SIZE);
+                        fd_source(fd_source const &) = delete;
+    fd_source &         operator = (fd_source const &) = delete;
+
+    /** \brief Read data from the source.
+     *
+     * This function works like std::istream::read(). If fewer than
+     * \p size bytes are available before the end of the input, the
+     * eof() and fail states get set and gcount() returns the number of
+     * bytes actually read.
+     *
+     * \exception brs_io_error
+     * The file descriptor could not be read.
+     *
+     * \param[out] data  The buffer receiving the data.
+     * \param[in] size  The number of bytes to read.
+     *
+     * \return A reference to this source.
+     */
+    fd_source &         read(char_type * data, std::size_t size)
+                        {
+                            if(size <= f_available
+                            && !f_fail)
+                            {
+                                memcpy(data, f_buffer.get() + f_position, size);
+                                f_position += size;
+                                f_available -= size;
+                                f_gcount = size;
+                            }
+                            else
+                            {
+                                read_block(data, size);
+                            }
+                            return *this;
+                        }
+
+    /** \brief Skip data.
+     *
+     * This function works like std::istream::ignore() with a size: the
+     * eof() state gets set if the end of the input is found first.
+     *
+     * \exception brs_io_error
+     * The file descriptor could not be read.
+     *
+     * \param[in] size  The number of bytes to skip.
+     *
+     * \return A reference to this source.
+     */
+    fd_source &         ignore(std::size_t size)
+                        {
+                            if(size <= f_available
+                            && !f_fail)
+                            {
+                                f_position += size;
+                                f_available -= size;
+                                f_gcount = size;
+                            }
+                            else
+                            {
+                                ignore_block(size);
+                            }
+                            return *this;
+                        }
+
+    std::streamsize     gcount() const { return static_cast<std::streamsize>(f_gcount); }
+    bool                eof() const { return f_eof; }
+    explicit            operator bool () const { return !f_fail; }
+    void                clear();
+    std::size_t         block_size() const;
+
+private:
+    void                read_block(char_type * data, std::size_t size);
+    void                ignore_block(std::size_t size);
+    bool                fill();
+    std::size_t         read_fd(char * data, std::size_t size);
+
+    int                         f_fd = -1;
+    std::size_t                 f_block_size = 0;
+    std::unique_ptr<char[]>     f_buffer = std::unique_ptr<char[]>();
+    std::size_t                 f_position = 0;
+    std::size_t                 f_available = 0;
+    std::size_t                 f_gcount = 0;
+    bool                        f_eof = false;
+    bool                        f_fail = false;
+};
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,265 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Scan the hunks of a BRS buffer in memory.
+ *
+ * The deserializer reads hunks from a stream and hands them to your
+ * callbacks. Tools that work on the format itself (deltas, statistics,
+ * in place updates, etc.) instead need to know where each hunk is
+ * found in a buffer. The read_hunk() function gives you that
+ * information without copying anything.
+ */
+
+// self
+//
+#include    <brs/brs.h>
+
+
+// C++
+//
+#include    <cstring>
+
+
+
+namespace brs
+{
+
+
+
+/** \brief Position and sizes of one hunk in a buffer.
+ *
+ * All the offsets are from the start of the buffer passed to
+ * read_hunk().
+ */
+struct hunk_t
+{
+    /** \brief Check whether this hunk marks the end of a sub-field.
+     *
+     * \return true if this is an end of sub-field marker.
+     */
+    bool is_end() const
+    {
+        return f_type == TYPE_FIELD
+            && f_name_length == 0
+            && f_size == 0;
+    }
+
+    /** \brief Offset right after this hunk.
+     *
+     * \return The offset of the next hunk in the buffer.
+     */
+    std::size_t end() const
+    {
+        return f_data + f_size;
+    }
+
+    std::size_t     f_offset = 0;           // offset of the hunk header
+    type_t          f_type = TYPE_FIELD;
+    std::size_t     f_name = 0;             // offset of the name
+    std::size_t     f_name_length = 0;
+    std::size_t     f_sub_name = 0;         // offset of the sub-name (TYPE_MAP)
+    std::size_t     f_sub_name_length = 0;
+    int             f_index = -1;           // index (TYPE_ARRAY, EXTENSION_ARRAY...)
+    std::size_t     f_count = 1;            // number of items (EXTENSION_ARRAY_RUN)
+    std::size_t     f_data = 0;             // offset of the data
+    std::size_t     f_size = 0;             // size of the data
+    bool            f_subfield = false;     // start of a sub-field (EXTENSION_SUBFIELD)
+    bool            f_padding = false;      // padding to skip (EXTENSION_PADDING)
+    bool            f_compressed = false;   // data is compressed (EXTENSION_COMPRESSED)
+    codec_t         f_codec = 0;            // codec used to compress the data (EXTENSION_COMPRESSED)
+    std::size_t     f_uncompressed_size = 0;    // size of the data once decompressed (EXTENSION_COMPRESSED)
+};
+
+
+/** \brief Read the hunk found at \p offset.
+ *
+ * This function parses the hunk header found at \p offset in \p buffer
+ * and saves the position of its various parts in \p hunk. The data is
+ * not read. To go to the next hunk, use hunk.end() as the next offset.
+ *
+ * The \p offset must point to a hunk header, not the magic code.
+ *
+ * \exception brs_unknown_type
+ * The hunk type is not known.
+ *
+ * \exception brs_map_name_cannot_be_empty
+ * The hunk is a map item with an empty sub-name.
+ *
+ * \exception brs_invalid_hunk
+ * The hunk is an array item with an invalid index or count, or a
+ * padding hunk with a name.
+ *
+ * \param[in] buffer  The buffer with the hunks.
+ * \param[in] size  The size of \p buffer in bytes.
+ * \param[in] offset  The offset of the hunk header to read.
+ * \param[out] hunk  The hunk information.
+ *
+ * \return true if the whole hunk is available in the buffer, false if the
+ * buffer is too small.
+ */
+inline bool read_hunk(char const * buffer, std::size_t size, std::size_t offset, hunk_t & hunk)
+{
+    hunk_sizes_t hunk_sizes = {};
+    if(offset + sizeof(hunk_sizes) > size)
+    {
+        return false;
+    }
+    memcpy(&hunk_sizes, buffer + offset, sizeof(hunk_sizes));
+
+    hunk = hunk_t();
+    hunk.f_offset = offset;
+    hunk.f_type = hunk_sizes.f_type;
+    hunk.f_name_length = hunk_sizes.f_name;
+    hunk.f_size = hunk_sizes.f_hunk;
+    offset += sizeof(hunk_sizes);
+
+    switch(hunk_sizes.f_type)
+    {
+    case TYPE_FIELD:
+        break;
+
+    case TYPE_ARRAY:
+        {
+            std::uint16_t idx(0);
+            if(offset + sizeof(idx) > size)
+            {
+                return false;
+            }
+            memcpy(&idx, buffer + offset, sizeof(idx));
+            hunk.f_index = idx;
+            offset += sizeof(idx);
+        }
+        break;
+
+    case TYPE_MAP:
+        {
+            if(offset + 1 > size)
+            {
+                return false;
+            }
+            hunk.f_sub_name_length = static_cast<std::uint8_t>(buffer[offset]);
+            if(hunk.f_sub_name_length == 0)
+            {
+                throw brs_map_name_cannot_be_empty("the length of a map's field name cannot be zero.");
+            }
+            hunk.f_sub_name = offset + 1;
+            offset += 1 + hunk.f_sub_name_length;
+        }
+        break;
+
+    case TYPE_EXTENDED:
+        {
+            if(offset + sizeof(extension_t) > size)
+            {
+                return false;
+            }
+            extension_t const extension(static_cast<extension_t>(buffer[offset]));
+            offset += sizeof(extension_t);
+
+            std::uint32_t idx[2] = {};
+            std::size_t length(0);
+            switch(extension)
+            {
+            case EXTENSION_ARRAY32:
+                length = sizeof(idx[0]);
+                break;
+
+            case EXTENSION_ARRAY_RUN:
+                length = sizeof(idx);
+                break;
+
+            case EXTENSION_SUBFIELD:
+                if(hunk.f_size != 0)
+                {
+                    throw brs_invalid_hunk("the start of a sub-field cannot include data.");
+                }
+                hunk.f_subfield = true;
+                break;
+
+            case EXTENSION_PADDING:
+                if(hunk.f_name_length != 0)
+                {
+                    throw brs_invalid_hunk("a padding hunk cannot have a name.");
+                }
+                hunk.f_padding = true;
+                break;
+
+            case EXTENSION_COMPRESSED:
+                {
+                    std::uint32_t uncompressed_size(0);
+                    if(offset + sizeof(hunk.f_codec) + sizeof(uncompressed_size) > size)
+                    {
+                        return false;
+                    }
+                    hunk.f_codec = static_cast<codec_t>(buffer[offset]);
+                    memcpy(&uncompressed_size, buffer + offset + sizeof(hunk.f_codec), sizeof(uncompressed_size));
+                    offset += sizeof(hunk.f_codec) + sizeof(uncompressed_size);
+                    hunk.f_compressed = true;
+                    hunk.f_uncompressed_size = uncompressed_size;
+                }
+                break;
+
+            default:
+                throw brs_unknown_type("read a field with an unknown extension.");
+
+            }
+            if(offset + length > size)
+            {
+                return false;
+            }
+            if(length == 0)
+            {
+                break;
+            }
+            memcpy(idx, buffer + offset, length);
+            offset += length;
+
+            if(idx[0] > static_cast<std::uint32_t>(std::numeric_limits<int>::max()))
+            {
+                throw brs_invalid_hunk("array index is too large.");
+            }
+            hunk.f_index = static_cast<int>(idx[0]);
+            if(extension == EXTENSION_ARRAY_RUN)
+            {
+                if(idx[1] == 0
+                || hunk.f_size % idx[1] != 0)
+                {
+                    throw brs_invalid_hunk("array run size is not a multiple of its number of items.");
+                }
+                hunk.f_count = idx[1];
+            }
+        }
+        break;
+
+    default:
+        throw brs_unknown_type("read a field with an unknown type.");
+
+    }
+
+    hunk.f_name = offset;
+    hunk.f_data = offset + hunk.f_name_length;
+
+    return hunk.end() <= size;
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,697 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the BRS log files.
+ *
+ * The writer keeps the records in a pending buffer. The buffer gets
+ * written once it reaches the buffer size or when a record gets
+ * committed. Only one thread writes at a time (f_write_mutex) so the
+ * blocks are written in order. Only one thread calls fdatasync() at a
+ * time; the other threads committing records wait for it and, if their
+ * record was included, return without calling fdatasync() themselves.
+ */
+
+// self
+//
+#include    "brs/log.h"
+
+
+// C++
+//
+#include    <cstring>
+#include    <thread>
+
+
+// C
+//
+#include    <fcntl.h>
+#include    <sys/stat.h>
+#include    <unistd.h>
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace brs
+{
+
+
+
+namespace
+{
+
+
+
+/** \brief Size of the blocks read by the log_reader.
+ */
+constexpr std::size_t const     READ_SIZE = 1024 * 1024;
+
+
+void throw_io_error(std::string const & message, std::string const & filename)
+{
+    int const e(errno);
+    throw brs_io_error(
+              message
+            + " \""
+            + filename
+            + "\": "
+            + strerror(e)
+            + '.');
+}
+
+
+
+} // no name namespace
+
+
+
+/** \brief Compute the checksum of a log record.
+ *
+ * This is the 32 bit FNV-1a hash of the record's hunks.
+ *
+ * \param[in] data  The hunks of the record.
+ * \param[in] size  The size of \p data.
+ *
+ * \return The checksum.
+ */
+log_checksum_t log_checksum(char const * data, std::size_t size)
+{
+    log_checksum_t hash(0x811c9dc5);
+    for(std::size_t idx(0); idx < size; ++idx)
+    {
+        hash ^= static_cast<std::uint8_t>(data[idx]);
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+
+/** \brief Remove a torn record from the end of a log file.
+ *
+ * After a crash, the last records of a log file may only be partially
+ * written. This function reads the file and truncates it right after
+ * the last valid record.
+ *
+ * Only a record which reaches the end of the file is considered torn.
+ * An invalid record followed by more data means the file is corrupted;
+ * the file is left alone so the valid records after it are not lost.
+ *
+ * This function must not be called while a log_writer is appending to
+ * the file. The log_writer constructor calls it for you.
+ *
+ * \exception brs_io_error
+ * The file cannot be opened, read, or truncated.
+ *
+ * \exception brs_invalid_record
+ * An invalid record was found before the end of the file.
+ *
+ * \exception brs_magic_unsupported
+ * The file is not a BRS log file.
+ *
+ * \param[in] filename  The name of the log file.
+ *
+ * \return The number of bytes removed from the file.
+ */
+std::size_t truncate_log(std::string const & filename)
+{
+    std::size_t end(0);
+    {
+        log_reader reader(filename);
+        std::string hunks;
+        while(reader.next_record(hunks))
+        {
+        }
+        end = reader.tell();
+    }
+
+    int const fd(open(filename.c_str(), O_RDWR | O_CLOEXEC));
+    if(fd < 0)
+    {
+        throw_io_error("could not open", filename);
+    }
+    struct stat st = {};
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw_io_error("could not get the size of", filename);
+    }
+    std::size_t const size(st.st_size);
+    if(size > end)
+    {
+        // the invalid record must reach the end of the file, otherwise
+        // it is not a torn record
+        //
+        if(end > 0
+        && size - end >= LOG_RECORD_HEADER_SIZE)
+        {
+            record_size_t record_size(0);
+            if(pread(fd, &record_size, sizeof(record_size), end) != sizeof(record_size))
+            {
+                close(fd);
+                throw_io_error("could not read", filename);
+            }
+            if(end + LOG_RECORD_HEADER_SIZE + record_size < size)
+            {
+                close(fd);
+                throw brs_invalid_record(
+                          "log file \""
+                        + filename
+                        + "\" has an invalid record at offset "
+                        + std::to_string(end)
+                        + '.');
+            }
+        }
+
+        if(ftruncate(fd, end) != 0
+        || fdatasync(fd) != 0)
+        {
+            close(fd);
+            throw_io_error("could not truncate", filename);
+        }
+    }
+    close(fd);
+
+    return size > end ? size - end : 0;
+}
+
+
+
+/** \brief Open a log file for writing.
+ *
+ * The file is created if it does not exist yet. Otherwise, a torn
+ * record at the end of the file is removed (see truncate_log()) and
+ * the new records get appended.
+ *
+ * The records are written to the file once \p buffer_size bytes are
+ * pending or when a record gets committed.
+ *
+ * \exception brs_io_error
+ * The file cannot be opened.
+ *
+ * \exception brs_invalid_record
+ * The file has an invalid record before its end (see truncate_log()).
+ *
+ * \param[in] filename  The name of the log file.
+ * \param[in] buffer_size  The number of bytes to buffer before writing.
+ */
+log_writer::log_writer(std::string const & filename, std::size_t buffer_size)
+    : f_filename(filename)
+    , f_buffer_size(buffer_size)
+{
+    f_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(f_fd < 0)
+    {
+        throw_io_error("could not open", filename);
+    }
+
+    try
+    {
+        f_truncated = truncate_log(filename);
+    }
+    catch(...)
+    {
+        close(f_fd);
+        throw;
+    }
+
+    struct stat st = {};
+    if(fstat(f_fd, &st) != 0)
+    {
+        close(f_fd);
+        throw_io_error("could not get the size of", filename);
+    }
+    if(st.st_size == 0)
+    {
+        magic_t const magic(BRS_LOG_MAGIC);
+        f_pending.append(reinterpret_cast<char const *>(&magic), sizeof(magic));
+    }
+}
+
+
+/** \brief Write and sync the remaining records.
+ *
+ * Errors are ignored. Call sync() before destroying the writer if you
+ * need to know whether all the records were saved.
+ */
+log_writer::~log_writer()
+{
+    try
+    {
+        sync();
+    }
+    catch(brs_io_error const &)
+    {
+    }
+    close(f_fd);
+}
+
+
+/** \brief Serialize one record.
+ *
+ * The \p callback is given a serializer which writes to a buffer
+ * without a magic code, the same way as with a record_writer. The
+ * record is added to the pending buffer. Call commit() to make sure it
+ * gets saved to disk.
+ *
+ * \param[in] callback  The function serializing the record.
+ *
+ * \return The number of the record, to pass to commit().
+ */
+log_record_t log_writer::add_record(serialize_t const & callback)
+{
+    std::lock_guard<std::mutex> lock(f_serializer_mutex);
+
+    f_buffer.str(std::string());
+    f_buffer.clear();
+    f_serializer.reset(f_buffer, false);
+    callback(f_serializer);
+
+    std::string const hunks(f_buffer.str());
+    return append(hunks.c_str(), hunks.length());
+}
+
+
+/** \brief Add an already serialized record.
+ *
+ * \param[in] hunks  The hunks of the record (without a magic code).
+ * \param[in] size  The number of bytes in \p hunks.
+ *
+ * \return The number of the record, to pass to commit().
+ */
+log_record_t log_writer::add_hunks(char const * hunks, std::size_t size)
+{
+    return append(hunks, size);
+}
+
+
+/** \brief Write the pending records.
+ *
+ * The records are written to the file without waiting for them to
+ * reach the disk.
+ */
+void log_writer::flush()
+{
+    write_pending(false);
+}
+
+
+/** \brief Make sure a record is saved on disk.
+ *
+ * This function returns once \p record and all the records added before
+ * it were written and synchronized to disk. If another thread is
+ * already synchronizing the file, this function waits for it and only
+ * synchronizes the file again if \p record was not included.
+ *
+ * \exception brs_io_error
+ * The records could not be written or synchronized.
+ *
+ * \param[in] record  The number returned by add_record() or add_hunks().
+ */
+void log_writer::commit(log_record_t record)
+{
+    std::unique_lock<std::mutex> lock(f_mutex);
+    if(record >= f_added)
+    {
+        throw brs_logic_error("record " + std::to_string(record) + " was not added yet.");
+    }
+
+    while(f_synced <= record)
+    {
+        if(f_syncing)
+        {
+            f_synced_changed.wait(lock);
+            continue;
+        }
+
+        f_syncing = true;
+        lock.unlock();
+        log_record_t count(0);
+        try
+        {
+            count = write_pending(true);
+        }
+        catch(...)
+        {
+            lock.lock();
+            f_syncing = false;
+            f_synced_changed.notify_all();
+            throw;
+        }
+        lock.lock();
+        f_syncing = false;
+        f_synced = std::max(f_synced, count);
+        f_synced_changed.notify_all();
+    }
+}
+
+
+/** \brief Make sure all the records are saved on disk.
+ */
+void log_writer::sync()
+{
+    log_record_t added(0);
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        added = f_added;
+    }
+    if(added == 0)
+    {
+        write_pending(true);
+        return;
+    }
+    commit(added - 1);
+}
+
+
+/** \brief Number of bytes removed from the file when it was opened.
+ *
+ * \return The size of the torn record removed from the end of the file.
+ */
+std::size_t log_writer::truncated() const
+{
+    return f_truncated;
+}
+
+
+log_record_t log_writer::append(char const * hunks, std::size_t size)
+{
+    record_size_t const record_size(static_cast<record_size_t>(size));
+    if(record_size != size)
+    {
+        throw brs_out_of_range("record too large.");
+    }
+    log_checksum_t const checksum(log_checksum(hunks, size));
+
+    bool full(false);
+    log_record_t record(0);
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        f_pending.append(reinterpret_cast<char const *>(&record_size), sizeof(record_size));
+        f_pending.append(reinterpret_cast<char const *>(&checksum), sizeof(checksum));
+        f_pending.append(hunks, size);
+        record = f_added;
+        ++f_added;
+        full = f_pending.length() >= f_buffer_size;
+    }
+
+    if(full)
+    {
+        write_pending(false);
+    }
+
+    return record;
+}
+
+
+/** \brief Write the pending records.
+ *
+ * \param[in] sync  Whether to call fdatasync() once the data is written.
+ *
+ * \return The number of records added before the pending buffer was
+ * taken, which are all saved once this function returns.
+ */
+log_record_t log_writer::write_pending(bool sync)
+{
+    std::lock_guard<std::mutex> write_lock(f_write_mutex);
+
+    log_record_t count(0);
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        f_writing.clear();
+        f_pending.swap(f_writing);
+        count = f_added;
+    }
+
+    char const * data(f_writing.data());
+    std::size_t size(f_writing.length());
+    while(size > 0)
+    {
+        ssize_t const r(write(f_fd, data, size));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            throw_io_error("could not write to", f_filename);
+        }
+        data += r;
+        size -= r;
+    }
+
+    if(sync
+    && fdatasync(f_fd) != 0)
+    {
+        throw_io_error("could not sync", f_filename);
+    }
+
+    return count;
+}
+
+
+
+/** \brief Open a log file for reading.
+ *
+ * The magic code is verified when the first record is read, so a
+ * reader can be created on a file which a writer just created.
+ *
+ * \exception brs_io_error
+ * The file cannot be opened.
+ *
+ * \param[in] filename  The name of the log file.
+ */
+log_reader::log_reader(std::string const & filename)
+    : f_filename(filename)
+{
+    f_fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(f_fd < 0)
+    {
+        throw_io_error("could not open", filename);
+    }
+}
+
+
+log_reader::~log_reader()
+{
+    close(f_fd);
+}
+
+
+/** \brief Read the hunks of the next record.
+ *
+ * When the file ends in the middle of a record or the checksum of the
+ * record does not match, this function returns false without moving
+ * to the next record. This happens when the file has a torn record
+ * at the end after a crash or when a writer did not finish writing that
+ * record yet. In the latter case, calling this function again later
+ * returns the record.
+ *
+ * \exception brs_magic_unsupported
+ * The file is not a BRS log file.
+ *
+ * \param[out] hunks  The hunks of the record.
+ *
+ * \return true if a record was read.
+ */
+bool log_reader::next_record(std::string & hunks)
+{
+    if(f_data_offset + f_position == 0)
+    {
+        magic_t magic(0);
+        if(!fill(sizeof(magic)))
+        {
+            return false;
+        }
+        memcpy(&magic, f_data.data(), sizeof(magic));
+        if(magic != BRS_LOG_MAGIC)
+        {
+            throw brs_magic_unsupported("log file magic unsupported.");
+        }
+        f_position = sizeof(magic);
+    }
+
+    if(!fill(LOG_RECORD_HEADER_SIZE))
+    {
+        f_data.resize(f_position);
+        return false;
+    }
+    record_size_t size(0);
+    log_checksum_t checksum(0);
+    memcpy(&size, f_data.data() + f_position, sizeof(size));
+    memcpy(&checksum, f_data.data() + f_position + sizeof(size), sizeof(checksum));
+
+    if(!fill(LOG_RECORD_HEADER_SIZE + size))
+    {
+        f_data.resize(f_position);
+        return false;
+    }
+    char const * data(f_data.data() + f_position + LOG_RECORD_HEADER_SIZE);
+    if(log_checksum(data, size) != checksum)
+    {
+        // the record may still be written, read it again next time
+        //
+        f_data.resize(f_position);
+        return false;
+    }
+
+    hunks.assign(data, size);
+    f_position += LOG_RECORD_HEADER_SIZE + size;
+    ++f_record_number;
+    return true;
+}
+
+
+/** \brief Read the next record.
+ *
+ * \param[in] callback  The callback called with each hunk of the record.
+ *
+ * \return false if there is no valid record to read; otherwise, the
+ * result of the deserialization.
+ */
+bool log_reader::read_record(process_hunk_t & callback)
+{
+    if(!next_record(f_record))
+    {
+        return false;
+    }
+
+    f_buffer.str(f_record);
+    f_buffer.clear();
+    f_deserializer.reset(f_buffer, false);
+    return f_deserializer.deserialize(callback);
+}
+
+
+/** \brief Wait for the next record.
+ *
+ * This function reads the next record. If none is available yet, it
+ * checks the file again every \p poll milliseconds until a writer adds
+ * one or \p timeout milliseconds have passed.
+ *
+ * \param[out] hunks  The hunks of the record.
+ * \param[in] timeout  How long to wait for a record.
+ * \param[in] poll  How long to sleep between checks.
+ *
+ * \return true if a record was read, false on a timeout.
+ */
+bool log_reader::follow(
+      std::string & hunks
+    , std::chrono::milliseconds timeout
+    , std::chrono::milliseconds poll)
+{
+    std::chrono::steady_clock::time_point const limit(std::chrono::steady_clock::now() + timeout);
+    for(;;)
+    {
+        if(next_record(hunks))
+        {
+            return true;
+        }
+        std::chrono::steady_clock::time_point const now(std::chrono::steady_clock::now());
+        if(now >= limit)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(poll, limit - now));
+    }
+}
+
+
+/** \brief Number of records read so far.
+ *
+ * \return The number of the next record.
+ */
+log_record_t log_reader::record_number() const
+{
+    return f_record_number;
+}
+
+
+/** \brief Offset of the next record.
+ *
+ * \return The offset in the file of the next record.
+ */
+std::size_t log_reader::tell() const
+{
+    return f_data_offset + f_position;
+}
+
+
+/** \brief Remove a torn record from the end of the file.
+ *
+ * See truncate_log().
+ *
+ * \return The number of bytes removed from the file.
+ */
+std::size_t log_reader::truncate_tail()
+{
+    return truncate_log(f_filename);
+}
+
+
+/** \brief Make sure \p size bytes are available in the buffer.
+ *
+ * \param[in] size  The number of bytes needed from f_position.
+ *
+ * \return true if enough data is available, false if the file is too short.
+ */
+bool log_reader::fill(std::size_t size)
+{
+    if(f_data.length() - f_position >= size)
+    {
+        return true;
+    }
+
+    if(f_position > 0)
+    {
+        f_data.erase(0, f_position);
+        f_data_offset += f_position;
+        f_position = 0;
+    }
+
+    while(f_data.length() < size)
+    {
+        std::size_t const used(f_data.length());
+        f_data.resize(used + READ_SIZE);
+        ssize_t const r(pread(f_fd, f_data.data() + used, READ_SIZE, f_data_offset + used));
+        if(r < 0)
+        {
+            f_data.resize(used);
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            throw_io_error("could not read", f_filename);
+        }
+        f_data.resize(used + r);
+        if(r == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,163 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Append-only log files of BRS records.
+ *
+ * A log file is used as a journal of events. Records are only ever
+ * appended to the file and a crash can leave the last records partially
+ * written. The format is similar to the record stream format (see
+ * brs/record.h) with a checksum added to each record so a torn record
+ * can be detected:
+ *
+ * \code
+ *     magic       (BRS_LOG_MAGIC)
+ *     size        (32 bits, size of the first record's hunks)
+ *     checksum    (32 bits, FNV-1a of the first record's hunks)
+ *     hunks       (the first record)
+ *     size
+ *     checksum
+ *     hunks       (the second record)
+ *     ...
+ * \endcode
+ *
+ * The log_writer buffers the records and writes them in large blocks.
+ * Calling commit() makes sure a record is on disk. When several threads
+ * commit at the same time, one fdatasync() is used for all of them
+ * (group commit).
+ *
+ * The log_reader reads the records back and can follow the file while
+ * a writer appends more records to it.
+ */
+
+// self
+//
+#include    <brs/record.h>
+
+
+// C++
+//
+#include    <condition_variable>
+#include    <mutex>
+
+
+
+namespace brs
+{
+
+
+
+constexpr magic_t const         BRS_LOG_MAGIC_BIG_ENDIAN    = build_magic('B', 'J');
+constexpr magic_t const         BRS_LOG_MAGIC_LITTLE_ENDIAN = build_magic('L', 'J');
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr magic_t const         BRS_LOG_MAGIC = BRS_LOG_MAGIC_BIG_ENDIAN;
+#else
+constexpr magic_t const         BRS_LOG_MAGIC = BRS_LOG_MAGIC_LITTLE_ENDIAN;
+#endif
+
+typedef std::uint32_t           log_checksum_t;
+typedef std::uint64_t           log_record_t;
+
+constexpr std::size_t const     LOG_RECORD_HEADER_SIZE = sizeof(record_size_t) + sizeof(log_checksum_t);
+
+
+log_checksum_t      log_checksum(char const * data, std::size_t size);
+std::size_t         truncate_log(std::string const & filename);
+
+
+class log_writer
+{
+public:
+    typedef std::function<void(serializer<std::stringstream> &)>    serialize_t;
+
+                        log_writer(
+                              std::string const & filename
+                            , std::size_t buffer_size = 1024 * 1024);
+                        log_writer(log_writer const &) = delete;
+                        ~log_writer();
+    log_writer &        operator = (log_writer const &) = delete;
+
+    log_record_t        add_record(serialize_t const & callback);
+    log_record_t        add_hunks(char const * hunks, std::size_t size);
+    void                flush();
+    void                commit(log_record_t record);
+    void                sync();
+    std::size_t         truncated() const;
+
+private:
+    log_record_t        append(char const * hunks, std::size_t size);
+    log_record_t        write_pending(bool sync);
+
+    std::string                     f_filename = std::string();
+    int                             f_fd = -1;
+    std::size_t                     f_buffer_size = 0;
+    std::size_t                     f_truncated = 0;
+    std::mutex                      f_mutex = std::mutex();
+    std::mutex                      f_write_mutex = std::mutex();
+    std::mutex                      f_serializer_mutex = std::mutex();
+    std::condition_variable         f_synced_changed = std::condition_variable();
+    std::string                     f_pending = std::string();
+    std::string                     f_writing = std::string();
+    log_record_t                    f_added = 0;
+    log_record_t                    f_synced = 0;
+    bool                            f_syncing = false;
+    std::stringstream               f_buffer = std::stringstream();
+    serializer<std::stringstream>   f_serializer = serializer<std::stringstream>(f_buffer, false);
+};
+
+
+class log_reader
+{
+public:
+    typedef typename deserializer<std::stringstream>::process_hunk_t    process_hunk_t;
+
+                        log_reader(std::string const & filename);
+                        log_reader(log_reader const &) = delete;
+                        ~log_reader();
+    log_reader &        operator = (log_reader const &) = delete;
+
+    bool                next_record(std::string & hunks);
+    bool                read_record(process_hunk_t & callback);
+    bool                follow(
+                              std::string & hunks
+                            , std::chrono::milliseconds timeout
+                            , std::chrono::milliseconds poll = std::chrono::milliseconds(10));
+    log_record_t        record_number() const;
+    std::size_t         tell() const;
+    std::size_t         truncate_tail();
+
+private:
+    bool                fill(std::size_t size);
+
+    std::string                     f_filename = std::string();
+    int                             f_fd = -1;
+    std::string                     f_data = std::string();
+    std::size_t                     f_data_offset = 0;      // file offset of f_data[0]
+    std::size_t                     f_position = 0;         // position in f_data
+    log_record_t                    f_record_number = 0;
+    std::string                     f_record = std::string();
+    std::stringstream               f_buffer = std::stringstream();
+    deserializer<std::stringstream> f_deserializer = deserializer<std::stringstream>(f_buffer, false);
+};
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
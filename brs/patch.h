@@ -0,0 +1,204 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Update fields of a BRS buffer in place.
+ *
+ * Counters and timestamps saved in large buffers (i.e. in shared memory)
+ * can be updated without serializing the whole buffer again as long as
+ * the new value has the same size as the old one.
+ *
+ * The locate() function finds the data of a field using a path (see
+ * brs/path.h). The resulting location can be saved and reused with
+ * patch() to update the value again, which is then a simple memcpy().
+ *
+ * \code
+ *     brs::location_t counter;
+ *     if(!brs::locate(buffer, size, "stats/counter", counter))
+ *     {
+ *         ...handle error...
+ *     }
+ *     ...
+ *     brs::patch(buffer, counter, ++count);
+ * \endcode
+ *
+ * The location remains valid as long as the layout of the buffer does
+ * not change.
+ */
+
+// self
+//
+#include    <brs/document.h>
+
+
+
+namespace brs
+{
+
+
+
+DECLARE_EXCEPTION(brs_error, brs_field_not_found);
+
+
+struct location_t
+{
+    std::size_t     f_offset = 0;       // offset of the data in the buffer
+    std::size_t     f_size = 0;         // size of the data
+};
+
+
+/** \brief Find the data of a field.
+ *
+ * This function searches \p buffer for the field at \p path and saves
+ * the position of its data in \p location. When the path points to an
+ * array item saved in a run (see serializer::add_array()), the location
+ * is the one of that one item.
+ *
+ * \exception brs_invalid_path
+ * The path is not valid.
+ *
+ * \param[in] buffer  The buffer with the BRS data.
+ * \param[in] size  The size of \p buffer.
+ * \param[in] path  The path to the field.
+ * \param[out] location  The location of the field data.
+ * \param[in] include_magic  Whether the buffer starts with the magic code.
+ *
+ * \return true if the field was found and its data is not compressed.
+ */
+inline bool locate(
+      char const * buffer
+    , std::size_t size
+    , std::string_view path
+    , location_t & location
+    , bool include_magic = true)
+{
+    path_t const p(parse_path(path));
+    document const doc(buffer, size, include_magic);
+    node const n(doc.root().find_path(p));
+    if(!n
+    || n.is_subfield()
+    || n.is_compressed())
+    {
+        return false;
+    }
+
+    location.f_offset = n.data_offset();
+    location.f_size = n.data().length();
+
+    path_segment_t const & last(p.back());
+    if(n.count() > 1
+    && last.f_kind == SEGMENT_INDEX
+    && !last.f_any)
+    {
+        location.f_size /= n.count();
+        location.f_offset += (last.f_index - n.index()) * location.f_size;
+    }
+
+    return true;
+}
+
+
+/** \brief Overwrite the data of a field.
+ *
+ * \exception brs_logic_error
+ * The size of \p value is not the size of the field data.
+ *
+ * \param[in] buffer  The buffer to update.
+ * \param[in] location  The location returned by locate().
+ * \param[in] value  The new value.
+ */
+template<typename T>
+void patch(char * buffer, location_t const & location, T const & value)
+{
+    static_assert(std::is_trivially_copyable<T>::value
+                , "patched values must be trivially copyable.");
+
+    if(location.f_size != sizeof(value))
+    {
+        throw brs_logic_error(
+                  "hunk size is "
+                + std::to_string(location.f_size)
+                + ", but you are trying to write "
+                + std::to_string(sizeof(value))
+                + '.');
+    }
+
+    memcpy(buffer + location.f_offset, &value, sizeof(value));
+}
+
+
+inline void patch(char * buffer, location_t const & location, std::string_view value)
+{
+    if(location.f_size != value.length())
+    {
+        throw brs_logic_error(
+                  "hunk size is "
+                + std::to_string(location.f_size)
+                + ", but you are trying to write "
+                + std::to_string(value.length())
+                + '.');
+    }
+
+    memcpy(buffer + location.f_offset, value.data(), value.length());
+}
+
+
+inline void patch(char * buffer, location_t const & location, std::string const & value)
+{
+    patch(buffer, location, std::string_view(value));
+}
+
+
+/** \brief Find and overwrite the data of a field.
+ *
+ * This function is a shortcut to locate() and patch(). If you update
+ * the same field repeatedly, save the location instead.
+ *
+ * \exception brs_field_not_found
+ * The field at \p path does not exist.
+ *
+ * \param[in] buffer  The buffer to update.
+ * \param[in] size  The size of \p buffer.
+ * \param[in] path  The path to the field.
+ * \param[in] value  The new value.
+ * \param[in] include_magic  Whether the buffer starts with the magic code.
+ *
+ * \return The location of the field, which can be used to patch it again.
+ */
+template<typename T>
+location_t patch(
+      char * buffer
+    , std::size_t size
+    , std::string_view path
+    , T const & value
+    , bool include_magic = true)
+{
+    location_t location;
+    if(!locate(buffer, size, path, location, include_magic))
+    {
+        throw brs_field_not_found("field \"" + std::string(path) + "\" not found.");
+    }
+    patch(buffer, location, value);
+    return location;
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,177 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the BRS path parser.
+ */
+
+// self
+//
+#include    "brs/path.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace brs
+{
+
+
+
+namespace
+{
+
+
+
+path_segment_t parse_segment(std::string_view segment, std::string_view path)
+{
+    path_segment_t result;
+
+    char close('\0');
+    std::string_view::size_type const pos(segment.find_first_of("[{"));
+    if(pos == std::string_view::npos)
+    {
+        result.f_name = segment;
+    }
+    else
+    {
+        result.f_name = segment.substr(0, pos);
+        if(segment[pos] == '[')
+        {
+            result.f_kind = SEGMENT_INDEX;
+            close = ']';
+        }
+        else
+        {
+            result.f_kind = SEGMENT_MAP;
+            close = '}';
+        }
+        if(segment.back() != close)
+        {
+            throw brs_invalid_path(
+                      "missing '"
+                    + std::string(1, close)
+                    + "' in path \""
+                    + std::string(path)
+                    + "\".");
+        }
+    }
+
+    if(result.f_name.empty())
+    {
+        throw brs_invalid_path("empty name in path \"" + std::string(path) + "\".");
+    }
+    if(result.f_name.length() > 127)
+    {
+        throw brs_invalid_path("name too long in path \"" + std::string(path) + "\".");
+    }
+
+    if(result.f_kind == SEGMENT_NAME)
+    {
+        return result;
+    }
+
+    std::string_view const value(segment.substr(pos + 1, segment.length() - pos - 2));
+    if(value == "*")
+    {
+        result.f_any = true;
+        return result;
+    }
+
+    if(result.f_kind == SEGMENT_MAP)
+    {
+        if(value.empty()
+        || value.length() > 255)
+        {
+            throw brs_invalid_path("invalid sub-name in path \"" + std::string(path) + "\".");
+        }
+        result.f_sub_name = value;
+        return result;
+    }
+
+    if(value.empty()
+    || value.length() > 10)
+    {
+        throw brs_invalid_path("invalid index in path \"" + std::string(path) + "\".");
+    }
+    std::int64_t index(0);
+    for(auto const c : value)
+    {
+        if(c < '0' || c > '9')
+        {
+            throw brs_invalid_path("invalid index in path \"" + std::string(path) + "\".");
+        }
+        index = index * 10 + c - '0';
+    }
+    if(index > std::numeric_limits<int>::max())
+    {
+        throw brs_invalid_path("invalid index in path \"" + std::string(path) + "\".");
+    }
+    result.f_index = static_cast<int>(index);
+
+    return result;
+}
+
+
+
+} // no name namespace
+
+
+
+/** \brief Parse a path to a field.
+ *
+ * The segments returned reference \p path, which must remain valid for
+ * as long as the result is used.
+ *
+ * \exception brs_invalid_path
+ * The path is empty or one of its segments is invalid.
+ *
+ * \param[in] path  The path to parse.
+ *
+ * \return The list of segments.
+ */
+path_t parse_path(std::string_view path)
+{
+    if(path.empty())
+    {
+        throw brs_invalid_path("a path cannot be empty.");
+    }
+
+    path_t result;
+    std::string_view::size_type start(0);
+    for(;;)
+    {
+        std::string_view::size_type const end(path.find('/', start));
+        result.push_back(parse_segment(path.substr(start, end - start), path));
+        if(end == std::string_view::npos)
+        {
+            break;
+        }
+        start = end + 1;
+    }
+
+    return result;
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,80 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Paths to fields in a BRS buffer.
+ *
+ * A path is a list of segments separated by slashes. Each segment is
+ * the name of a field optionally followed by an array index or a map
+ * sub-name:
+ *
+ * \li `name` -- the field named `name`;
+ * \li `name[12]` -- the item 12 of the array named `name`;
+ * \li `name{key}` -- the item `key` of the map named `name`;
+ * \li `name[*]` and `name{*}` -- any item of the array or map.
+ *
+ * All the segments except the last one must name sub-fields. For
+ * example, `header/size` is the field named `size` in the sub-field
+ * named `header`.
+ */
+
+// self
+//
+#include    <brs/brs.h>
+
+
+// C++
+//
+#include    <string_view>
+
+
+
+namespace brs
+{
+
+
+
+DECLARE_EXCEPTION(brs_error, brs_invalid_path);
+
+
+typedef std::uint8_t            segment_kind_t;
+
+constexpr segment_kind_t const  SEGMENT_NAME = 0;   // name
+constexpr segment_kind_t const  SEGMENT_INDEX = 1;  // name[index] or name[*]
+constexpr segment_kind_t const  SEGMENT_MAP = 2;    // name{sub_name} or name{*}
+
+
+struct path_segment_t
+{
+    std::string_view    f_name = std::string_view();
+    segment_kind_t      f_kind = SEGMENT_NAME;
+    bool                f_any = false;              // [*] or {*}
+    int                 f_index = -1;
+    std::string_view    f_sub_name = std::string_view();
+};
+
+typedef std::vector<path_segment_t>     path_t;
+
+
+path_t              parse_path(std::string_view path);
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,219 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Implementation of the BRS projections.
+ */
+
+// self
+//
+#include    "brs/projection.h"
+
+
+// last include
+//
+#include    <snapdev/poison.h>
+
+
+
+namespace brs
+{
+
+
+
+projection::projection()
+    : f_steps(1)
+{
+}
+
+
+projection::projection(std::initializer_list<std::string_view> paths)
+    : f_steps(1)
+{
+    for(auto const & p : paths)
+    {
+        add_path(p);
+    }
+}
+
+
+projection::projection(std::vector<std::string> const & paths)
+    : f_steps(1)
+{
+    for(auto const & p : paths)
+    {
+        add_path(p);
+    }
+}
+
+
+/** \brief Add a path to this projection.
+ *
+ * The \p path gets parsed and added to the tree of steps. Segments
+ * shared with paths added earlier are reused.
+ *
+ * If a path ends on a sub-field which is also the prefix of another
+ * path (i.e. "stats" and "stats/counter"), the shorter path wins and
+ * the whole sub-field is sent to your callback.
+ *
+ * \exception brs_invalid_path
+ * The path is not valid.
+ *
+ * \param[in] path  The path to add.
+ *
+ * \return The number of the path, as returned by
+ * deserializer::matched_path(). Adding the same path again returns
+ * the number it was first given.
+ */
+std::size_t projection::add_path(std::string_view path)
+{
+    path_t const segments(parse_path(path));
+
+    std::size_t step(ROOT);
+    for(auto const & s : segments)
+    {
+        std::size_t next(NO_MATCH);
+        for(auto const c : f_steps[step].f_children)
+        {
+            step_t const & child(f_steps[c]);
+            if(child.f_name == s.f_name
+            && child.f_kind == s.f_kind
+            && child.f_any == s.f_any
+            && child.f_index == s.f_index
+            && child.f_sub_name == s.f_sub_name)
+            {
+                next = c;
+                break;
+            }
+        }
+        if(next == NO_MATCH)
+        {
+            step_t child;
+            child.f_name = s.f_name;
+            child.f_kind = s.f_kind;
+            child.f_any = s.f_any;
+            child.f_index = s.f_index;
+            child.f_sub_name = s.f_sub_name;
+
+            next = f_steps.size();
+            f_steps.push_back(child);
+            f_steps[step].f_children.push_back(next);
+        }
+        step = next;
+    }
+
+    if(f_steps[step].f_path == NO_MATCH)
+    {
+        f_steps[step].f_path = f_paths;
+        ++f_paths;
+    }
+    return f_steps[step].f_path;
+}
+
+
+/** \brief Return the number of distinct paths.
+ *
+ * \return The number of paths added to this projection.
+ */
+std::size_t projection::size() const
+{
+    return f_paths;
+}
+
+
+/** \brief Search the children of \p step for one matching \p field.
+ *
+ * A name segment matches a field with that name, whatever its index or
+ * sub-name. An index segment only matches array items, including runs
+ * of items which overlap the index. A map segment only matches map
+ * items.
+ *
+ * \param[in] step  The current step, ROOT at the top level.
+ * \param[in] field  The field just read by the deserializer.
+ *
+ * \return The matching step or NO_MATCH.
+ */
+std::size_t projection::match(std::size_t step, field_t const & field) const
+{
+    for(auto const c : f_steps[step].f_children)
+    {
+        step_t const & child(f_steps[c]);
+        if(child.f_name != field.f_name)
+        {
+            continue;
+        }
+        switch(child.f_kind)
+        {
+        case SEGMENT_NAME:
+            return c;
+
+        case SEGMENT_INDEX:
+            if(field.f_index >= 0
+            && (child.f_any
+                || (child.f_index >= field.f_index
+                    && static_cast<std::size_t>(child.f_index - field.f_index) < field.f_count)))
+            {
+                return c;
+            }
+            break;
+
+        case SEGMENT_MAP:
+            if(!field.f_sub_name.empty()
+            && (child.f_any || child.f_sub_name == field.f_sub_name))
+            {
+                return c;
+            }
+            break;
+
+        default:
+            throw brs_logic_error("unknown path segment kind.");
+
+        }
+    }
+
+    return NO_MATCH;
+}
+
+
+/** \brief Check whether \p step is the end of a path.
+ *
+ * \param[in] step  A step returned by match().
+ *
+ * \return true if the matching hunk has to be sent to the callback.
+ */
+bool projection::is_leaf(std::size_t step) const
+{
+    return f_steps[step].f_path != NO_MATCH;
+}
+
+
+/** \brief Return the number of the path ending at \p step.
+ *
+ * \param[in] step  A step returned by match().
+ *
+ * \return The path number, or NO_MATCH if \p step is not a leaf.
+ */
+std::size_t projection::path(std::size_t step) const
+{
+    return f_steps[step].f_path;
+}
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,91 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Select the fields to deserialize.
+ *
+ * A projection is a compiled set of paths (see brs/path.h). When passed
+ * to deserializer::deserialize(), only the hunks matching one of the
+ * paths are sent to your callback. Everything else, including whole
+ * sub-fields, is skipped by the deserializer.
+ *
+ * \code
+ *     brs::projection const paths{ "count", "t2/size[*]" };
+ *     ...
+ *     in.deserialize(callback, paths);
+ * \endcode
+ *
+ * The paths are compiled once in a tree where common prefixes are
+ * shared so matching a hunk only looks at the children of the current
+ * step. A projection can be reused for any number of buffers.
+ */
+
+// self
+//
+#include    <brs/path.h>
+
+
+// C++
+//
+#include    <initializer_list>
+
+
+
+namespace brs
+{
+
+
+
+class projection
+{
+public:
+    static constexpr std::size_t const  ROOT = 0;
+    static constexpr std::size_t const  NO_MATCH = static_cast<std::size_t>(-1);
+
+                        projection();
+                        projection(std::initializer_list<std::string_view> paths);
+                        projection(std::vector<std::string> const & paths);
+
+    std::size_t         add_path(std::string_view path);
+    std::size_t         size() const;
+
+    std::size_t         match(std::size_t step, field_t const & field) const;
+    bool                is_leaf(std::size_t step) const;
+    std::size_t         path(std::size_t step) const;
+
+private:
+    struct step_t
+    {
+        std::string                 f_name = std::string();
+        segment_kind_t              f_kind = SEGMENT_NAME;
+        bool                        f_any = false;
+        int                         f_index = -1;
+        std::string                 f_sub_name = std::string();
+        std::vector<std::size_t>    f_children = std::vector<std::size_t>();
+        std::size_t                 f_path = NO_MATCH;
+    };
+
+    std::vector<step_t> f_steps = std::vector<step_t>();
+    std::size_t         f_paths = 0;
+};
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -0,0 +1,539 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+/** \file
+ * \brief Save multiple BRS records in one stream.
+ *
+ * A serializer writes one magic code followed by one run of hunks. To
+ * save many messages in one file or socket (a log, a batch of messages,
+ * etc.) the record format frames each message:
+ *
+ * \code
+ *     magic       (BRS_RECORD_MAGIC)
+ *     size        (32 bits, size of the first record's hunks)
+ *     hunks       (the first record)
+ *     size
+ *     hunks       (the second record)
+ *     ...
+ * \endcode
+ *
+ * The records do not include their own magic code. The size prefix
+ * allows the reader to count, skip, and seek records without reading
+ * their hunks and to split a file in byte ranges which each start on
+ * a record boundary, so they can be processed in parallel.
+ */
+
+// self
+//
+#include    <brs/brs.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <sstream>
+
+
+
+namespace brs
+{
+
+
+
+DECLARE_EXCEPTION(brs_error, brs_invalid_record);
+
+
+constexpr magic_t const         BRS_RECORD_MAGIC_BIG_ENDIAN    = build_magic('B', 'F');
+constexpr magic_t const         BRS_RECORD_MAGIC_LITTLE_ENDIAN = build_magic('L', 'F');
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr magic_t const         BRS_RECORD_MAGIC = BRS_RECORD_MAGIC_BIG_ENDIAN;
+#else
+constexpr magic_t const         BRS_RECORD_MAGIC = BRS_RECORD_MAGIC_LITTLE_ENDIAN;
+#endif
+
+typedef std::uint32_t           record_size_t;
+
+constexpr std::size_t const     UNKNOWN_RECORD = static_cast<std::size_t>(-1);
+constexpr std::size_t const     RECORD_READ_SIZE = 1024 * 1024;     // records are read in chunks of this size
+
+
+/** \brief A byte range of a record stream.
+ *
+ * The f_start offset is the offset of the first record's size and
+ * f_end is the offset right after the last record of the range.
+ */
+struct record_range_t
+{
+    std::size_t     f_start = 0;
+    std::size_t     f_end = 0;
+    std::size_t     f_records = 0;
+};
+
+typedef std::vector<record_range_t>     record_range_vector_t;
+
+
+/** \brief Write records to a stream.
+ *
+ * The constructor writes the record magic code. Then each call to
+ * add_record() writes one record.
+ *
+ * \code
+ *     std::ofstream out("journal.brs");
+ *     brs::record_writer<std::ofstream> writer(out);
+ *     for(auto const & e : events)
+ *     {
+ *         writer.add_record([&e](brs::serializer<std::stringstream> & s)
+ *             {
+ *                 e.serialize(s);
+ *             });
+ *     }
+ * \endcode
+ *
+ * \tparam S  The type of output stream to write the records to.
+ */
+template<typename S>
+class record_writer
+{
+public:
+    typedef std::function<void(serializer<std::stringstream> &)>    serialize_t;
+
+    record_writer(S & output)
+        : f_output(output)
+    {
+        magic_t const magic(BRS_RECORD_MAGIC);
+        f_output.write(
+                  reinterpret_cast<typename S::char_type const *>(&magic)
+                , sizeof(magic));
+    }
+
+
+    /** \brief Serialize one record.
+     *
+     * The \p callback is given a serializer which writes to a buffer
+     * without a magic code. Once it returns, the size of that buffer
+     * followed by its content are written to the output stream.
+     *
+     * \param[in] callback  The function serializing the record.
+     */
+    void add_record(serialize_t const & callback)
+    {
+        f_buffer.str(std::string());
+        f_buffer.clear();
+        f_serializer.reset(f_buffer, false);
+        callback(f_serializer);
+
+        std::string const hunks(f_buffer.str());
+        add_hunks(hunks.c_str(), hunks.length());
+    }
+
+
+    /** \brief Add an already serialized record.
+     *
+     * This function writes a record which was serialized with a
+     * serializer created with its include_magic parameter set to false.
+     *
+     * \param[in] hunks  The hunks of the record.
+     * \param[in] size  The number of bytes in \p hunks.
+     */
+    void add_hunks(char const * hunks, std::size_t size)
+    {
+        record_size_t const record_size(static_cast<record_size_t>(size));
+        if(record_size != size)
+        {
+            throw brs_out_of_range("record too large.");
+        }
+
+        f_output.write(
+                  reinterpret_cast<typename S::char_type const *>(&record_size)
+                , sizeof(record_size));
+        f_output.write(
+                  reinterpret_cast<typename S::char_type const *>(hunks)
+                , size);
+    }
+
+private:
+    S &                             f_output;
+    std::stringstream               f_buffer = std::stringstream();
+    serializer<std::stringstream>   f_serializer = serializer<std::stringstream>(f_buffer, false);
+};
+
+
+/** \brief Read records from a stream.
+ *
+ * The constructor verifies the record magic code. Then each call to
+ * read_record() reads the next record and calls your callback with
+ * each one of its hunks.
+ *
+ * The stream must support seekg() and tellg() for the skip_record(),
+ * seek(), count_records(), and split() functions.
+ *
+ * \tparam S  The type of input stream to read the records from.
+ */
+template<typename S>
+class record_reader
+{
+public:
+    typedef typename deserializer<std::stringstream>::process_hunk_t    process_hunk_t;
+
+    record_reader(S & input)
+        : f_input(input)
+    {
+        magic_t magic = {};
+        f_input.read(reinterpret_cast<typename S::char_type *>(&magic), sizeof(magic));
+        if(!f_input || f_input.gcount() != sizeof(magic))
+        {
+            throw brs_magic_missing("magic missing from the start of the record stream.");
+        }
+        if(magic != BRS_RECORD_MAGIC)
+        {
+            throw brs_magic_unsupported("record stream magic unsupported.");
+        }
+        f_offsets.push_back(sizeof(magic));
+    }
+
+
+    /** \brief Set the limits used to read the records.
+     *
+     * The limits are passed to the deserializer used by read_record().
+     * The f_max_total_bytes limit is also the maximum size of a record;
+     * it gets checked before the record gets read.
+     *
+     * \param[in] limits  The new limits.
+     */
+    void set_limits(limits_t const & limits)
+    {
+        f_limits = limits;
+        f_deserializer.set_limits(limits);
+    }
+
+
+    /** \brief Read the next record.
+     *
+     * This function reads the next record and deserializes it with
+     * \p callback.
+     *
+     * \param[in] callback  The callback called with each hunk of the record.
+     *
+     * \return false if there are no more records; otherwise, the result
+     * of the deserialization.
+     */
+    bool read_record(process_hunk_t & callback)
+    {
+        if(!next_record(f_record))
+        {
+            return false;
+        }
+
+        f_buffer.str(f_record);
+        f_buffer.clear();
+        f_deserializer.reset(f_buffer, false);
+        return f_deserializer.deserialize(callback);
+    }
+
+
+    /** \brief Read the hunks of the next record.
+     *
+     * The size of the record comes from the stream. The buffer grows
+     * RECORD_READ_SIZE bytes at a time as the data gets read, so a
+     * truncated or corrupted size does not allocate more memory than
+     * the stream holds.
+     *
+     * \exception brs_invalid_record
+     * The stream ends in the middle of a record.
+     *
+     * \exception brs_limit_exceeded
+     * The record is larger than the f_max_total_bytes limit.
+     *
+     * \param[out] hunks  The hunks of the record.
+     *
+     * \return true if a record was read, false at the end of the stream.
+     */
+    bool next_record(std::string & hunks)
+    {
+        record_size_t size(0);
+        if(!read_size(size))
+        {
+            return false;
+        }
+
+        hunks.clear();
+        while(hunks.length() < size)
+        {
+            std::size_t const offset(hunks.length());
+            std::size_t const part(std::min(size - offset, RECORD_READ_SIZE));
+            hunks.resize(offset + part);
+            f_input.read(reinterpret_cast<typename S::char_type *>(hunks.data() + offset), part);
+            if(!f_input || static_cast<std::size_t>(f_input.gcount()) != part)
+            {
+                throw brs_invalid_record("record is truncated.");
+            }
+        }
+        record_read(size);
+        return true;
+    }
+
+
+    /** \brief Skip the next record.
+     *
+     * The record size gets read and the data skipped with seekg() so the
+     * hunks are not read. A file stream lets you seek past its end, so
+     * the last byte of the record gets read to make sure it exists.
+     *
+     * \exception brs_invalid_record
+     * The stream ends in the middle of a record.
+     *
+     * \exception brs_limit_exceeded
+     * The record is larger than the f_max_total_bytes limit.
+     *
+     * \return true if a record was skipped, false at the end of the stream.
+     */
+    bool skip_record()
+    {
+        record_size_t size(0);
+        if(!read_size(size))
+        {
+            return false;
+        }
+        if(size > 0)
+        {
+            f_input.seekg(size - 1, std::ios_base::cur);
+            if(!f_input
+            || S::traits_type::eq_int_type(f_input.get(), S::traits_type::eof()))
+            {
+                throw brs_invalid_record("record is truncated.");
+            }
+        }
+        record_read(size);
+        return true;
+    }
+
+
+    /** \brief Go to the specified record.
+     *
+     * The offsets of the records already visited are cached so going
+     * back to a previous record is fast.
+     *
+     * \param[in] record  The record number, starting at 0.
+     *
+     * \return true if the record exists.
+     */
+    bool seek(std::size_t record)
+    {
+        std::size_t const known(std::min(record, f_offsets.size() - 1));
+        f_input.clear();
+        f_input.seekg(f_offsets[known]);
+        f_record_number = known;
+        while(f_record_number < record)
+        {
+            if(!skip_record())
+            {
+                return false;
+            }
+        }
+
+        // we may be right after the last record, make sure it exists
+        //
+        std::size_t const offset(tell());
+        record_size_t size(0);
+        bool const exists(read_size(size));
+        f_input.clear();
+        f_input.seekg(offset);
+        return exists;
+    }
+
+
+    /** \brief Go to the specified offset.
+     *
+     * This function is used to go to the f_start offset of a range
+     * returned by split(). The offset must be on a record boundary.
+     *
+     * \param[in] offset  The offset of a record.
+     */
+    void seek_offset(std::size_t offset)
+    {
+        f_input.clear();
+        f_input.seekg(offset);
+
+        auto it(std::lower_bound(f_offsets.begin(), f_offsets.end(), offset));
+        if(it != f_offsets.end()
+        && *it == offset)
+        {
+            f_record_number = it - f_offsets.begin();
+        }
+        else
+        {
+            f_record_number = UNKNOWN_RECORD;
+        }
+    }
+
+
+    /** \brief Get the offset of the next record.
+     *
+     * \return The current offset in the input stream.
+     */
+    std::size_t tell()
+    {
+        f_input.clear();
+        return f_input.tellg();
+    }
+
+
+    /** \brief Count the number of records.
+     *
+     * This function counts the records from the start of the stream by
+     * skipping over them. The current position is restored on return.
+     *
+     * \return The number of records in the stream.
+     */
+    std::size_t count_records()
+    {
+        std::size_t const offset(tell());
+        std::size_t const record_number(f_record_number);
+
+        seek(f_offsets.size() - 1);
+        while(skip_record())
+        {
+        }
+        std::size_t const count(f_record_number);
+
+        f_input.clear();
+        f_input.seekg(offset);
+        f_record_number = record_number;
+
+        return count;
+    }
+
+
+    /** \brief Split the stream in \p count ranges.
+     *
+     * This function breaks the stream in up to \p count ranges of
+     * about the same size. Each range starts on a record boundary so
+     * each one can be processed in parallel by separate readers (use
+     * seek_offset() and tell() to stay within a range).
+     *
+     * Ranges without records are not returned so the result may have
+     * fewer than \p count entries.
+     *
+     * The current position is restored on return.
+     *
+     * \param[in] count  The number of ranges to create.
+     *
+     * \return The ranges.
+     */
+    record_range_vector_t split(std::size_t count)
+    {
+        record_range_vector_t result;
+        if(count == 0)
+        {
+            return result;
+        }
+
+        std::size_t const offset(tell());
+        std::size_t const record_number(f_record_number);
+
+        f_input.clear();
+        f_input.seekg(0, std::ios_base::end);
+        std::size_t const size(tell());
+        std::size_t const start(f_offsets[0]);
+        std::size_t const step(std::max(static_cast<std::size_t>(1), (size - start + count - 1) / count));
+
+        seek(0);
+        record_range_t range;
+        range.f_start = start;
+        for(;;)
+        {
+            std::size_t const position(tell());
+            if(!skip_record())
+            {
+                break;
+            }
+            if(position >= range.f_start + step
+            && range.f_records > 0)
+            {
+                range.f_end = position;
+                result.push_back(range);
+                range = record_range_t();
+                range.f_start = position;
+            }
+            ++range.f_records;
+            range.f_end = tell();
+        }
+        if(range.f_records > 0)
+        {
+            result.push_back(range);
+        }
+
+        f_input.clear();
+        f_input.seekg(offset);
+        f_record_number = record_number;
+
+        return result;
+    }
+
+private:
+    bool read_size(record_size_t & size)
+    {
+        f_input.read(reinterpret_cast<typename S::char_type *>(&size), sizeof(size));
+        if(!f_input || f_input.gcount() != sizeof(size))
+        {
+            if(f_input.gcount() == 0)
+            {
+                return false;
+            }
+            throw brs_invalid_record("record size is truncated.");
+        }
+        if(size > f_limits.f_max_total_bytes)
+        {
+            throw brs_limit_exceeded(
+                      "record size is "
+                    + std::to_string(size)
+                    + ", which is more than the limit of "
+                    + std::to_string(f_limits.f_max_total_bytes)
+                    + '.');
+        }
+        return true;
+    }
+
+    void record_read(record_size_t size)
+    {
+        if(f_record_number == UNKNOWN_RECORD)
+        {
+            return;
+        }
+        ++f_record_number;
+        if(f_record_number == f_offsets.size())
+        {
+            f_offsets.push_back(f_offsets.back() + sizeof(size) + size);
+        }
+    }
+
+    S &                                 f_input;
+    limits_t                            f_limits = limits_t();
+    std::vector<std::size_t>            f_offsets = std::vector<std::size_t>();
+    std::size_t                         f_record_number = 0;
+    std::string                         f_record = std::string();
+    std::stringstream                   f_buffer = std::stringstream();
+    deserializer<std::stringstream>     f_deserializer = deserializer<std::stringstream>(f_buffer, false);
+};
+
+
+
+} // namespace brs
+// vim: ts=4 sw=4 et
@@ -36,9 +36,40 @@
 // C++
 //
 #include    <fstream>
+#include    <map>
+#include    <unordered_map>
 
 
 
+namespace
+{
+
+
+
+class gather_stream
+    : public std::stringstream
+{
+public:
+    int writev(iovec const * fragments, int count)
+    {
+        ++f_writev_calls;
+        int size(0);
+        for(int idx(0); idx < count; ++idx)
+        {
+            write(reinterpret_cast<char const *>(fragments[idx].iov_base), fragments[idx].iov_len);
+            size += static_cast<int>(fragments[idx].iov_len);
+        }
+        return size;
+    }
+
+    std::size_t     f_writev_calls = 0;
+};
+
+
+
+} // no name namespace
+
+
 
 CATCH_TEST_CASE("basic_types", "[basic]")
 {
@@ -1189,4 +1220,1759 @@ CATCH_TEST_CASE("basic_types", "[basic]")
 }
 
 
+CATCH_TEST_CASE("version_1", "[basic][version]")
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // buffer written by version 1 of the serializer:
+    //
+    //     out.add_value("name", std::string("v1"));
+    //     out.start_subfield("sub");
+    //     out.add_value("count", 33);
+    //     out.add_value("list", 3, std::string("three"));
+    //     out.end_subfield();
+    //     out.add_value("map", std::string("key"), std::string("value"));
+    //     out.add_value("after", 55);
+    //
+    std::uint8_t const g_version_1_buffer[] =
+    {
+        0x42, 0x52, 0x4C, 0x01, 0x10, 0x04, 0x00, 0x00, 0x6E, 0x61, 0x6D, 0x65,
+        0x76, 0x31, 0x0C, 0x00, 0x00, 0x00, 0x73, 0x75, 0x62, 0x14, 0x08, 0x00,
+        0x00, 0x63, 0x6F, 0x75, 0x6E, 0x74, 0x21, 0x00, 0x00, 0x00, 0x11, 0x0A,
+        0x00, 0x00, 0x03, 0x00, 0x6C, 0x69, 0x73, 0x74, 0x74, 0x68, 0x72, 0x65,
+        0x65, 0x00, 0x00, 0x00, 0x00, 0x0E, 0x0A, 0x00, 0x00, 0x03, 0x6B, 0x65,
+        0x79, 0x6D, 0x61, 0x70, 0x76, 0x61, 0x6C, 0x75, 0x65, 0x14, 0x08, 0x00,
+        0x00, 0x61, 0x66, 0x74, 0x65, 0x72, 0x37, 0x00, 0x00, 0x00,
+    };
+    std::string const data(reinterpret_cast<char const *>(g_version_1_buffer), sizeof(g_version_1_buffer));
+
+    CATCH_SECTION("read a version 1 buffer")
+    {
+        CATCH_REQUIRE(data.substr(0, 4) == std::string(reinterpret_cast<char const *>(&brs::BRS_MAGIC_V1), 4));
+
+        std::stringstream buffer(data);
+        brs::deserializer in(buffer);
+        CATCH_REQUIRE(in.get_version() == brs::BRS_VERSION_1);
+
+        std::string name;
+        int count(0);
+        std::string three;
+        std::string map_value;
+        int after(0);
+        brs::deserializer<std::stringstream>::process_hunk_t sub(
+            [&](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "count")
+                {
+                    return d.read_data(count);
+                }
+                CATCH_REQUIRE(field.f_name == "list");
+                CATCH_REQUIRE(field.f_index == 3);
+                return d.read_data(three);
+            });
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "name")
+                {
+                    return d.read_data(name);
+                }
+                if(field.f_name == "sub")
+                {
+                    // version 1 sub-fields look like empty fields
+                    //
+                    CATCH_REQUIRE_FALSE(field.f_subfield);
+                    CATCH_REQUIRE(field.f_size == 0);
+                    return d.deserialize(sub);
+                }
+                if(field.f_name == "map")
+                {
+                    CATCH_REQUIRE(field.f_sub_name == "key");
+                    return d.read_data(map_value);
+                }
+                CATCH_REQUIRE(field.f_name == "after");
+                return d.read_data(after);
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(name == "v1");
+        CATCH_REQUIRE(count == 33);
+        CATCH_REQUIRE(three == "three");
+        CATCH_REQUIRE(map_value == "value");
+        CATCH_REQUIRE(after == 55);
+
+        // the same deserializer reads version 2 buffers after a reset()
+        //
+        std::stringstream current;
+        brs::serializer out(current);
+        out.add_value("after", 56);
+        in.reset(current);
+        CATCH_REQUIRE(in.get_version() == brs::BRS_VERSION);
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(after == 56);
+    }
+
+    CATCH_SECTION("functions requiring sub-field hunks refuse version 1")
+    {
+        std::stringstream buffer(data);
+        brs::deserializer in(buffer);
+        brs::deserializer<std::stringstream>::process_batch_t func(
+            [](brs::deserializer<std::stringstream> & d
+              , brs::field_record_t const * records
+              , std::size_t size)
+            {
+                snapdev::NOT_USED(d, records, size);
+                return true;
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize_batch(func)
+                , brs::brs_magic_unsupported
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_unsupported: batches cannot be used with version 1 buffers."));
+    }
+
+    CATCH_SECTION("version 1 buffers have no extended hunks")
+    {
+        std::stringstream current;
+        brs::serializer out(current);
+        out.start_subfield("sub");
+        out.end_subfield();
+        std::string v1(current.str());
+        memcpy(v1.data(), &brs::BRS_MAGIC_V1, sizeof(brs::BRS_MAGIC_V1));
+
+        std::stringstream buffer(v1);
+        brs::deserializer in(buffer);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                return d.skip_field();
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_unknown_type
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_unknown_type: read a field with an unknown type."));
+    }
+#endif
+}
+
+
+CATCH_TEST_CASE("limits", "[limits]")
+{
+    CATCH_SECTION("default limits")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+
+        brs::deserializer in(buffer);
+        brs::limits_t const & limits(in.get_limits());
+        CATCH_REQUIRE(limits.f_max_total_bytes == std::numeric_limits<std::size_t>::max());
+        CATCH_REQUIRE(limits.f_max_field_size == std::numeric_limits<std::size_t>::max());
+        CATCH_REQUIRE(limits.f_max_hunks == std::numeric_limits<std::size_t>::max());
+        CATCH_REQUIRE(limits.f_max_depth == std::numeric_limits<std::size_t>::max());
+    }
+
+    CATCH_SECTION("field size limit")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("small", std::string(100, 's'));
+        out.add_value("large", std::string(101, 'l'));
+
+        brs::deserializer in(buffer);
+        brs::limits_t limits;
+        limits.f_max_field_size = 100;
+        in.set_limits(limits);
+
+        std::vector<std::string> names;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&names](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                names.push_back(field.f_name);
+                std::string value;
+                d.read_data(value);
+                return true;
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_limit_exceeded
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_limit_exceeded: hunk size is 101, which is more than the limit of 100."));
+        CATCH_REQUIRE(names == std::vector<std::string>{ "small" });
+    }
+
+    CATCH_SECTION("hunk count limit")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        for(int idx(0); idx < 10; ++idx)
+        {
+            out.add_value("index", idx, idx);
+        }
+
+        brs::deserializer in(buffer);
+        brs::limits_t limits;
+        limits.f_max_hunks = 9;
+        in.set_limits(limits);
+
+        int count(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&count](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                int value;
+                d.read_data(value);
+                ++count;
+                return true;
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_limit_exceeded
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_limit_exceeded: number of hunks is limited to 9."));
+        CATCH_REQUIRE(count == 9);
+    }
+
+    CATCH_SECTION("total size limit")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("map", "key", std::string("value"));   // 4 + 1 + 3 + 3 + 5 = 16 bytes
+        out.add_value("other", "key", std::string("value")); // 4 + 1 + 3 + 5 + 5 = 18 bytes
+
+        // the sub-name is checked separately, make sure that works too
+        //
+        for(std::size_t max : { 33, 30 })
+        {
+            buffer.clear();
+            buffer.seekg(0);
+
+            brs::deserializer in(buffer);
+            brs::limits_t limits;
+            limits.f_max_total_bytes = max;
+            in.set_limits(limits);
+
+            int count(0);
+            brs::deserializer<std::stringstream>::process_hunk_t func(
+                [&count](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+                {
+                    snapdev::NOT_USED(field);
+                    std::string value;
+                    d.read_data(value);
+                    ++count;
+                    return true;
+                });
+            CATCH_REQUIRE_THROWS_MATCHES(
+                      in.deserialize(func)
+                    , brs::brs_limit_exceeded
+                    , Catch::Matchers::ExceptionMessage(
+                              "brs_limit_exceeded: total size of the hunks is limited to "
+                            + std::to_string(max)
+                            + " bytes."));
+            CATCH_REQUIRE(count == 1);
+        }
+    }
+
+    CATCH_SECTION("depth limit")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        {
+            brs::recursive r1(out, "level");
+            {
+                brs::recursive r2(out, "level");
+                {
+                    brs::recursive r3(out, "level");
+                    out.add_value("deepest", 3);
+                }
+            }
+        }
+
+        for(std::size_t max(0); max < 4; ++max)
+        {
+            buffer.clear();
+            buffer.seekg(0);
+
+            brs::deserializer in(buffer);
+            brs::limits_t limits;
+            limits.f_max_depth = max;
+            in.set_limits(limits);
+
+            int deepest(0);
+            brs::deserializer<std::stringstream>::process_hunk_t func;
+            func = [&func, &deepest](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+                {
+                    if(field.f_name == "level")
+                    {
+                        return d.deserialize(func);
+                    }
+                    d.read_data(deepest);
+                    return true;
+                };
+            if(max < 3)
+            {
+                CATCH_REQUIRE_THROWS_MATCHES(
+                          in.deserialize(func)
+                        , brs::brs_limit_exceeded
+                        , Catch::Matchers::ExceptionMessage(
+                                  "brs_limit_exceeded: sub-field depth is limited to "
+                                + std::to_string(max)
+                                + '.'));
+                CATCH_REQUIRE(deepest == 0);
+            }
+            else
+            {
+                CATCH_REQUIRE(in.deserialize(func));
+                CATCH_REQUIRE(deepest == 3);
+            }
+        }
+    }
+}
+
+
+CATCH_TEST_CASE("columns", "[columns]")
+{
+    struct point
+    {
+        std::int32_t    f_x = 0;
+        double          f_y = 0.0;
+        std::uint8_t    f_flags = 0;
+    };
+
+    CATCH_SECTION("push/restore columns")
+    {
+        std::vector<point> points(rand() % 100 + 10);
+        for(auto & p : points)
+        {
+            p.f_x = rand();
+            p.f_y = rand() / 3.0;
+            p.f_flags = rand();
+        }
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_columns(
+                  "points"
+                , points
+                , brs::column("x", &point::f_x)
+                , brs::column("y", &point::f_y)
+                , brs::column("flags", &point::f_flags));
+
+        // magic + start (with its extension byte) + 3 columns + end
+        //
+        std::string const data(buffer.str());
+        CATCH_REQUIRE(data.length() == sizeof(brs::magic_t)
+                                     + (4 + 1 + 6)
+                                     + (4 + 1 + points.size() * sizeof(std::int32_t))
+                                     + (4 + 1 + points.size() * sizeof(double))
+                                     + (4 + 5 + points.size() * sizeof(std::uint8_t))
+                                     + 4);
+
+        std::vector<point> all;
+        std::vector<point> y_only;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&all](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                if(field.f_name != "points")
+                {
+                    return false;
+                }
+                return in.read_columns(
+                          all
+                        , brs::column("x", &point::f_x)
+                        , brs::column("y", &point::f_y)
+                        , brs::column("flags", &point::f_flags));
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        bool const r(in.deserialize(func));
+        CATCH_REQUIRE(r);
+
+        CATCH_REQUIRE(all.size() == points.size());
+        for(std::size_t idx(0); idx < points.size(); ++idx)
+        {
+            CATCH_REQUIRE(all[idx].f_x == points[idx].f_x);
+            CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(all[idx].f_y, points[idx].f_y, 0.0));
+            CATCH_REQUIRE(all[idx].f_flags == points[idx].f_flags);
+        }
+
+        // only read one column, the others are skipped
+        //
+        func = [&y_only](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                return d.read_columns(y_only, brs::column("y", &point::f_y));
+            };
+
+        std::stringstream copy(data);
+        brs::deserializer in2(copy);
+        bool const r2(in2.deserialize(func));
+        CATCH_REQUIRE(r2);
+
+        CATCH_REQUIRE(y_only.size() == points.size());
+        for(std::size_t idx(0); idx < points.size(); ++idx)
+        {
+            CATCH_REQUIRE(y_only[idx].f_x == 0);
+            CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(y_only[idx].f_y, points[idx].f_y, 0.0));
+            CATCH_REQUIRE(y_only[idx].f_flags == 0);
+        }
+    }
+
+    CATCH_SECTION("push/restore empty columns")
+    {
+        std::vector<point> points;
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_columns("points", points, brs::column("x", &point::f_x));
+        out.add_value("after", 123);
+
+        std::vector<point> result(5);
+        int after(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result, &after](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                if(field.f_name == "points")
+                {
+                    return in.read_columns(result, brs::column("x", &point::f_x));
+                }
+                in.read_data(after);
+                return true;
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        bool const r(in.deserialize(func));
+        CATCH_REQUIRE(r);
+        CATCH_REQUIRE(result.empty());
+        CATCH_REQUIRE(after == 123);
+    }
+
+    CATCH_SECTION("columns of different sizes")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.start_subfield("points");
+        std::int32_t const x[3] = { 1, 2, 3 };
+        out.add_value("x", x, sizeof(x));
+        double const y[2] = { 1.0, 2.0 };
+        out.add_value("y", y, sizeof(y));
+        out.end_subfield();
+
+        std::vector<point> result;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                return in.read_columns(
+                          result
+                        , brs::column("x", &point::f_x)
+                        , brs::column("y", &point::f_y));
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: column \"y\" has 2 values, expected 3."));
+    }
+
+    CATCH_SECTION("truncated columns")
+    {
+        std::vector<point> points(20);
+        for(std::size_t idx(0); idx < points.size(); ++idx)
+        {
+            points[idx].f_x = static_cast<std::int32_t>(idx + 1);
+        }
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_columns(
+                  "points"
+                , points
+                , brs::column("x", &point::f_x)
+                , brs::column("y", &point::f_y));
+
+        // cut the buffer in the middle of the "y" column
+        //
+        std::string data(buffer.str());
+        data.resize(data.length() - 4 - 50);
+
+        std::vector<point> result;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                return in.read_columns(
+                          result
+                        , brs::column("x", &point::f_x)
+                        , brs::column("y", &point::f_y));
+            });
+
+        std::stringstream truncated(data);
+        brs::deserializer in(truncated);
+        CATCH_REQUIRE_FALSE(in.deserialize(func));
+
+        std::stringstream again(data);
+        in.reset(again);
+        brs::result_t const result_code(in.try_deserialize(func));
+        CATCH_REQUIRE(result_code.f_error == brs::ERROR_TRUNCATED);
+
+        // the "x" column was read, the "y" values were not fabricated
+        //
+        CATCH_REQUIRE(result.size() == points.size());
+        for(std::size_t idx(0); idx < points.size(); ++idx)
+        {
+            CATCH_REQUIRE(result[idx].f_x == points[idx].f_x);
+            CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(result[idx].f_y, 0.0, 0.0));
+        }
+    }
+}
+
+
+CATCH_TEST_CASE("reset", "[reset]")
+{
+    CATCH_SECTION("reuse one serializer and one deserializer")
+    {
+        std::stringstream first;
+        brs::serializer out(first);
+        brs::deserializer in(first);
+
+        for(int idx(0); idx < 10; ++idx)
+        {
+            std::stringstream buffer;
+            out.reset(buffer);
+            out.add_value("count", idx);
+            out.add_value("name", "message #" + std::to_string(idx));
+
+            int count(-1);
+            std::string name;
+            brs::deserializer<std::stringstream>::process_hunk_t func(
+                [&count, &name](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+                {
+                    if(field.f_name == "count")
+                    {
+                        d.read_data(count);
+                    }
+                    else
+                    {
+                        d.read_data(name);
+                    }
+                    return true;
+                });
+
+            in.reset(buffer);
+            bool const r(in.deserialize(func));
+            CATCH_REQUIRE(r);
+            CATCH_REQUIRE(count == idx);
+            CATCH_REQUIRE(name == "message #" + std::to_string(idx));
+        }
+    }
+
+    CATCH_SECTION("limits apply per buffer")
+    {
+        std::stringstream first;
+        brs::deserializer<std::stringstream> in(first, false);
+        brs::limits_t limits;
+        limits.f_max_hunks = 2;
+        in.set_limits(limits);
+
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                std::uint8_t value(0);
+                return d.read_data(value);
+            });
+
+        for(int idx(0); idx < 5; ++idx)
+        {
+            std::stringstream buffer;
+            brs::serializer out(buffer);
+            out.add_value("a", static_cast<std::uint8_t>(1));
+            out.add_value("b", static_cast<std::uint8_t>(2));
+
+            in.reset(buffer);
+            bool const r(in.deserialize(func));
+            CATCH_REQUIRE(r);
+            CATCH_REQUIRE(in.get_limits().f_max_hunks == 2);
+        }
+    }
+
+    CATCH_SECTION("reset verifies the magic")
+    {
+        std::stringstream first;
+        brs::deserializer<std::stringstream> in(first, false);
+
+        std::stringstream empty;
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.reset(empty)
+                , brs::brs_magic_missing
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_missing: magic missing from the start of the buffer."));
+
+        std::stringstream bad("BRX\1");
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.reset(bad)
+                , brs::brs_magic_unsupported
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_unsupported: magic unsupported."));
+    }
+}
+
+
+CATCH_TEST_CASE("size_counter", "[size]")
+{
+    auto serialize = [](auto & out)
+        {
+            out.add_value("count", static_cast<std::uint32_t>(33));
+            out.add_value("name", std::string("size counter"));
+            out.add_value("empty", std::string());
+            out.add_value("sizes", 5, static_cast<std::uint16_t>(1024));
+            out.add_value("colors", "red", std::string("#ff0000"));
+            std::vector<std::int64_t> const list{ 1, -2, 3, -4 };
+            out.add_value("list", list);
+            out.start_subfield("sub");
+            out.add_value("depth", 1.5);
+            out.end_subfield();
+        };
+
+    CATCH_SECTION("size_counter matches the real output")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        serialize(out);
+
+        brs::size_counter counter;
+        brs::serializer<brs::size_counter> measure(counter);
+        serialize(measure);
+
+        CATCH_REQUIRE(counter.size() == buffer.str().length());
+
+        counter.reset();
+        CATCH_REQUIRE(counter.size() == 0);
+    }
+
+    CATCH_SECTION("measure() with and without magic")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        serialize(out);
+
+        std::size_t const size(brs::measure(serialize));
+        CATCH_REQUIRE(size == buffer.str().length());
+        CATCH_REQUIRE(brs::measure(serialize, false) == size - sizeof(brs::magic_t));
+    }
+}
+
+
+CATCH_TEST_CASE("map", "[map]")
+{
+    CATCH_SECTION("string keys and string values")
+    {
+        std::map<std::string, std::string> const colors{
+            { "red", "#ff0000" },
+            { "green", "#00ff00" },
+            { "blue", "#0000ff" },
+            { std::string(300, 'k'), "keys can be longer than 255 characters" },
+            { "empty", std::string() },
+        };
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_map("colors", colors);
+        out.add_value("after", 7);
+
+        std::map<std::string, std::string> result;
+        int after(0);
+        int calls(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result, &after, &calls](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                ++calls;
+                if(field.f_name == "colors")
+                {
+                    CATCH_REQUIRE(in.read_map(result));
+                }
+                else
+                {
+                    in.read_data(after);
+                }
+                return true;
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        bool const r(in.deserialize(func));
+        CATCH_REQUIRE(r);
+        CATCH_REQUIRE(calls == 2);
+        CATCH_REQUIRE(result == colors);
+        CATCH_REQUIRE(after == 7);
+    }
+
+    CATCH_SECTION("large unordered map with fixed size values")
+    {
+        std::unordered_map<std::string, std::int32_t> config;
+        for(std::int32_t idx(0); idx < 100'000; ++idx)
+        {
+            config["key" + std::to_string(idx)] = idx * 3;
+        }
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_map("config", config);
+
+        std::unordered_map<std::string, std::int32_t> result;
+        int calls(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result, &calls](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                ++calls;
+                CATCH_REQUIRE(field.f_name == "config");
+                return in.read_map(result);
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        in.deserialize(func);
+        CATCH_REQUIRE(calls == 1);
+        CATCH_REQUIRE(result == config);
+    }
+
+    CATCH_SECTION("fixed size keys and empty map")
+    {
+        std::map<std::int64_t, double> const values{
+            { -5, 1.25 },
+            { 0, 0.0 },
+            { 1'000'000'000'000, -3.5 },
+        };
+        std::map<std::int64_t, double> const empty;
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_map("values", values);
+        out.add_map("empty", empty);
+
+        std::map<std::int64_t, double> result;
+        std::map<std::int64_t, double> result_empty{ { 1, 1.0 } };
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result, &result_empty](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                if(field.f_name == "values")
+                {
+                    return in.read_map(result);
+                }
+                result_empty.clear();
+                return in.read_map(result_empty);
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        in.deserialize(func);
+        CATCH_REQUIRE(result == values);
+        CATCH_REQUIRE(result_empty.empty());
+    }
+
+    CATCH_SECTION("read a map with the wrong types")
+    {
+        std::map<std::string, std::string> const names{
+            { "a", "alpha" },
+        };
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_map("names", names);
+
+        std::map<std::int64_t, std::int64_t> result;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                return in.read_map(result);
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: map data is truncated."));
+    }
+}
+
+
+CATCH_TEST_CASE("array", "[array]")
+{
+    CATCH_SECTION("sparse array with 32 bit indexes")
+    {
+        std::map<int, std::int32_t> const sparse{
+            { 0, 100 },
+            { 65'535, 200 },
+            { 65'536, 300 },
+            { 1'000'000, 400 },
+            { std::numeric_limits<int>::max(), 500 },
+        };
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        for(auto const & item : sparse)
+        {
+            out.add_value("sparse", item.first, item.second);
+        }
+
+        // 16 bit indexes use the original, smaller, hunk
+        //
+        CATCH_REQUIRE(buffer.str().length()
+                == sizeof(brs::magic_t)
+                 + (sizeof(brs::hunk_sizes_t) + 6 + sizeof(std::int32_t)) * 5
+                 + sizeof(std::uint16_t) * 2
+                 + (sizeof(brs::extension_t) + sizeof(std::uint32_t)) * 3);
+
+        std::map<int, std::int32_t> result;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                CATCH_REQUIRE(field.f_name == "sparse");
+                CATCH_REQUIRE(field.f_count == 1);
+                std::int32_t value(0);
+                in.read_data(value);
+                result[field.f_index] = value;
+                return true;
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        in.deserialize(func);
+        CATCH_REQUIRE(result == sparse);
+    }
+
+    CATCH_SECTION("dense array saved as a run")
+    {
+        std::vector<std::uint32_t> values(100'000);
+        for(std::size_t idx(0); idx < values.size(); ++idx)
+        {
+            values[idx] = static_cast<std::uint32_t>(idx * idx);
+        }
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_array("dense", values, 70'000);
+
+        CATCH_REQUIRE(buffer.str().length()
+                == sizeof(brs::magic_t)
+                 + sizeof(brs::hunk_sizes_t)
+                 + sizeof(brs::extension_t)
+                 + sizeof(std::uint32_t) * 2
+                 + 5
+                 + values.size() * sizeof(std::uint32_t));
+
+        std::vector<std::uint32_t> result;
+        int calls(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&result, &calls](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                ++calls;
+                CATCH_REQUIRE(field.f_name == "dense");
+                CATCH_REQUIRE(field.f_index == 70'000);
+                CATCH_REQUIRE(field.f_count == 100'000);
+                in.read_data(result);
+                return true;
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        in.deserialize(func);
+        CATCH_REQUIRE(calls == 1);
+        CATCH_REQUIRE(result == values);
+    }
+
+    CATCH_SECTION("large array split in multiple runs")
+    {
+        struct block
+        {
+            char        f_data[1024 * 1024];
+        };
+        std::vector<block> blocks(17);
+        for(std::size_t idx(0); idx < blocks.size(); ++idx)
+        {
+            memset(blocks[idx].f_data, static_cast<int>(idx + 1), sizeof(blocks[idx].f_data));
+        }
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_array("blocks", blocks);
+
+        std::vector<std::pair<int, std::size_t>> runs;
+        std::vector<block> result(blocks.size());
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&runs, &result](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+            {
+                runs.emplace_back(field.f_index, field.f_count);
+                std::vector<block> items;
+                in.read_data(items);
+                CATCH_REQUIRE(items.size() == field.f_count);
+                std::copy(items.begin(), items.end(), result.begin() + field.f_index);
+                return true;
+            });
+
+        buffer.clear();
+        brs::deserializer in(buffer);
+        in.deserialize(func);
+        CATCH_REQUIRE(runs.size() == 3);
+        CATCH_REQUIRE(runs[0] == std::make_pair(0, std::size_t(7)));
+        CATCH_REQUIRE(runs[1] == std::make_pair(7, std::size_t(7)));
+        CATCH_REQUIRE(runs[2] == std::make_pair(14, std::size_t(3)));
+        for(std::size_t idx(0); idx < blocks.size(); ++idx)
+        {
+            CATCH_REQUIRE(memcmp(blocks[idx].f_data, result[idx].f_data, sizeof(block)) == 0);
+        }
+    }
+
+    CATCH_SECTION("invalid arrays")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  out.add_value("negative", -1, 5)
+                , brs::brs_out_of_range
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_out_of_range: name, index, or hunk too large"));
+
+        std::vector<int> const values{ 1, 2, 3 };
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  out.add_array("overflow", values, std::numeric_limits<int>::max() - 1)
+                , brs::brs_out_of_range
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_out_of_range: index or item too large"));
+
+        struct huge
+        {
+            char        f_data[8 * 1024 * 1024];
+        };
+        huge const * none(nullptr);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  out.add_array("huge", none, 1)
+                , brs::brs_out_of_range
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_out_of_range: index or item too large"));
+    }
+}
+
+
+CATCH_TEST_CASE("skip_field", "[skip]")
+{
+    CATCH_SECTION("skip fields and sub-fields")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("before", std::string("skipped"));
+        out.start_subfield("sub");
+        {
+            out.add_value("value", 123);
+            out.start_subfield("deeper");
+            {
+                out.add_value("value", 456);
+            }
+            out.end_subfield();
+        }
+        out.end_subfield();
+        out.add_value("after", 789);
+
+        brs::deserializer in(buffer);
+        std::vector<std::size_t> header_sizes;
+        int after(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&header_sizes, &after](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                header_sizes.push_back(field.f_header_size);
+                if(field.f_name == "after")
+                {
+                    d.read_data(after);
+                    return true;
+                }
+                return d.skip_field();
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(after == 789);
+        CATCH_REQUIRE(header_sizes == std::vector<std::size_t>({ 4, 5, 4 }));
+    }
+}
+
+
+CATCH_TEST_CASE("field_names", "[field]")
+{
+    CATCH_SECTION("fixed strings")
+    {
+        brs::field_name_t name;
+        CATCH_REQUIRE(name.empty());
+        CATCH_REQUIRE(name.c_str()[0] == '\0');
+        CATCH_REQUIRE(brs::field_name_t::capacity() == 127);
+        CATCH_REQUIRE(brs::field_sub_name_t::capacity() == 255);
+
+        name = brs::field_name_t("color");
+        CATCH_REQUIRE(name.length() == 5);
+        CATCH_REQUIRE(name == "color");
+        CATCH_REQUIRE("color" == name);
+        CATCH_REQUIRE(name == std::string("color"));
+        CATCH_REQUIRE(name != "colors");
+        CATCH_REQUIRE(std::string_view(name) == "color");
+        CATCH_REQUIRE(std::string(name) == "color");
+        CATCH_REQUIRE("my " + name == "my color");
+        CATCH_REQUIRE(name + "s" == "colors");
+        CATCH_REQUIRE(name < brs::field_name_t("colors"));
+
+        std::stringstream ss;
+        ss << name;
+        CATCH_REQUIRE(ss.str() == "color");
+
+        name.clear();
+        CATCH_REQUIRE(name.empty());
+        CATCH_REQUIRE(name == "");
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  name.resize(128)
+                , brs::brs_out_of_range
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_out_of_range: string too large"));
+    }
+
+    CATCH_SECTION("longest names")
+    {
+        std::string const name(brs::MAX_NAME_LENGTH, 'n');
+        std::string const sub_name(brs::MAX_SUB_NAME_LENGTH, 's');
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value(name, 1);
+        out.add_value(name, sub_name, std::string("value"));
+
+        brs::deserializer in(buffer);
+        std::vector<std::string> names;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&names](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                names.push_back(field.f_name);
+                names.push_back(field.f_sub_name);
+                return d.skip_field();
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(names == std::vector<std::string>({ name, std::string(), name, sub_name }));
+    }
+}
+
+
+CATCH_TEST_CASE("error_codes", "[error]")
+{
+    CATCH_SECTION("serializer errors")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.set_exceptions(false);
+        CATCH_REQUIRE(out.get_result());
+
+        out.add_value("a", 1);
+        std::size_t const size(buffer.str().length());
+        out.add_value("", 2);
+        out.add_value(std::string(200, 'n'), 3);
+        out.add_value("b", 4);
+
+        brs::result_t const result(out.get_result());
+        CATCH_REQUIRE_FALSE(result);
+        CATCH_REQUIRE(result.f_error == brs::ERROR_EMPTY_NAME);
+        CATCH_REQUIRE(result.f_offset == size);
+        CATCH_REQUIRE(std::string(brs::error_name(result.f_error)) == "empty name");
+
+        out.clear_result();
+        CATCH_REQUIRE(out.get_result());
+
+        brs::deserializer in(buffer);
+        std::vector<std::string> names;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&names](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                names.push_back(field.f_name);
+                int value(0);
+                return d.read_data(value);
+            });
+        CATCH_REQUIRE(in.try_deserialize(func));
+        CATCH_REQUIRE(names == std::vector<std::string>({ "a", "b" }));
+    }
+
+    CATCH_SECTION("truncated buffer")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("first", 1);
+        std::size_t const offset(buffer.str().length());
+        out.add_value("second", std::string("value"));
+        std::string const data(buffer.str());
+
+        std::stringstream truncated(data.substr(0, data.length() - 2));
+        brs::deserializer in(truncated);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "first")
+                {
+                    int value(0);
+                    return d.read_data(value);
+                }
+                std::string value;
+                return d.read_data(value);
+            });
+        brs::result_t const result(in.try_deserialize(func));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_TRUNCATED);
+        CATCH_REQUIRE(result.f_offset == offset);
+    }
+
+    CATCH_SECTION("invalid hunks")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("ok", 1);
+        std::size_t const offset(buffer.str().length());
+        brs::hunk_sizes_t const hunk_sizes{ brs::TYPE_EXTENDED, 1, 0 };
+        brs::extension_t const extension(99);
+        buffer.write(reinterpret_cast<char const *>(&hunk_sizes), sizeof(hunk_sizes));
+        buffer.write(reinterpret_cast<char const *>(&extension), sizeof(extension));
+        buffer.write("x", 1);
+        std::string const data(buffer.str());
+
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                return d.skip_field();
+            });
+
+        std::stringstream input(data);
+        brs::deserializer in(input);
+        brs::result_t const result(in.try_deserialize(func));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_UNKNOWN_TYPE);
+        CATCH_REQUIRE(result.f_offset == offset);
+
+        // the same buffer throws with deserialize()
+        //
+        std::stringstream again(data);
+        in.reset(again);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_unknown_type
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_unknown_type: read a field with an unknown extension."));
+    }
+
+    CATCH_SECTION("limits and data errors")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("small", std::string(100, 's'));
+        std::size_t const offset(buffer.str().length());
+        out.add_value("large", std::string(101, 'l'));
+        std::string const data(buffer.str());
+
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                std::string value;
+                return d.read_data(value);
+            });
+
+        std::stringstream input(data);
+        brs::deserializer in(input);
+        brs::limits_t limits;
+        limits.f_max_field_size = 100;
+        in.set_limits(limits);
+        brs::result_t result(in.try_deserialize(func));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_LIMIT_EXCEEDED);
+        CATCH_REQUIRE(result.f_offset == offset);
+
+        brs::deserializer<std::stringstream>::process_hunk_t wrong_type(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                std::int64_t value(0);
+                return d.read_data(value);
+            });
+        std::stringstream second(data);
+        in.reset(second);
+        in.set_limits(brs::limits_t());
+        result = in.try_deserialize(wrong_type);
+        CATCH_REQUIRE(result.f_error == brs::ERROR_INVALID_DATA);
+        CATCH_REQUIRE(result.f_offset == sizeof(brs::magic_t));
+    }
+
+    CATCH_SECTION("callback stops the deserialization")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("one", 1);
+        std::size_t const offset(buffer.str().length());
+        out.add_value("stop", 2);
+        out.add_value("three", 3);
+
+        brs::deserializer in(buffer);
+        std::vector<std::string> names;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&names](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                names.push_back(field.f_name);
+                int value(0);
+                return d.read_data(value) && field.f_name != "stop";
+            });
+        brs::result_t const result(in.try_deserialize(func));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_CALLBACK);
+        CATCH_REQUIRE(result.f_offset == offset);
+        CATCH_REQUIRE(names == std::vector<std::string>({ "one", "stop" }));
+    }
+
+    CATCH_SECTION("invalid magic")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("value", 1);
+
+        brs::deserializer in(buffer);
+
+        std::stringstream empty;
+        brs::result_t result(in.try_reset(empty));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_MAGIC_MISSING);
+        CATCH_REQUIRE(result.f_offset == 0);
+
+        std::stringstream bad("XYZ!");
+        result = in.try_reset(bad);
+        CATCH_REQUIRE(result.f_error == brs::ERROR_MAGIC_UNSUPPORTED);
+
+        std::stringstream bad_again("XYZ!");
+        CATCH_REQUIRE_THROWS_AS(in.reset(bad_again), brs::brs_magic_unsupported);
+    }
+}
+
+
+
+CATCH_TEST_CASE("fragments", "[fragments]")
+{
+    CATCH_SECTION("save a value from fragments")
+    {
+        std::string const parts[] = { "fragmented ", "", "values are ", "saved in one hunk" };
+        std::vector<iovec> fragments;
+        std::string whole;
+        for(auto const & p : parts)
+        {
+            fragments.push_back(iovec{ const_cast<char *>(p.data()), p.length() });
+            whole += p;
+        }
+
+        std::stringstream expected;
+        {
+            brs::serializer out(expected);
+            out.add_value("text", whole);
+            out.add_value("after", 33);
+        }
+
+        std::stringstream copied;
+        {
+            brs::serializer out(copied);
+            out.add_value("text", fragments);
+            out.add_value("after", 33);
+        }
+        CATCH_REQUIRE(copied.str() == expected.str());
+        CATCH_REQUIRE_FALSE(brs::has_writev<std::stringstream>::value);
+
+        gather_stream gathered;
+        {
+            brs::serializer out(gathered);
+            out.add_value("text", fragments.data(), fragments.size());
+            out.add_value("after", 33);
+        }
+        CATCH_REQUIRE(brs::has_writev<gather_stream>::value);
+        CATCH_REQUIRE(gathered.f_writev_calls == 1);
+        CATCH_REQUIRE(gathered.str() == expected.str());
+
+        brs::deserializer in(gathered);
+        std::string text;
+        int after(0);
+        brs::deserializer<gather_stream>::process_hunk_t func(
+            [&text, &after](brs::deserializer<gather_stream> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "text")
+                {
+                    return d.read_data(text);
+                }
+                return d.read_data(after);
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(text == whole);
+        CATCH_REQUIRE(after == 33);
+    }
+
+    CATCH_SECTION("invalid fragments")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+
+        std::vector<iovec> const fragments{ iovec{ nullptr, 0x00800000 } };
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  out.add_value("large", fragments)
+                , brs::brs_out_of_range
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_out_of_range: name or hunk too large"));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  out.add_value("", fragments)
+                , brs::brs_cannot_be_empty
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_cannot_be_empty: name cannot be an empty string"));
+    }
+}
+
+
+
+CATCH_TEST_CASE("read_into", "[read]")
+{
+    CATCH_SECTION("read in caller buffers")
+    {
+        std::string const large(10000, 'L');
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("small", std::string("small value"));
+        out.add_value("large", large);
+        out.add_value("owned", std::string("owned value"));
+        out.add_value("skipped", large);
+        out.add_value("last", 55);
+
+        brs::deserializer in(buffer);
+        char small[32];
+        std::size_t small_size(0);
+        std::string streamed;
+        std::unique_ptr<char[]> owned;
+        std::size_t owned_size(0);
+        int last(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "small")
+                {
+                    small_size = field.f_size;
+                    return d.read_into(small, sizeof(small));
+                }
+                if(field.f_name == "large")
+                {
+                    while(d.remaining_data() > 0)
+                    {
+                        char chunk[1024];
+                        std::size_t size(sizeof(chunk));
+                        if(!d.read_partial(chunk, size))
+                        {
+                            return false;
+                        }
+                        CATCH_REQUIRE(size > 0);
+                        streamed.append(chunk, size);
+                    }
+                    return true;
+                }
+                if(field.f_name == "owned")
+                {
+                    owned_size = field.f_size;
+                    return d.take_data(owned);
+                }
+                if(field.f_name == "skipped")
+                {
+                    char chunk[100];
+                    std::size_t size(sizeof(chunk));
+                    CATCH_REQUIRE(d.read_partial(chunk, size));
+                    CATCH_REQUIRE(size == sizeof(chunk));
+                    CATCH_REQUIRE(d.remaining_data() == large.length() - sizeof(chunk));
+                    return d.skip_field();
+                }
+                return d.read_data(last);
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(std::string(small, small_size) == "small value");
+        CATCH_REQUIRE(streamed == large);
+        CATCH_REQUIRE(std::string(owned.get(), owned_size) == "owned value");
+        CATCH_REQUIRE(last == 55);
+    }
+
+    CATCH_SECTION("buffer too small")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("value", std::string("does not fit"));
+
+        brs::deserializer in(buffer);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                char small[4];
+                return d.read_into(small, sizeof(small));
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: hunk size is 12, but the buffer only has 4 bytes."));
+
+        std::stringstream again(buffer.str());
+        in.reset(again);
+        brs::result_t const result(in.try_deserialize(func));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_INVALID_DATA);
+    }
+
+    CATCH_SECTION("read_partial() then read_data()")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("text", std::string("partially read"));
+        out.add_value("after", 33);
+        std::string const data(buffer.str());
+
+        std::string text;
+        int after(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&text, &after](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "text")
+                {
+                    char chunk[4];
+                    std::size_t size(sizeof(chunk));
+                    CATCH_REQUIRE(d.read_partial(chunk, size));
+                    return d.read_data(text);
+                }
+                return d.read_data(after);
+            });
+
+        std::stringstream input(data);
+        brs::deserializer in(input);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: the data of this hunk was already read."));
+        CATCH_REQUIRE(text.empty());
+
+        std::stringstream again(data);
+        in.reset(again);
+        brs::result_t const result(in.try_deserialize(func));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_INVALID_DATA);
+        CATCH_REQUIRE(text.empty());
+    }
+
+    CATCH_SECTION("read_data() then skip_field()")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("text", std::string("read once"));
+        out.add_value("after", 33);
+
+        brs::deserializer in(buffer);
+        std::string text;
+        int after(0);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&text, &after](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "text")
+                {
+                    CATCH_REQUIRE(d.read_data(text));
+                    CATCH_REQUIRE(d.remaining_data() == 0);
+                    return d.skip_field();
+                }
+                return d.read_data(after);
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(text == "read once");
+        CATCH_REQUIRE(after == 33);
+    }
+}
+
+
+
+CATCH_TEST_CASE("vectors", "[vector]")
+{
+    struct sample
+    {
+        std::uint16_t   f_id = 0;
+        double          f_value = 0.0;
+        char            f_tag[3] = {};
+    };
+
+    CATCH_SECTION("vector of structures in one hunk")
+    {
+        std::vector<sample> samples(rand() % 200 + 50);
+        for(auto & s : samples)
+        {
+            s.f_id = rand();
+            s.f_value = rand() / 7.0;
+            s.f_tag[0] = 'a' + rand() % 26;
+        }
+        std::vector<std::int64_t> const list{ 1, -2, 3, -4 };
+        std::vector<double> const empty;
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("samples", samples);
+        out.add_value("list", list);
+        out.add_value("empty", empty);
+
+        // magic + one hunk per vector, the data includes all the items
+        //
+        std::string const data(buffer.str());
+        CATCH_REQUIRE(data.length() == sizeof(brs::magic_t)
+                                     + (4 + 7 + samples.size() * sizeof(sample))
+                                     + (4 + 4 + list.size() * sizeof(std::int64_t))
+                                     + (4 + 5));
+
+        brs::deserializer in(buffer);
+        std::vector<sample> samples_result;
+        std::vector<std::int64_t> list_result;
+        std::vector<double> empty_result{ 1.0 };
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "samples")
+                {
+                    CATCH_REQUIRE(field.f_size == samples.size() * sizeof(sample));
+                    return d.read_data(samples_result);
+                }
+                if(field.f_name == "list")
+                {
+                    return d.read_data(list_result);
+                }
+                return d.read_data(empty_result);
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+
+        CATCH_REQUIRE(samples_result.size() == samples.size());
+        for(std::size_t idx(0); idx < samples.size(); ++idx)
+        {
+            CATCH_REQUIRE(samples_result[idx].f_id == samples[idx].f_id);
+            CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(samples_result[idx].f_value, samples[idx].f_value, 0.0));
+            CATCH_REQUIRE(samples_result[idx].f_tag[0] == samples[idx].f_tag[0]);
+        }
+        CATCH_REQUIRE(list_result == list);
+        CATCH_REQUIRE(empty_result.empty());
+    }
+
+    CATCH_SECTION("size is not a multiple of the item size")
+    {
+        std::vector<std::uint8_t> const bytes{ 1, 2, 3, 4, 5 };
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("bytes", bytes);
+
+        brs::deserializer in(buffer);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                std::vector<std::uint32_t> words;
+                return d.read_data(words);
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: hunk size (5) is not a multiple of the vector item size: 4."));
+    }
+}
+
+
+
+CATCH_TEST_CASE("batch", "[batch]")
+{
+    CATCH_SECTION("flat message delivered in batches")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        for(int idx(0); idx < 1000; ++idx)
+        {
+            out.add_value("value", idx, static_cast<std::uint32_t>(idx * 3));
+        }
+        out.add_value("map", "key", std::string("map value"));
+        std::string const large(brs::BATCH_DATA_SIZE + 100, 'L');
+        out.add_value("large", large);
+        out.add_value("last", 55);
+
+        brs::deserializer in(buffer);
+        std::vector<std::size_t> sizes;
+        std::uint64_t sum(0);
+        int count(0);
+        std::string map_value;
+        std::string large_value;
+        int last(0);
+        brs::deserializer<std::stringstream>::process_batch_t func(
+            [&](brs::deserializer<std::stringstream> & d
+              , brs::field_record_t const * records
+              , std::size_t size)
+            {
+                snapdev::NOT_USED(d);
+                sizes.push_back(size);
+                for(std::size_t idx(0); idx < size; ++idx)
+                {
+                    brs::field_record_t const & r(records[idx]);
+                    CATCH_REQUIRE_FALSE(r.f_subfield);
+                    if(r.f_name == "value")
+                    {
+                        std::uint32_t v(0);
+                        CATCH_REQUIRE(r.f_size == sizeof(v));
+                        memcpy(&v, r.f_data, sizeof(v));
+                        CATCH_REQUIRE(v == static_cast<std::uint32_t>(r.f_index * 3));
+                        CATCH_REQUIRE(r.f_index == count);
+                        sum += v;
+                        ++count;
+                    }
+                    else if(r.f_name == "map")
+                    {
+                        CATCH_REQUIRE(r.f_sub_name == "key");
+                        map_value = std::string(r.f_data, r.f_size);
+                    }
+                    else if(r.f_name == "large")
+                    {
+                        large_value = std::string(r.f_data, r.f_size);
+                    }
+                    else
+                    {
+                        CATCH_REQUIRE(r.f_name == "last");
+                        memcpy(&last, r.f_data, sizeof(last));
+                    }
+                }
+                return true;
+            });
+        CATCH_REQUIRE(in.deserialize_batch(func, 300));
+
+        // 1000 values + map, then large does not fit, then last
+        //
+        CATCH_REQUIRE(sizes == std::vector<std::size_t>({ 300, 300, 300, 101, 1, 1 }));
+        CATCH_REQUIRE(count == 1000);
+        CATCH_REQUIRE(sum == 3 * 999 * 1000 / 2);
+        CATCH_REQUIRE(map_value == "map value");
+        CATCH_REQUIRE(large_value == large);
+        CATCH_REQUIRE(last == 55);
+    }
+
+    CATCH_SECTION("sub-fields end the batch")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("a", 1);
+        out.add_value("b", 2);
+        out.start_subfield("sub");
+        out.add_value("c", 3);
+        out.add_value("d", 4);
+        out.end_subfield();
+        out.start_subfield("skipped");
+        out.add_value("e", 5);
+        out.end_subfield();
+        out.add_value("f", 6);
+
+        brs::deserializer in(buffer);
+        std::vector<std::string> batches;
+        brs::deserializer<std::stringstream>::process_batch_t func(
+            [&](brs::deserializer<std::stringstream> & d
+              , brs::field_record_t const * records
+              , std::size_t size)
+            {
+                std::string names;
+                for(std::size_t idx(0); idx < size; ++idx)
+                {
+                    names += records[idx].f_name;
+                    if(records[idx].f_subfield)
+                    {
+                        CATCH_REQUIRE(idx == size - 1);
+                        CATCH_REQUIRE(records[idx].f_size == 0);
+                    }
+                }
+                batches.push_back(names);
+                if(records[size - 1].f_subfield)
+                {
+                    if(records[size - 1].f_name == "skipped")
+                    {
+                        return d.skip_field();
+                    }
+                    return d.deserialize_batch(func);
+                }
+                return true;
+            });
+        CATCH_REQUIRE(in.deserialize_batch(func));
+        CATCH_REQUIRE(batches == std::vector<std::string>({ "ab", "sub", "cd", "skipped", "f" }));
+    }
+
+    CATCH_SECTION("buffers are reused")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("a", 1);
+        out.start_subfield("sub");
+        out.add_value("b", 2);
+        out.end_subfield();
+        std::string const data(buffer.str());
+
+        std::vector<char const *> pointers;
+        brs::deserializer<std::stringstream>::process_batch_t func(
+            [&](brs::deserializer<std::stringstream> & d
+              , brs::field_record_t const * records
+              , std::size_t size)
+            {
+                pointers.push_back(records[0].f_name.data());
+                if(records[size - 1].f_subfield)
+                {
+                    return d.deserialize_batch(func);
+                }
+                return true;
+            });
+
+        std::stringstream first(data);
+        brs::deserializer in(first);
+        CATCH_REQUIRE(in.deserialize_batch(func));
+        CATCH_REQUIRE(pointers.size() == 3);          // "a", "sub", and "b"
+        CATCH_REQUIRE(pointers[1] == pointers[0]);
+        CATCH_REQUIRE(pointers[2] != pointers[0]);    // nested batch has its own buffer
+
+        std::stringstream second(data);
+        in.reset(second);
+        CATCH_REQUIRE(in.deserialize_batch(func));
+        CATCH_REQUIRE(pointers.size() == 6);
+        CATCH_REQUIRE(pointers[3] == pointers[0]);
+        CATCH_REQUIRE(pointers[4] == pointers[1]);
+        CATCH_REQUIRE(pointers[5] == pointers[2]);
+    }
+
+    CATCH_SECTION("errors without exceptions")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("a", 1);
+        out.add_value("b", 2);
+
+        std::string const data(buffer.str());
+        brs::deserializer<std::stringstream>::process_batch_t func(
+            [](brs::deserializer<std::stringstream> & d
+              , brs::field_record_t const * records
+              , std::size_t size)
+            {
+                snapdev::NOT_USED(d, records, size);
+                return false;
+            });
+
+        std::stringstream stop(data);
+        brs::deserializer in(stop);
+        brs::result_t result(in.try_deserialize_batch(func));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_CALLBACK);
+
+        std::stringstream truncated(data.substr(0, data.length() - 1));
+        in.reset(truncated);
+        result = in.try_deserialize_batch(func);
+        CATCH_REQUIRE(result.f_error == brs::ERROR_TRUNCATED);
+        CATCH_REQUIRE(result.f_offset == sizeof(brs::magic_t) + 4 + 1 + sizeof(int));
+    }
+}
+
+
 // vim: ts=4 sw=4 et
@@ -0,0 +1,398 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the dictionary compression.
+ *
+ * This file implements tests to verify that small messages compressed
+ * with a trained dictionary can be decompressed and are smaller.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#include    <brs/compress.h>
+#include    <brs/patch.h>
+
+
+// C++
+//
+#include    <sstream>
+
+
+
+namespace
+{
+
+
+
+std::string message(std::uint32_t id)
+{
+    char const * const colors[] = { "red", "green", "blue", "yellow" };
+
+    std::stringstream buffer;
+    brs::serializer out(buffer);
+    out.add_value("id", id);
+    out.add_value("event", std::string(id % 3 == 0 ? "connection" : "disconnection"));
+    out.add_value("color", std::string(colors[id % 4]));
+    out.start_subfield("client");
+    {
+        out.add_value("address", "192.168.1." + std::to_string(id % 250));
+        out.add_value("port", static_cast<std::uint16_t>(40000 + id % 100));
+        out.add_value("agent", std::string("Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)"));
+    }
+    out.end_subfield();
+    out.add_value("status", std::string("the connection was accepted by the server"));
+    return buffer.str();
+}
+
+
+brs::dictionary::pointer_t sample_dictionary()
+{
+    std::vector<std::string> samples;
+    for(std::uint32_t id(0); id < 1000; ++id)
+    {
+        samples.push_back(message(id * 7 + 3));
+    }
+    return std::make_shared<brs::dictionary>(brs::dictionary::train(samples, 4096));
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("compress", "[compress]")
+{
+    CATCH_SECTION("compress and decompress small messages")
+    {
+        brs::dictionary::pointer_t dict(sample_dictionary());
+        CATCH_REQUIRE(dict->id() != 0);
+        CATCH_REQUIRE(dict->data().length() <= 4096);
+
+        brs::compressor c(dict);
+        brs::decompressor d;
+        d.add_dictionary(dict);
+
+        std::size_t original_size(0);
+        std::size_t compressed_size(0);
+        for(std::uint32_t id(5000); id < 5100; ++id)
+        {
+            std::string const m(message(id));
+            std::string const compressed(c.compress(m));
+            CATCH_REQUIRE(d.decompress(compressed) == m);
+
+            original_size += m.length();
+            compressed_size += compressed.length();
+        }
+
+        // the dictionary includes most of the names and values
+        //
+        CATCH_REQUIRE(compressed_size * 3 < original_size);
+    }
+
+    CATCH_SECTION("invalid compressed buffers")
+    {
+        brs::dictionary::pointer_t dict(sample_dictionary());
+        brs::compressor c(dict);
+        std::string const compressed(c.compress(message(1)));
+
+        brs::decompressor d(100);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  d.decompress(compressed)
+                , brs::brs_compression_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_compression_error: unknown dictionary "
+                        + std::to_string(dict->id())
+                        + "."));
+
+        d.add_dictionary(dict);
+        CATCH_REQUIRE_THROWS_AS(d.decompress(compressed), brs::brs_compression_error);
+
+        brs::decompressor large;
+        large.add_dictionary(dict);
+        CATCH_REQUIRE_THROWS_AS(large.decompress(compressed.substr(0, compressed.length() - 1)), brs::brs_compression_error);
+        CATCH_REQUIRE_THROWS_AS(large.decompress(compressed.substr(0, 5)), brs::brs_magic_missing);
+        CATCH_REQUIRE_THROWS_AS(large.decompress(message(1)), brs::brs_magic_unsupported);
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::dictionary("not a trained dictionary")
+                , brs::brs_compression_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_compression_error: the dictionary data is not a trained dictionary."));
+    }
+}
+
+
+
+CATCH_TEST_CASE("compressed_hunks", "[compress]")
+{
+    CATCH_SECTION("large fields get compressed")
+    {
+        std::string text;
+        for(int idx(0); idx < 500; ++idx)
+        {
+            text += "line #" + std::to_string(idx) + " of a large text field\n";
+        }
+        std::string random(2000, '\0');
+        std::uint32_t seed(1);
+        for(auto & c : random)
+        {
+            seed = seed * 1103515245 + 12345;
+            c = static_cast<char>(seed >> 16);
+        }
+
+        brs::zstd_codec codec;
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.set_compression(&codec, 256);
+        out.add_value("small", std::string(100, 's'));
+        out.add_value("text", text);
+        out.add_value("random", random);
+        out.add_value("number", 1234.5);
+        out.add_value("repeated", std::string(300, 'r'));
+        std::string const data(buffer.str());
+        CATCH_REQUIRE(data.length() < text.length() / 2);
+
+        brs::deserializer<std::stringstream>::process_hunk_t func;
+        std::map<std::string, std::string> values;
+        std::map<std::string, std::size_t> compressed;
+        double number(0.0);
+        func = [&values, &compressed, &number](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                compressed[field.f_name] = field.f_compressed_size;
+                if(field.f_name == "number")
+                {
+                    return d.read_data(number);
+                }
+                if(field.f_name == "repeated")
+                {
+                    // read a compressed field in chunks
+                    //
+                    std::string value;
+                    while(d.remaining_data() > 0)
+                    {
+                        char chunk[64];
+                        std::size_t size(sizeof(chunk));
+                        if(!d.read_partial(chunk, size))
+                        {
+                            return false;
+                        }
+                        value.append(chunk, size);
+                    }
+                    values[field.f_name] = value;
+                    return true;
+                }
+                return d.read_data(values[field.f_name]);
+            };
+
+        std::stringstream input(data);
+        brs::deserializer in(input);
+        in.set_compression(&codec);
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(values["small"] == std::string(100, 's'));
+        CATCH_REQUIRE(values["text"] == text);
+        CATCH_REQUIRE(values["random"] == random);
+        CATCH_REQUIRE(values["repeated"] == std::string(300, 'r'));
+        CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(number, 1234.5, 0.0));
+
+        CATCH_REQUIRE(compressed["small"] == 0);
+        CATCH_REQUIRE(compressed["text"] > 0);
+        CATCH_REQUIRE(compressed["text"] < text.length() / 2);
+        CATCH_REQUIRE(compressed["random"] == 0);
+        CATCH_REQUIRE(compressed["number"] == 0);
+        CATCH_REQUIRE(compressed["repeated"] > 0);
+
+        // without a codec, the compressed fields can still be skipped
+        //
+        {
+            std::stringstream again(data);
+            brs::deserializer no_codec(again);
+            number = 0.0;
+            brs::deserializer<std::stringstream>::process_hunk_t skip(
+                [&number](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+                {
+                    if(field.f_name == "number")
+                    {
+                        return d.read_data(number);
+                    }
+                    return d.skip_field();
+                });
+            CATCH_REQUIRE(no_codec.deserialize(skip));
+            CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(number, 1234.5, 0.0));
+        }
+
+        {
+            std::stringstream again(data);
+            brs::deserializer no_codec(again);
+            CATCH_REQUIRE_THROWS_MATCHES(
+                      no_codec.deserialize(func)
+                    , brs::brs_unknown_type
+                    , Catch::Matchers::ExceptionMessage(
+                              "brs_unknown_type: the data is compressed with an unsupported codec."));
+        }
+
+        // the codec is verified before the buffer gets allocated
+        //
+        {
+            std::stringstream again(data);
+            brs::deserializer no_codec(again);
+            std::string text_value;
+            brs::deserializer<std::stringstream>::process_hunk_t read_text(
+                [&text_value](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+                {
+                    if(field.f_name == "text")
+                    {
+                        return d.read_data(text_value);
+                    }
+                    return d.skip_field();
+                });
+            brs::result_t const result(no_codec.try_deserialize(read_text));
+            CATCH_REQUIRE(result.f_error == brs::ERROR_UNKNOWN_TYPE);
+            CATCH_REQUIRE(text_value.empty());
+            CATCH_REQUIRE(text_value.capacity() < text.length());
+        }
+
+        // a document finds the compressed fields but cannot view them
+        //
+        brs::document doc(data);
+        brs::node const n(doc.root().find("text"));
+        CATCH_REQUIRE(n.is_compressed());
+        CATCH_REQUIRE_FALSE(doc.root().find("small").is_compressed());
+        CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(doc.root().find("number").value<double>(), 1234.5, 0.0));
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  n.data()
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: data of \"text\" is compressed."));
+
+        brs::location_t location;
+        CATCH_REQUIRE_FALSE(brs::locate(data.data(), data.length(), "text", location));
+        CATCH_REQUIRE(brs::locate(data.data(), data.length(), "number", location));
+    }
+
+    CATCH_SECTION("uncompressed size limit")
+    {
+        brs::zstd_codec codec;
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.set_compression(&codec);
+        out.add_value("large", std::string(5000, 'l'));
+
+        brs::deserializer in(buffer);
+        in.set_compression(&codec);
+        brs::limits_t limits;
+        limits.f_max_field_size = 4096;
+        in.set_limits(limits);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                return d.skip_field();
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_limit_exceeded
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_limit_exceeded: uncompressed hunk size is 5000, which is more than the limit of 4096."));
+    }
+
+    CATCH_SECTION("uncompressed size larger than a hunk")
+    {
+        brs::zstd_codec codec;
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.set_compression(&codec);
+        out.add_value("large", std::string(5000, 'l'));
+
+        // the uncompressed size follows the hunk sizes, the extension,
+        // and the codec; the default limits do not catch this one
+        //
+        std::string data(buffer.str());
+        std::size_t const offset(sizeof(brs::magic_t) + sizeof(brs::hunk_sizes_t) + sizeof(brs::extension_t) + sizeof(brs::codec_t));
+        std::uint32_t const uncompressed_size(0xFFFFFFFF);
+        memcpy(data.data() + offset, &uncompressed_size, sizeof(uncompressed_size));
+
+        std::stringstream input(data);
+        brs::deserializer in(input);
+        in.set_compression(&codec);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                std::string value;
+                return d.read_data(value);
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_invalid_hunk
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_hunk: the uncompressed size of a compressed hunk is too large."));
+    }
+
+    CATCH_SECTION("empty compressed hunk")
+    {
+        // a compressed hunk without data followed by raw bytes must not
+        // be read as an uncompressed hunk
+        //
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        std::string data(buffer.str());
+
+        brs::hunk_sizes_t hunk_sizes = {};
+        hunk_sizes.f_type = brs::TYPE_EXTENDED;
+        hunk_sizes.f_name = 1;
+        hunk_sizes.f_hunk = 0;
+        brs::extension_t const extension(brs::EXTENSION_COMPRESSED);
+        brs::codec_t const codec(99);
+        std::uint32_t const uncompressed_size(4);
+        data.append(reinterpret_cast<char const *>(&hunk_sizes), sizeof(hunk_sizes));
+        data.append(reinterpret_cast<char const *>(&extension), sizeof(extension));
+        data.append(reinterpret_cast<char const *>(&codec), sizeof(codec));
+        data.append(reinterpret_cast<char const *>(&uncompressed_size), sizeof(uncompressed_size));
+        data += "xABCD";
+
+        std::stringstream input(data);
+        brs::deserializer in(input);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                std::string value;
+                return d.read_data(value);
+            });
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  in.deserialize(func)
+                , brs::brs_invalid_hunk
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_hunk: a compressed hunk cannot be empty."));
+
+        std::stringstream again(data);
+        in.reset(again);
+        brs::result_t const result(in.try_deserialize(func));
+        CATCH_REQUIRE(result.f_error == brs::ERROR_INVALID_HUNK);
+    }
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,313 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the BRS delta functions.
+ *
+ * This file implements tests to verify that a delta created between
+ * two buffers regenerates the second buffer when applied to the first.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#include    <brs/delta.h>
+
+
+// C++
+//
+#include    <sstream>
+
+
+
+namespace
+{
+
+
+
+struct record_t
+{
+    std::int32_t                        f_count = 0;
+    std::string                         f_name = std::string();
+    std::map<int, double>               f_values = std::map<int, double>();
+    std::map<std::string, std::string>  f_attributes = std::map<std::string, std::string>();
+    std::vector<std::string>            f_children = std::vector<std::string>();
+};
+
+
+std::string serialize(record_t const & record)
+{
+    std::stringstream buffer;
+    brs::serializer out(buffer);
+
+    out.add_value("count", record.f_count);
+    out.add_value_if_not_empty("name", record.f_name);
+    for(auto const & v : record.f_values)
+    {
+        out.add_value("values", v.first, v.second);
+    }
+    for(auto const & a : record.f_attributes)
+    {
+        out.add_value("attributes", a.first, a.second);
+    }
+    for(auto const & c : record.f_children)
+    {
+        brs::recursive r(out, "child");
+        out.add_value("title", c);
+    }
+
+    return buffer.str();
+}
+
+
+std::string random_string()
+{
+    std::string result;
+    int const max(rand() % 20 + 1);
+    for(int i(0); i < max; ++i)
+    {
+        result += static_cast<char>('a' + rand() % 26);
+    }
+    return result;
+}
+
+
+record_t random_record()
+{
+    record_t record;
+    record.f_count = rand();
+    record.f_name = random_string();
+    int max(rand() % 50);
+    for(int i(0); i < max; ++i)
+    {
+        record.f_values[rand() % 1000] = rand() / 7.0;
+    }
+    max = rand() % 20;
+    for(int i(0); i < max; ++i)
+    {
+        record.f_attributes[random_string()] = random_string();
+    }
+    max = rand() % 10;
+    for(int i(0); i < max; ++i)
+    {
+        record.f_children.push_back(random_string());
+    }
+    return record;
+}
+
+
+void mutate(record_t & record)
+{
+    switch(rand() % 7)
+    {
+    case 0:
+        record.f_count = rand();
+        break;
+
+    case 1:
+        record.f_name = rand() % 3 == 0 ? std::string() : random_string();
+        break;
+
+    case 2:
+        record.f_values[rand() % 1000] = rand() / 3.0;
+        break;
+
+    case 3:
+        if(!record.f_values.empty())
+        {
+            record.f_values.erase(record.f_values.begin());
+        }
+        break;
+
+    case 4:
+        record.f_attributes[random_string()] = random_string();
+        break;
+
+    case 5:
+        if(!record.f_children.empty())
+        {
+            record.f_children.erase(record.f_children.begin() + rand() % record.f_children.size());
+        }
+        break;
+
+    default:
+        record.f_children.insert(
+                  record.f_children.begin() + rand() % (record.f_children.size() + 1)
+                , random_string());
+        break;
+
+    }
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("delta", "[delta]")
+{
+    CATCH_SECTION("identical buffers")
+    {
+        record_t const record(random_record());
+        std::string const base(serialize(record));
+
+        std::string const delta(brs::create_delta(base, base));
+
+        // magic + size + hash + one copy operation
+        //
+        CATCH_REQUIRE(delta.length() == sizeof(brs::magic_t) + 8 + 8 + 1 + 4);
+        CATCH_REQUIRE(delta[0] == 'B');
+        CATCH_REQUIRE(delta[1] == 'D');
+        CATCH_REQUIRE(delta[2] == 'L');
+        CATCH_REQUIRE(delta[3] == brs::BRS_VERSION);
+
+        CATCH_REQUIRE(brs::apply_delta(base, delta) == base);
+    }
+
+    CATCH_SECTION("one value changed")
+    {
+        record_t record;
+        record.f_count = 1;
+        record.f_name = "delta";
+        for(int i(0); i < 100; ++i)
+        {
+            record.f_values[i] = i * 1.5;
+        }
+        std::string const base(serialize(record));
+
+        record.f_values[50] = -3.25;
+        std::string const current(serialize(record));
+
+        std::string const delta(brs::create_delta(base, current));
+
+        // magic + size + hash + copy + remove + insert (with the hunk) + copy
+        //
+        std::size_t const values_hunk(4 + 2 + 6 + sizeof(double));
+        CATCH_REQUIRE(delta.length() == sizeof(brs::magic_t) + 8 + 8 + 4 * (1 + 4) + values_hunk);
+
+        CATCH_REQUIRE(brs::apply_delta(base, delta) == current);
+    }
+
+    CATCH_SECTION("everything removed")
+    {
+        record_t const record(random_record());
+        std::string const base(serialize(record));
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        std::string const current(buffer.str());
+
+        std::string const delta(brs::create_delta(base, current));
+        CATCH_REQUIRE(delta.length() == sizeof(brs::magic_t) + 8 + 8 + 1 + 4);
+        CATCH_REQUIRE(brs::apply_delta(base, delta) == current);
+    }
+
+    CATCH_SECTION("random mutations")
+    {
+        for(int count(0); count < 100; ++count)
+        {
+            record_t record(random_record());
+            std::string const base(serialize(record));
+
+            int const max(rand() % 10 + 1);
+            for(int i(0); i < max; ++i)
+            {
+                mutate(record);
+            }
+            std::string const current(serialize(record));
+
+            std::string const delta(brs::create_delta(base, current));
+            CATCH_REQUIRE(brs::apply_delta(base, delta) == current);
+        }
+    }
+
+    CATCH_SECTION("array runs")
+    {
+        std::vector<std::int32_t> values(1000);
+        for(std::size_t idx(0); idx < values.size(); ++idx)
+        {
+            values[idx] = static_cast<std::int32_t>(idx);
+        }
+
+        std::stringstream base_buffer;
+        brs::serializer base_out(base_buffer);
+        base_out.add_array("values", values);
+        base_out.add_value("sparse", 100'000, 5);
+        std::string const base(base_buffer.str());
+
+        values[500] = -1;
+        std::stringstream current_buffer;
+        brs::serializer current_out(current_buffer);
+        current_out.add_array("values", values);
+        current_out.add_value("sparse", 100'000, 6);
+        std::string const current(current_buffer.str());
+
+        std::string const delta(brs::create_delta(base, current));
+        CATCH_REQUIRE(brs::apply_delta(base, delta) == current);
+    }
+    CATCH_SECTION("wrong base")
+    {
+        record_t record(random_record());
+        std::string const base(serialize(record));
+        record.f_count ^= 1;
+        std::string const current(serialize(record));
+
+        std::string const delta(brs::create_delta(base, current));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::apply_delta(current, delta)
+                , brs::brs_invalid_delta
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_delta: this delta was not created from this base buffer."));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::apply_delta(base, base)
+                , brs::brs_magic_unsupported
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_unsupported: magic unsupported."));
+    }
+
+    CATCH_SECTION("invalid delta")
+    {
+        record_t const record(random_record());
+        std::string const base(serialize(record));
+        std::string delta(brs::create_delta(base, base));
+
+        std::string truncated(delta.substr(0, delta.length() - 1));
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::apply_delta(base, truncated)
+                , brs::brs_invalid_delta
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_delta: delta operation is truncated."));
+
+        delta[sizeof(brs::magic_t) + 8 + 8] = 5;
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::apply_delta(base, delta)
+                , brs::brs_invalid_delta
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_delta: unknown delta operation 5."));
+    }
+}
+
+
+// vim: ts=4 sw=4 et
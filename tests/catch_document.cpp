@@ -0,0 +1,293 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the BRS document.
+ *
+ * This file implements tests to verify that a document gives access to
+ * the fields of a buffer without callbacks.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#include    <brs/document.h>
+
+
+// C++
+//
+#include    <sstream>
+
+
+
+namespace
+{
+
+
+
+std::string sample()
+{
+    std::stringstream buffer;
+    brs::serializer out(buffer);
+    out.add_value("count", static_cast<std::uint32_t>(42));
+    out.add_value("name", std::string("document"));
+    out.start_subfield("header");
+    {
+        out.add_value("size", static_cast<std::uint16_t>(1024));
+        out.start_subfield("nested");
+        out.add_value("deep", 3.5);
+        out.end_subfield();
+        out.add_value("colors", "red", std::string("#ff0000"));
+        out.add_value("colors", "blue", std::string("#0000ff"));
+    }
+    out.end_subfield();
+    out.add_value("items", 3, static_cast<std::int32_t>(-3));
+    out.add_value("items", 100'000, static_cast<std::int32_t>(-100'000));
+    std::vector<std::int32_t> const run{ 10, 11, 12, 13 };
+    out.add_array("run", run, 10);
+    out.add_value("empty", std::string());
+    return buffer.str();
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("document", "[document]")
+{
+    CATCH_SECTION("browse a buffer")
+    {
+        std::string const buffer(sample());
+        brs::document doc(buffer);
+
+        // nothing is scanned until accessed
+        //
+        CATCH_REQUIRE(doc.node_count() == 1);
+
+        brs::node const root(doc.root());
+        CATCH_REQUIRE(root);
+        CATCH_REQUIRE(root.is_subfield());
+        CATCH_REQUIRE(root.name().empty());
+        CATCH_REQUIRE(root.size() == 7);
+        CATCH_REQUIRE(doc.node_count() == 1 + 7);
+
+        CATCH_REQUIRE(root.find("count").value<std::uint32_t>() == 42);
+        CATCH_REQUIRE(root.find("name").data() == "document");
+        CATCH_REQUIRE(root.find("empty"));
+        CATCH_REQUIRE(root.find("empty").data().empty());
+        CATCH_REQUIRE_FALSE(root.find("empty").is_subfield());
+        CATCH_REQUIRE_FALSE(root.find("missing"));
+
+        CATCH_REQUIRE(root.find("items", 3).value<std::int32_t>() == -3);
+        CATCH_REQUIRE(root.find("items", 100'000).value<std::int32_t>() == -100'000);
+        CATCH_REQUIRE_FALSE(root.find("items", 4));
+
+        brs::node const run(root.find("run", 12));
+        CATCH_REQUIRE(run);
+        CATCH_REQUIRE(run.index() == 10);
+        CATCH_REQUIRE(run.count() == 4);
+        CATCH_REQUIRE(run.data().length() == 4 * sizeof(std::int32_t));
+
+        brs::node const header(root.find("header"));
+        CATCH_REQUIRE(header.is_subfield());
+        CATCH_REQUIRE(doc.node_count() == 1 + 7);
+        CATCH_REQUIRE(header.size() == 4);
+        CATCH_REQUIRE(doc.node_count() == 1 + 7 + 4);
+        CATCH_REQUIRE(header.find("size").value<std::uint16_t>() == 1024);
+        CATCH_REQUIRE(header.find("colors", "blue").data() == "#0000ff");
+        CATCH_REQUIRE(header.find("colors", "red").sub_name() == "red");
+        CATCH_REQUIRE_FALSE(header.find("colors", "green"));
+        CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(header.find("nested").find("deep").value<double>(), 3.5, 0.0));
+        CATCH_REQUIRE(doc.node_count() == 1 + 7 + 4 + 1);
+
+        CATCH_REQUIRE_FALSE(root.child(7));
+        CATCH_REQUIRE(root.child(0).name() == "count");
+        CATCH_REQUIRE(root.child(6).name() == "empty");
+    }
+
+    CATCH_SECTION("wrong value size")
+    {
+        std::string const buffer(sample());
+        brs::document doc(buffer);
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  doc.root().find("count").value<std::uint64_t>()
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: hunk size is 4, but you are trying to read 8."));
+    }
+
+    CATCH_SECTION("invalid buffers")
+    {
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::document(std::string("BR"))
+                , brs::brs_magic_missing
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_missing: magic missing from the start of the buffer."));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::document(std::string("XRL\1"))
+                , brs::brs_magic_unsupported
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_unsupported: magic unsupported."));
+
+        // version 1 sub-fields cannot be found without a schema
+        //
+        std::string v1(sample());
+        memcpy(v1.data(), &brs::BRS_MAGIC_V1, sizeof(brs::BRS_MAGIC_V1));
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::document(v1)
+                , brs::brs_magic_unsupported
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_unsupported: version 1 buffers cannot be browsed, use a deserializer instead."));
+
+        std::string buffer(sample());
+        buffer.resize(buffer.length() - 3);
+        brs::document doc(buffer);
+        CATCH_REQUIRE_THROWS_AS(doc.root().size(), brs::brs_invalid_hunk);
+
+        std::stringstream unclosed;
+        brs::serializer out(unclosed);
+        out.start_subfield("open");
+        out.add_value("value", 1);
+        std::string const data(unclosed.str());
+        brs::document open(data);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  open.root().size()
+                , brs::brs_invalid_hunk
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_hunk: sub-field is missing its end marker."));
+    }
+}
+
+
+CATCH_TEST_CASE("aligned", "[document][aligned]")
+{
+    CATCH_SECTION("payloads are aligned and viewed in place")
+    {
+        std::vector<double> values(100);
+        for(std::size_t idx(0); idx < values.size(); ++idx)
+        {
+            values[idx] = static_cast<double>(idx) * 1.5;
+        }
+        std::vector<float> const small{ 1.0f, 2.0f, 3.0f };
+        std::uint32_t const slot(33);
+
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.set_aligned(true);
+        CATCH_REQUIRE(out.is_aligned());
+        out.add_value("flag", static_cast<char>('y'));
+        out.add_value("d", 3.5);
+        out.add_value("name", std::string("odd"));
+        out.add_array("values", values);
+        out.add_value("slots", "k", &slot, sizeof(slot));
+        out.start_subfield("sub");
+        {
+            out.add_array("small", small, 70000);
+            out.add_value("big", 70001, static_cast<std::uint64_t>(1234));
+        }
+        out.end_subfield();
+        out.add_value("last", static_cast<std::uint16_t>(16));
+
+        // copy to a buffer aligned to a cache line
+        //
+        struct alignas(brs::LARGE_PAYLOAD_ALIGNMENT) line
+        {
+            char        f_data[brs::LARGE_PAYLOAD_ALIGNMENT];
+        };
+        std::string const data(buffer.str());
+        std::vector<line> storage(data.length() / sizeof(line) + 1);
+        char * aligned(reinterpret_cast<char *>(storage.data()));
+        memcpy(aligned, data.data(), data.length());
+
+        brs::document doc(aligned, data.length());
+        brs::node const root(doc.root());
+        CATCH_REQUIRE(root.size() == 7);
+        CATCH_REQUIRE(root.find("d").data_offset() % alignof(double) == 0);
+        CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(root.find("d").value<double>(), 3.5, 0.0));
+        CATCH_REQUIRE(root.find("name").data() == "odd");
+        brs::node const slots(root.find("slots", "k"));
+        CATCH_REQUIRE(slots);
+        CATCH_REQUIRE(slots.data_offset() % alignof(std::uint32_t) == 0);
+        CATCH_REQUIRE(slots.value<std::uint32_t>() == 33);
+        CATCH_REQUIRE(root.find("last").data_offset() % alignof(std::uint16_t) == 0);
+
+        brs::node const v(root.find("values"));
+        CATCH_REQUIRE(v.data_offset() % brs::LARGE_PAYLOAD_ALIGNMENT == 0);
+        brs::array_view<double> const view(v.view<double>());
+        CATCH_REQUIRE(view.size() == values.size());
+        CATCH_REQUIRE(std::vector<double>(view.begin(), view.end()) == values);
+
+        brs::node const sub(root.find("sub"));
+        CATCH_REQUIRE(sub.size() == 2);
+        brs::array_view<float> const floats(sub.find("small").view<float>());
+        CATCH_REQUIRE(floats.size() == 3);
+        CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(floats[2], 3.0f, 0.0f));
+        CATCH_REQUIRE(sub.find("big", 70001).view<std::uint64_t>()[0] == 1234);
+
+        // the deserializer skips the padding
+        //
+        std::vector<std::string> names;
+        brs::deserializer in(buffer);
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&names, &func](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                names.push_back(field.f_name);
+                if(field.f_subfield)
+                {
+                    return d.deserialize(func);
+                }
+                return d.skip_field();
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+        CATCH_REQUIRE(names == std::vector<std::string>({ "flag", "d", "name", "values", "slots", "sub", "small", "big", "last" }));
+    }
+
+    CATCH_SECTION("views of invalid data")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+        out.add_value("d", 3.5);
+        out.add_value("odd", std::string("12345"));
+
+        std::string const data(buffer.str());
+        brs::document doc(data);
+        CATCH_REQUIRE(doc.root().find("d").data_offset() == 9);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  doc.root().find("d").view<double>()
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: data of \"d\" is not aligned to 8 bytes."));
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  doc.root().find("odd").view<std::uint16_t>()
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: hunk size is 5, which is not a multiple of 2."));
+        CATCH_REQUIRE(doc.root().find("odd").view<char>().size() == 5);
+    }
+}
+
+
+// vim: ts=4 sw=4 et
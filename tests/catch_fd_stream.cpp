@@ -0,0 +1,242 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the file descriptor streams.
+ *
+ * This file implements tests to verify that the fd_sink and fd_source
+ * classes can be used by the serializer and the deserializer, including
+ * with values crossing the block boundaries.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#include    <brs/fd_stream.h>
+
+
+// C++
+//
+#include    <thread>
+
+
+// C
+//
+#include    <fcntl.h>
+#include    <unistd.h>
+
+
+
+namespace
+{
+
+
+
+std::string fd_filename(std::string const & name)
+{
+    std::string const filename(SNAP_CATCH2_NAMESPACE::g_tmp_dir() + "/" + name + ".brs");
+    unlink(filename.c_str());
+    return filename;
+}
+
+
+std::string value(std::size_t idx)
+{
+    // sizes from a few bytes to more than one block
+    //
+    std::size_t const size(idx % 10 == 9
+                ? brs::FD_MIN_BLOCK_SIZE + idx * 1000
+                : idx * 997 % 70000);
+    return std::string(size, static_cast<char>('a' + idx % 26));
+}
+
+
+template<typename S>
+void write_values(brs::serializer<S> & out)
+{
+    for(std::size_t idx(0); idx < 50; ++idx)
+    {
+        out.add_value("value", static_cast<int>(idx), value(idx));
+        out.add_value("id", static_cast<std::uint32_t>(idx));
+    }
+}
+
+
+template<typename S>
+void read_values(S & input)
+{
+    brs::deserializer in(input);
+    std::size_t count(0);
+    std::uint32_t id(0);
+    typename brs::deserializer<S>::process_hunk_t func(
+        [&count, &id](brs::deserializer<S> & d, brs::field_t const & field)
+        {
+            if(field.f_name == "id")
+            {
+                CATCH_REQUIRE(d.read_data(id));
+                CATCH_REQUIRE(id == count);
+                ++count;
+                return true;
+            }
+            std::string v;
+            CATCH_REQUIRE(d.read_data(v));
+            CATCH_REQUIRE(v == value(field.f_index));
+            return true;
+        });
+    CATCH_REQUIRE(in.deserialize(func));
+    CATCH_REQUIRE(count == 50);
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("fd_stream", "[fd]")
+{
+    CATCH_SECTION("write and read a file")
+    {
+        std::string const filename(fd_filename("fd-stream"));
+        int fd(open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+        CATCH_REQUIRE(fd != -1);
+        std::size_t size(0);
+        {
+            brs::fd_sink sink(fd);
+            CATCH_REQUIRE(sink.block_size() == brs::FD_DEFAULT_BLOCK_SIZE);
+            brs::serializer out(sink);
+            write_values(out);
+            size = sink.tell();
+        }
+        close(fd);
+
+        fd = open(filename.c_str(), O_RDONLY);
+        CATCH_REQUIRE(fd != -1);
+        CATCH_REQUIRE(lseek(fd, 0, SEEK_END) == static_cast<off_t>(size));
+        lseek(fd, 0, SEEK_SET);
+        {
+            brs::fd_source source(fd, brs::FD_MAX_BLOCK_SIZE);
+            read_values(source);
+        }
+        close(fd);
+    }
+
+    CATCH_SECTION("write and read a pipe")
+    {
+        int pipes[2];
+        CATCH_REQUIRE(pipe(pipes) == 0);
+
+        std::thread th([&pipes]()
+            {
+                {
+                    brs::fd_sink sink(pipes[1]);
+                    brs::serializer out(sink);
+                    write_values(out);
+
+                    // fragments are passed to writev()
+                    //
+                    std::string const large(brs::FD_MIN_BLOCK_SIZE, 'f');
+                    std::vector<iovec> const fragments{
+                        iovec{ const_cast<char *>("small "), 6 },
+                        iovec{ const_cast<char *>(large.data()), large.length() },
+                    };
+                    out.add_value("fragments", fragments);
+                }
+                close(pipes[1]);
+            });
+
+        brs::fd_source source(pipes[0]);
+        brs::deserializer in(source);
+        std::size_t count(0);
+        std::string fragments;
+        brs::deserializer<brs::fd_source>::process_hunk_t func(
+            [&count, &fragments](brs::deserializer<brs::fd_source> & d, brs::field_t const & field)
+            {
+                if(field.f_name == "fragments")
+                {
+                    return d.read_data(fragments);
+                }
+                ++count;
+                return d.skip_field();
+            });
+        CATCH_REQUIRE(in.deserialize(func));
+        th.join();
+        close(pipes[0]);
+
+        CATCH_REQUIRE(count == 100);
+        CATCH_REQUIRE(fragments == "small " + std::string(brs::FD_MIN_BLOCK_SIZE, 'f'));
+        CATCH_REQUIRE(brs::has_writev<brs::fd_sink>::value);
+    }
+
+    CATCH_SECTION("end of file and truncated data")
+    {
+        std::string const filename(fd_filename("fd-eof"));
+        int fd(open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+        CATCH_REQUIRE(fd != -1);
+        CATCH_REQUIRE(write(fd, "0123456789", 10) == 10);
+        close(fd);
+
+        fd = open(filename.c_str(), O_RDONLY);
+        CATCH_REQUIRE(fd != -1);
+        brs::fd_source source(fd);
+        char buf[8];
+        CATCH_REQUIRE(source.read(buf, 4));
+        CATCH_REQUIRE(source.gcount() == 4);
+        CATCH_REQUIRE(std::string(buf, 4) == "0123");
+        CATCH_REQUIRE(source.ignore(2));
+        CATCH_REQUIRE(source.gcount() == 2);
+        CATCH_REQUIRE_FALSE(source.read(buf, 8));
+        CATCH_REQUIRE(source.gcount() == 4);
+        CATCH_REQUIRE(std::string(buf, 4) == "6789");
+        CATCH_REQUIRE(source.eof());
+        CATCH_REQUIRE_FALSE(source.read(buf, 1));
+        CATCH_REQUIRE(source.gcount() == 0);
+
+        source.clear();
+        CATCH_REQUIRE(source);
+        CATCH_REQUIRE_FALSE(source.eof());
+        source.ignore(5);
+        CATCH_REQUIRE(source.gcount() == 0);
+        CATCH_REQUIRE(source.eof());
+        close(fd);
+    }
+
+    CATCH_SECTION("invalid block sizes")
+    {
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::fd_sink(1, brs::FD_MIN_BLOCK_SIZE - 1)
+                , brs::brs_out_of_range
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_out_of_range: block size must be between 1048576 and 16777216 bytes."));
+        CATCH_REQUIRE_THROWS_AS(brs::fd_source(0, brs::FD_MAX_BLOCK_SIZE + 1), brs::brs_out_of_range);
+    }
+
+    CATCH_SECTION("write errors")
+    {
+        brs::fd_sink sink(-1);
+        sink.write("data", 4);
+        CATCH_REQUIRE_THROWS_AS(sink.flush(), brs::brs_io_error);
+    }
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,251 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the BRS instrumentation.
+ *
+ * This file implements tests to verify that the statistics and hooks
+ * of the serializer and deserializer get updated as expected when the
+ * BRS_INSTRUMENTATION macro is defined.
+ *
+ * \note
+ * The tests use their own stream type so the instrumented serializer
+ * and deserializer are distinct instantiations from the ones used in
+ * the other tests.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#define BRS_INSTRUMENTATION
+#include    <brs/brs.h>
+
+
+// C++
+//
+#include    <sstream>
+
+
+
+
+
+namespace
+{
+
+
+
+class instrumented_stream
+    : public std::stringstream
+{
+};
+
+
+class test_hooks
+    : public brs::instrumentation_hooks
+{
+public:
+    virtual void on_hunk(
+          brs::type_t type
+        , brs::name_t const & name
+        , std::size_t header_size
+        , std::size_t data_size) override
+    {
+        f_events.push_back(
+                  "hunk:" + std::to_string(type)
+                + ':' + name
+                + ':' + std::to_string(header_size)
+                + ':' + std::to_string(data_size));
+    }
+
+    virtual void on_start_subfield(brs::name_t const & name, std::size_t depth) override
+    {
+        f_events.push_back("start:" + name + ':' + std::to_string(depth));
+    }
+
+    virtual void on_end_subfield(std::size_t depth) override
+    {
+        f_events.push_back("end:" + std::to_string(depth));
+    }
+
+    virtual void on_callback(brs::field_t const & field, std::chrono::nanoseconds duration) override
+    {
+        CATCH_REQUIRE(duration.count() >= 0);
+        f_events.push_back("callback:" + field.f_name);
+    }
+
+    std::vector<std::string>    f_events = std::vector<std::string>();
+};
+
+
+void serialize_sample(brs::serializer<instrumented_stream> & out)
+{
+    out.add_value("count", static_cast<std::int32_t>(33));
+    out.add_value("colors", 5, std::string("red"));
+    out.add_value("names", "first", std::string("Alexis"));
+    {
+        brs::recursive<instrumented_stream> r(out, "sub");
+        out.add_value("size", static_cast<std::int16_t>(7));
+    }
+}
+
+
+bool process_hunk(
+      brs::deserializer<instrumented_stream> & in
+    , brs::field_t const & field)
+{
+    if(field.f_name == "count")
+    {
+        std::int32_t value;
+        in.read_data(value);
+        CATCH_REQUIRE(value == 33);
+    }
+    else if(field.f_name == "colors"
+         || field.f_name == "names")
+    {
+        std::string value;
+        in.read_data(value);
+    }
+    else if(field.f_name == "sub")
+    {
+        brs::deserializer<instrumented_stream>::process_hunk_t func(&process_hunk);
+        CATCH_REQUIRE(in.deserialize(func));
+    }
+    else if(field.f_name == "size")
+    {
+        std::int16_t value;
+        in.read_data(value);
+        CATCH_REQUIRE(value == 7);
+    }
+    else
+    {
+        CATCH_REQUIRE(field.f_name == "?unknown?");
+    }
+    return true;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("instrumentation", "[instrumentation]")
+{
+    CATCH_SECTION("serializer statistics and hooks")
+    {
+        instrumented_stream buffer;
+        brs::serializer<instrumented_stream> out(buffer);
+        test_hooks hooks;
+        out.set_hooks(&hooks);
+
+        serialize_sample(out);
+
+        brs::stats_t const & stats(out.get_stats());
+        CATCH_REQUIRE(stats.f_hunks[brs::TYPE_FIELD] == 3);    // count, size, end
+        CATCH_REQUIRE(stats.f_hunks[brs::TYPE_ARRAY] == 1);
+        CATCH_REQUIRE(stats.f_hunks[brs::TYPE_MAP] == 1);
+        CATCH_REQUIRE(stats.f_hunks[brs::TYPE_EXTENDED] == 1); // sub
+        CATCH_REQUIRE(stats.f_bytes[brs::TYPE_FIELD] == (4 + 5 + 4) + (4 + 4 + 2) + 4);
+        CATCH_REQUIRE(stats.f_bytes[brs::TYPE_ARRAY] == 4 + 2 + 6 + 3);
+        CATCH_REQUIRE(stats.f_bytes[brs::TYPE_MAP] == 4 + 1 + 5 + 5 + 6);
+        CATCH_REQUIRE(stats.f_bytes[brs::TYPE_EXTENDED] == 4 + 1 + 3);
+        CATCH_REQUIRE(stats.f_field_bytes.at("count") == 4 + 5 + 4);
+        CATCH_REQUIRE(stats.f_field_bytes.at("sub") == 4 + 1 + 3);
+        CATCH_REQUIRE(stats.f_max_depth == 1);
+        CATCH_REQUIRE(stats.f_depth == 0);
+
+        // the header + data bytes add up to the whole buffer minus the magic
+        //
+        std::size_t total(0);
+        for(auto b : stats.f_bytes)
+        {
+            total += b;
+        }
+        CATCH_REQUIRE(total + sizeof(brs::magic_t) == buffer.str().length());
+
+        std::vector<std::string> const expected = {
+            "hunk:0:count:4:4",
+            "hunk:1:colors:6:3",
+            "hunk:2:names:10:6",
+            "hunk:3:sub:5:0",
+            "start:sub:1",
+            "hunk:0:size:4:2",
+            "hunk:0::4:0",
+            "end:1",
+        };
+        CATCH_REQUIRE(hooks.f_events == expected);
+
+        out.reset_stats();
+        CATCH_REQUIRE(out.get_stats().f_hunks[brs::TYPE_FIELD] == 0);
+        CATCH_REQUIRE(out.get_stats().f_field_bytes.empty());
+    }
+
+    CATCH_SECTION("deserializer statistics and hooks")
+    {
+        instrumented_stream buffer;
+        {
+            brs::serializer<instrumented_stream> out(buffer);
+            serialize_sample(out);
+        }
+        std::size_t const size(buffer.str().length());
+
+        brs::deserializer<instrumented_stream> in(buffer);
+        test_hooks hooks;
+        in.set_hooks(&hooks);
+
+        brs::deserializer<instrumented_stream>::process_hunk_t func(&process_hunk);
+        bool const r(in.deserialize(func));
+        CATCH_REQUIRE(r);
+
+        brs::stats_t const & stats(in.get_stats());
+        CATCH_REQUIRE(stats.f_hunks[brs::TYPE_FIELD] == 3);
+        CATCH_REQUIRE(stats.f_hunks[brs::TYPE_ARRAY] == 1);
+        CATCH_REQUIRE(stats.f_hunks[brs::TYPE_MAP] == 1);
+        CATCH_REQUIRE(stats.f_hunks[brs::TYPE_EXTENDED] == 1);
+        CATCH_REQUIRE(stats.f_bytes[brs::TYPE_FIELD] + stats.f_bytes[brs::TYPE_ARRAY] + stats.f_bytes[brs::TYPE_MAP] + stats.f_bytes[brs::TYPE_EXTENDED] + sizeof(brs::magic_t) == size);
+        CATCH_REQUIRE(stats.f_field_bytes.at("names") == 4 + 1 + 5 + 5 + 6);
+        CATCH_REQUIRE(stats.f_max_depth == 1);
+        CATCH_REQUIRE(stats.f_depth == 0);
+        CATCH_REQUIRE(stats.f_parse_time.count() > 0);
+        CATCH_REQUIRE(stats.f_callback_time.count() >= 0);
+
+        std::vector<std::string> const expected = {
+            "hunk:0:count:4:4",
+            "callback:count",
+            "hunk:1:colors:6:3",
+            "callback:colors",
+            "hunk:2:names:10:6",
+            "callback:names",
+            "hunk:3:sub:5:0",
+            "start:sub:1",
+            "hunk:0:size:4:2",
+            "callback:size",
+            "hunk:0::4:0",
+            "end:1",
+            "callback:sub",
+        };
+        CATCH_REQUIRE(hooks.f_events == expected);
+    }
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,361 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the BRS log files.
+ *
+ * This file implements tests to verify that records appended to a log
+ * file can be read back, including after a crash left a torn record
+ * at the end of the file.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#include    <brs/log.h>
+
+
+// C++
+//
+#include    <fstream>
+#include    <thread>
+
+
+// C
+//
+#include    <sys/stat.h>
+#include    <unistd.h>
+
+
+
+namespace
+{
+
+
+
+std::string log_filename(std::string const & name)
+{
+    std::string const filename(SNAP_CATCH2_NAMESPACE::g_tmp_dir() + "/" + name + ".brs");
+    unlink(filename.c_str());
+    return filename;
+}
+
+
+void add_event(brs::log_writer & writer, std::uint32_t id)
+{
+    writer.add_record([id](brs::serializer<std::stringstream> & out)
+        {
+            out.add_value("id", id);
+            out.add_value("name", "event #" + std::to_string(id));
+        });
+}
+
+
+std::uint32_t read_event(brs::log_reader & reader, bool & found)
+{
+    std::uint32_t id(0);
+    std::string name;
+    brs::log_reader::process_hunk_t func(
+        [&id, &name](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+        {
+            if(field.f_name == "id")
+            {
+                in.read_data(id);
+            }
+            else
+            {
+                in.read_data(name);
+            }
+            return true;
+        });
+    found = reader.read_record(func);
+    if(found)
+    {
+        CATCH_REQUIRE(name == "event #" + std::to_string(id));
+    }
+    return id;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("log", "[log]")
+{
+    CATCH_SECTION("write and read back")
+    {
+        std::string const filename(log_filename("write-read"));
+        {
+            brs::log_writer writer(filename, 4096);
+            CATCH_REQUIRE(writer.truncated() == 0);
+            for(std::uint32_t id(0); id < 1000; ++id)
+            {
+                add_event(writer, id);
+            }
+        }
+
+        brs::log_reader reader(filename);
+        for(std::uint32_t id(0); id < 1000; ++id)
+        {
+            CATCH_REQUIRE(reader.record_number() == id);
+            bool found(false);
+            CATCH_REQUIRE(read_event(reader, found) == id);
+            CATCH_REQUIRE(found);
+        }
+        bool found(true);
+        read_event(reader, found);
+        CATCH_REQUIRE_FALSE(found);
+        CATCH_REQUIRE(reader.record_number() == 1000);
+        CATCH_REQUIRE(reader.truncate_tail() == 0);
+    }
+
+    CATCH_SECTION("torn records get truncated")
+    {
+        std::string const filename(log_filename("torn"));
+        {
+            brs::log_writer writer(filename);
+            for(std::uint32_t id(0); id < 10; ++id)
+            {
+                add_event(writer, id);
+            }
+            writer.sync();
+        }
+
+        // a record with a size but only part of its data
+        //
+        {
+            std::ofstream out(filename, std::ios_base::app | std::ios_base::binary);
+            brs::record_size_t const size(100);
+            out.write(reinterpret_cast<char const *>(&size), sizeof(size));
+            out.write("12345", 5);
+        }
+
+        {
+            brs::log_reader reader(filename);
+            std::string hunks;
+            std::size_t count(0);
+            while(reader.next_record(hunks))
+            {
+                ++count;
+            }
+            CATCH_REQUIRE(count == 10);
+        }
+
+        {
+            brs::log_writer writer(filename);
+            CATCH_REQUIRE(writer.truncated() == sizeof(brs::record_size_t) + 5);
+            add_event(writer, 10);
+        }
+
+        // a complete record with a bad checksum
+        //
+        {
+            std::ofstream out(filename, std::ios_base::app | std::ios_base::binary);
+            brs::record_size_t const size(3);
+            brs::log_checksum_t const checksum(brs::log_checksum("abc", 3) + 1);
+            out.write(reinterpret_cast<char const *>(&size), sizeof(size));
+            out.write(reinterpret_cast<char const *>(&checksum), sizeof(checksum));
+            out.write("abc", 3);
+        }
+
+        {
+            brs::log_reader reader(filename);
+            CATCH_REQUIRE(reader.truncate_tail() == brs::LOG_RECORD_HEADER_SIZE + 3);
+            for(std::uint32_t id(0); id <= 10; ++id)
+            {
+                bool found(false);
+                CATCH_REQUIRE(read_event(reader, found) == id);
+                CATCH_REQUIRE(found);
+            }
+            bool found(true);
+            read_event(reader, found);
+            CATCH_REQUIRE_FALSE(found);
+        }
+    }
+
+    CATCH_SECTION("corrupted records are not truncated")
+    {
+        std::string const filename(log_filename("corrupted"));
+        {
+            brs::log_writer writer(filename);
+            for(std::uint32_t id(0); id < 10; ++id)
+            {
+                add_event(writer, id);
+            }
+            writer.sync();
+        }
+
+        // change one byte of the data of the fifth record
+        //
+        std::size_t offset(0);
+        {
+            brs::log_reader reader(filename);
+            std::string hunks;
+            for(int idx(0); idx < 4; ++idx)
+            {
+                CATCH_REQUIRE(reader.next_record(hunks));
+            }
+            offset = reader.tell() + brs::LOG_RECORD_HEADER_SIZE + 3;
+        }
+        struct stat st = {};
+        CATCH_REQUIRE(stat(filename.c_str(), &st) == 0);
+        {
+            std::fstream file(filename, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+            file.seekp(offset);
+            file.put('*');
+        }
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::log_writer(filename)
+                , brs::brs_invalid_record
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_record: log file \""
+                        + filename
+                        + "\" has an invalid record at offset "
+                        + std::to_string(offset - brs::LOG_RECORD_HEADER_SIZE - 3)
+                        + '.'));
+
+        // the records after the corrupted one are still in the file
+        //
+        struct stat after = {};
+        CATCH_REQUIRE(stat(filename.c_str(), &after) == 0);
+        CATCH_REQUIRE(after.st_size == st.st_size);
+
+        brs::log_reader reader(filename);
+        CATCH_REQUIRE_THROWS_AS(reader.truncate_tail(), brs::brs_invalid_record);
+    }
+
+    CATCH_SECTION("group commit from multiple threads")
+    {
+        std::string const filename(log_filename("group-commit"));
+        {
+            brs::log_writer writer(filename);
+            std::vector<std::thread> threads;
+            for(std::uint32_t t(0); t < 4; ++t)
+            {
+                threads.emplace_back([&writer, t]()
+                    {
+                        for(std::uint32_t id(0); id < 250; ++id)
+                        {
+                            std::uint32_t const value(t * 1000 + id);
+                            std::string hunks;
+                            {
+                                std::stringstream buffer;
+                                brs::serializer out(buffer, false);
+                                out.add_value("id", value);
+                                out.add_value("name", "event #" + std::to_string(value));
+                                hunks = buffer.str();
+                            }
+                            writer.commit(writer.add_hunks(hunks.data(), hunks.length()));
+                        }
+                    });
+            }
+            for(auto & th : threads)
+            {
+                th.join();
+            }
+        }
+
+        brs::log_reader reader(filename);
+        std::vector<std::uint32_t> last(4, static_cast<std::uint32_t>(-1));
+        std::size_t count(0);
+        for(;;)
+        {
+            bool found(false);
+            std::uint32_t const value(read_event(reader, found));
+            if(!found)
+            {
+                break;
+            }
+            ++count;
+
+            // records of one thread are in order
+            //
+            std::uint32_t const t(value / 1000);
+            CATCH_REQUIRE(t < 4);
+            CATCH_REQUIRE(value % 1000 == last[t] + 1);
+            last[t] = value % 1000;
+        }
+        CATCH_REQUIRE(count == 1000);
+    }
+
+    CATCH_SECTION("follow a log file")
+    {
+        std::string const filename(log_filename("follow"));
+        brs::log_writer writer(filename);
+        brs::log_reader reader(filename);
+
+        std::string hunks;
+        CATCH_REQUIRE_FALSE(reader.next_record(hunks));
+        CATCH_REQUIRE_FALSE(reader.follow(hunks, std::chrono::milliseconds(20)));
+
+        std::thread th([&writer]()
+            {
+                for(std::uint32_t id(0); id < 5; ++id)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    add_event(writer, id);
+                    writer.flush();
+                }
+            });
+
+        for(std::uint32_t id(0); id < 5; ++id)
+        {
+            CATCH_REQUIRE(reader.follow(hunks, std::chrono::seconds(10), std::chrono::milliseconds(1)));
+            CATCH_REQUIRE(reader.record_number() == id + 1);
+        }
+        th.join();
+    }
+
+    CATCH_SECTION("invalid log files")
+    {
+        std::string const filename(log_filename("invalid"));
+        {
+            std::ofstream out(filename);
+            out << "not a log file";
+        }
+
+        brs::log_reader reader(filename);
+        std::string hunks;
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  reader.next_record(hunks)
+                , brs::brs_magic_unsupported
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_unsupported: log file magic unsupported."));
+
+        CATCH_REQUIRE_THROWS_AS(brs::log_writer(filename), brs::brs_magic_unsupported);
+
+        CATCH_REQUIRE_THROWS_AS(brs::log_reader(filename + ".missing"), brs::brs_io_error);
+
+        brs::log_writer writer(log_filename("commit"));
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  writer.commit(0)
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: record 0 was not added yet."));
+    }
+}
+
+
+// vim: ts=4 sw=4 et
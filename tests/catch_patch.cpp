@@ -0,0 +1,199 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the BRS paths and in place updates.
+ *
+ * This file implements tests to verify that paths get parsed as expected
+ * and that fields can be updated directly in a buffer.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#include    <brs/patch.h>
+
+
+// C++
+//
+#include    <sstream>
+
+
+
+namespace
+{
+
+
+
+std::string sample()
+{
+    std::stringstream buffer;
+    brs::serializer out(buffer);
+    out.add_value("name", std::string("patch"));
+    out.start_subfield("stats");
+    {
+        out.add_value("counter", static_cast<std::int64_t>(0));
+        out.add_value("when", 1000.5);
+        out.add_value("slots", 7, static_cast<std::uint32_t>(70));
+        out.add_value("tags", "color", std::string("red"));
+        std::vector<std::uint16_t> const run{ 1, 2, 3 };
+        out.add_array("run", run, 5);
+    }
+    out.end_subfield();
+    out.add_value("counter", static_cast<std::int64_t>(-1));
+    return buffer.str();
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("path", "[path]")
+{
+    CATCH_SECTION("valid paths")
+    {
+        brs::path_t const path(brs::parse_path("header/items[12]/colors{red}/any[*]/all{*}"));
+        CATCH_REQUIRE(path.size() == 5);
+
+        CATCH_REQUIRE(path[0].f_name == "header");
+        CATCH_REQUIRE(path[0].f_kind == brs::SEGMENT_NAME);
+
+        CATCH_REQUIRE(path[1].f_name == "items");
+        CATCH_REQUIRE(path[1].f_kind == brs::SEGMENT_INDEX);
+        CATCH_REQUIRE(path[1].f_index == 12);
+        CATCH_REQUIRE_FALSE(path[1].f_any);
+
+        CATCH_REQUIRE(path[2].f_name == "colors");
+        CATCH_REQUIRE(path[2].f_kind == brs::SEGMENT_MAP);
+        CATCH_REQUIRE(path[2].f_sub_name == "red");
+
+        CATCH_REQUIRE(path[3].f_name == "any");
+        CATCH_REQUIRE(path[3].f_kind == brs::SEGMENT_INDEX);
+        CATCH_REQUIRE(path[3].f_any);
+
+        CATCH_REQUIRE(path[4].f_name == "all");
+        CATCH_REQUIRE(path[4].f_kind == brs::SEGMENT_MAP);
+        CATCH_REQUIRE(path[4].f_any);
+    }
+
+    CATCH_SECTION("invalid paths")
+    {
+        char const * const invalid[] = {
+            "",
+            "a//b",
+            "/a",
+            "a/",
+            "[3]",
+            "a[3",
+            "a[]",
+            "a[-3]",
+            "a[3x]",
+            "a[99999999999]",
+            "a{}",
+            "a{b",
+            "a{b]",
+        };
+        for(auto const & p : invalid)
+        {
+            CATCH_REQUIRE_THROWS_AS(brs::parse_path(p), brs::brs_invalid_path);
+        }
+    }
+}
+
+
+CATCH_TEST_CASE("patch", "[patch]")
+{
+    CATCH_SECTION("locate and patch fields")
+    {
+        std::string buffer(sample());
+        std::size_t const size(buffer.length());
+
+        brs::location_t counter;
+        CATCH_REQUIRE(brs::locate(buffer.data(), buffer.length(), "stats/counter", counter));
+        CATCH_REQUIRE(counter.f_size == sizeof(std::int64_t));
+        for(std::int64_t value(1); value <= 10; ++value)
+        {
+            brs::patch(buffer.data(), counter, value);
+        }
+
+        brs::patch(buffer.data(), buffer.length(), "stats/when", 2000.25);
+        brs::patch(buffer.data(), buffer.length(), "stats/slots[7]", static_cast<std::uint32_t>(77));
+        brs::patch(buffer.data(), buffer.length(), "stats/tags{color}", std::string("blu"));
+        brs::patch(buffer.data(), buffer.length(), "stats/run[6]", static_cast<std::uint16_t>(222));
+        brs::location_t const top(brs::patch(buffer.data(), buffer.length(), "counter", static_cast<std::int64_t>(33)));
+        CATCH_REQUIRE(top.f_offset + top.f_size == size);
+
+        CATCH_REQUIRE(buffer.length() == size);
+
+        brs::document doc(buffer);
+        brs::node const stats(doc.root().find("stats"));
+        CATCH_REQUIRE(stats.find("counter").value<std::int64_t>() == 10);
+        CATCH_REQUIRE(SNAP_CATCH2_NAMESPACE::nearly_equal(stats.find("when").value<double>(), 2000.25, 0.0));
+        CATCH_REQUIRE(stats.find("slots", 7).value<std::uint32_t>() == 77);
+        CATCH_REQUIRE(stats.find("tags", "color").data() == "blu");
+        CATCH_REQUIRE(doc.root().find("counter").value<std::int64_t>() == 33);
+
+        std::string_view const run(stats.find("run").data());
+        std::uint16_t items[3];
+        CATCH_REQUIRE(run.length() == sizeof(items));
+        memcpy(items, run.data(), sizeof(items));
+        CATCH_REQUIRE(items[0] == 1);
+        CATCH_REQUIRE(items[1] == 222);
+        CATCH_REQUIRE(items[2] == 3);
+    }
+
+    CATCH_SECTION("fields that cannot be patched")
+    {
+        std::string buffer(sample());
+
+        brs::location_t location;
+        CATCH_REQUIRE_FALSE(brs::locate(buffer.data(), buffer.length(), "stats", location));
+        CATCH_REQUIRE_FALSE(brs::locate(buffer.data(), buffer.length(), "stats/missing", location));
+        CATCH_REQUIRE_FALSE(brs::locate(buffer.data(), buffer.length(), "name/sub", location));
+        CATCH_REQUIRE_FALSE(brs::locate(buffer.data(), buffer.length(), "stats/slots[8]", location));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::patch(buffer.data(), buffer.length(), "stats/missing", 5)
+                , brs::brs_field_not_found
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_field_not_found: field \"stats/missing\" not found."));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::patch(buffer.data(), buffer.length(), "stats/counter", 5)
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: hunk size is 8, but you are trying to write 4."));
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::patch(buffer.data(), buffer.length(), "name", std::string("longer"))
+                , brs::brs_logic_error
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_logic_error: hunk size is 5, but you are trying to write 6."));
+
+        CATCH_REQUIRE(buffer == sample());
+    }
+}
+
+
+// vim: ts=4 sw=4 et
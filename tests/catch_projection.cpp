@@ -0,0 +1,215 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the BRS projections.
+ *
+ * This file implements tests to verify that a projection only delivers
+ * the selected fields and skips everything else.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#include    <brs/projection.h>
+
+
+// C++
+//
+#include    <sstream>
+
+
+
+namespace
+{
+
+
+
+std::string sample()
+{
+    std::stringstream buffer;
+    brs::serializer out(buffer);
+    out.add_value("name", std::string("projection"));
+    out.start_subfield("t1");
+    {
+        out.add_value("size", 0, static_cast<std::uint32_t>(10));
+        out.start_subfield("deep");
+        {
+            out.add_value("size", 0, static_cast<std::uint32_t>(99));
+        }
+        out.end_subfield();
+    }
+    out.end_subfield();
+    out.add_value("count", static_cast<std::uint32_t>(3));
+    out.start_subfield("t2");
+    {
+        out.add_value("color", "red", std::string("#f00"));
+        out.add_value("size", 1, static_cast<std::uint32_t>(11));
+        out.add_value("size", 2, static_cast<std::uint32_t>(22));
+        std::vector<std::uint32_t> const run{ 100, 101, 102 };
+        out.add_array("size", run, 100000);
+        out.add_value("size", static_cast<std::uint32_t>(5));
+        out.add_value("color", "blue", std::string("#00f"));
+    }
+    out.end_subfield();
+    return buffer.str();
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("projection", "[projection]")
+{
+    CATCH_SECTION("compile paths")
+    {
+        brs::projection paths{ "count", "t2/size[*]", "t2/color{blue}" };
+        CATCH_REQUIRE(paths.size() == 3);
+        CATCH_REQUIRE(paths.add_path("t2/size[*]") == 1);
+        CATCH_REQUIRE(paths.add_path("t2/size[3]") == 3);
+        CATCH_REQUIRE(paths.size() == 4);
+
+        CATCH_REQUIRE_THROWS_AS(paths.add_path("t2//size"), brs::brs_invalid_path);
+    }
+
+    CATCH_SECTION("deliver only matching fields")
+    {
+        std::stringstream buffer(sample());
+        brs::deserializer in(buffer);
+
+        std::uint32_t count(0);
+        std::vector<std::uint32_t> sizes;
+        std::string color;
+        std::vector<std::size_t> matched;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                matched.push_back(d.matched_path());
+                switch(d.matched_path())
+                {
+                case 0:
+                    CATCH_REQUIRE(field.f_name == "count");
+                    d.read_data(count);
+                    break;
+
+                case 1:
+                    {
+                        CATCH_REQUIRE(field.f_name == "size");
+                        std::vector<std::uint32_t> items(field.f_count);
+                        d.read_data(items);
+                        sizes.insert(sizes.end(), items.begin(), items.end());
+                    }
+                    break;
+
+                case 2:
+                    CATCH_REQUIRE(field.f_sub_name == "blue");
+                    d.read_data(color);
+                    break;
+
+                default:
+                    CATCH_REQUIRE(false);
+
+                }
+                return true;
+            });
+        brs::projection const paths{ "count", "t2/size[*]", "t2/color{blue}" };
+        CATCH_REQUIRE(in.deserialize(func, paths));
+
+        CATCH_REQUIRE(count == 3);
+        CATCH_REQUIRE(sizes == std::vector<std::uint32_t>({ 11, 22, 100, 101, 102 }));
+        CATCH_REQUIRE(color == "#00f");
+        CATCH_REQUIRE(matched == std::vector<std::size_t>({ 0, 1, 1, 1, 2 }));
+    }
+
+    CATCH_SECTION("specific array items")
+    {
+        std::stringstream buffer(sample());
+        brs::deserializer in(buffer);
+
+        std::vector<int> indexes;
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&indexes](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                indexes.push_back(field.f_index);
+                std::string data;
+                d.read_data(data);
+                return true;
+            });
+        brs::projection const paths{ "t2/size[2]", "t2/size[100001]", "t1/size[0]" };
+        CATCH_REQUIRE(in.deserialize(func, paths));
+        CATCH_REQUIRE(indexes == std::vector<int>({ 0, 2, 100000 }));
+    }
+
+    CATCH_SECTION("whole sub-field")
+    {
+        std::stringstream buffer(sample());
+        brs::deserializer in(buffer);
+
+        std::vector<std::string> names;
+        brs::deserializer<std::stringstream>::process_hunk_t sub(
+            [&names, &sub](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                names.push_back(field.f_name);
+                if(field.f_subfield)
+                {
+                    return d.deserialize(sub);
+                }
+                std::string data;
+                d.read_data(data);
+                return true;
+            });
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [&sub](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                CATCH_REQUIRE(field.f_subfield);
+                return d.deserialize(sub);
+            });
+        brs::projection const paths{ "t1", "t1/size[0]" };
+        CATCH_REQUIRE(in.deserialize(func, paths));
+        CATCH_REQUIRE(names == std::vector<std::string>({ "size", "deep", "size" }));
+    }
+
+    CATCH_SECTION("truncated buffer")
+    {
+        std::string const data(sample());
+        brs::projection const paths{ "count" };
+        brs::deserializer<std::stringstream>::process_hunk_t func(
+            [](brs::deserializer<std::stringstream> & d, brs::field_t const & field)
+            {
+                snapdev::NOT_USED(field);
+                std::uint32_t count(0);
+                d.read_data(count);
+                return true;
+            });
+        for(std::size_t size(sizeof(brs::magic_t) + 1); size < data.length(); size += 7)
+        {
+            std::stringstream buffer(data.substr(0, size));
+            brs::deserializer in(buffer);
+            in.deserialize(func, paths);    // must not loop or crash
+        }
+    }
+}
+
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,297 @@
+// Copyright (c) 2011-2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Verify the BRS record stream.
+ *
+ * This file implements tests to verify that records written with the
+ * record_writer can be counted, skipped, split, and read back with the
+ * record_reader.
+ */
+
+// self
+//
+#include    "catch_main.h"
+
+
+// brs
+//
+#include    <brs/record.h>
+
+
+// C++
+//
+#include    <fstream>
+
+
+
+namespace
+{
+
+
+
+void write_records(std::stringstream & buffer, int count)
+{
+    brs::record_writer<std::stringstream> writer(buffer);
+    for(int idx(0); idx < count; ++idx)
+    {
+        writer.add_record([idx](brs::serializer<std::stringstream> & out)
+            {
+                out.add_value("id", idx);
+                out.add_value("name", "record #" + std::to_string(idx) + std::string(idx % 7, '+'));
+            });
+    }
+}
+
+
+int read_id(brs::record_reader<std::stringstream> & reader)
+{
+    int id(-1);
+    brs::record_reader<std::stringstream>::process_hunk_t func(
+        [&id](brs::deserializer<std::stringstream> & in, brs::field_t const & field)
+        {
+            if(field.f_name == "id")
+            {
+                in.read_data(id);
+            }
+            else
+            {
+                std::string name;
+                in.read_data(name);
+            }
+            return true;
+        });
+    if(!reader.read_record(func))
+    {
+        return -1;
+    }
+    return id;
+}
+
+
+
+} // no name namespace
+
+
+
+CATCH_TEST_CASE("record", "[record]")
+{
+    CATCH_SECTION("write and read records")
+    {
+        std::stringstream buffer;
+        write_records(buffer, 10);
+
+        std::string const data(buffer.str());
+        CATCH_REQUIRE(data[0] == 'B');
+        CATCH_REQUIRE(data[1] == 'F');
+        CATCH_REQUIRE(data[2] == 'L');
+        CATCH_REQUIRE(data[3] == brs::BRS_VERSION);
+
+        // first record: size then hunks without a magic
+        //
+        brs::record_size_t size(0);
+        memcpy(&size, data.data() + 4, sizeof(size));
+        CATCH_REQUIRE(size == (4 + 2 + 4) + (4 + 4 + 9));
+        CATCH_REQUIRE(data[8] == 2 << 2);      // "id" hunk header
+
+        brs::record_reader<std::stringstream> reader(buffer);
+        for(int idx(0); idx < 10; ++idx)
+        {
+            CATCH_REQUIRE(read_id(reader) == idx);
+        }
+        CATCH_REQUIRE(read_id(reader) == -1);
+        CATCH_REQUIRE(reader.count_records() == 10);
+    }
+
+    CATCH_SECTION("count, skip, and seek")
+    {
+        std::stringstream buffer;
+        write_records(buffer, 25);
+
+        brs::record_reader<std::stringstream> reader(buffer);
+        CATCH_REQUIRE(reader.count_records() == 25);
+
+        // counting does not move the current position
+        //
+        CATCH_REQUIRE(read_id(reader) == 0);
+
+        CATCH_REQUIRE(reader.skip_record());
+        CATCH_REQUIRE(reader.skip_record());
+        CATCH_REQUIRE(read_id(reader) == 3);
+
+        CATCH_REQUIRE(reader.seek(17));
+        CATCH_REQUIRE(read_id(reader) == 17);
+
+        CATCH_REQUIRE(reader.seek(2));
+        CATCH_REQUIRE(read_id(reader) == 2);
+
+        CATCH_REQUIRE(reader.seek(24));
+        CATCH_REQUIRE(read_id(reader) == 24);
+        CATCH_REQUIRE(read_id(reader) == -1);
+
+        CATCH_REQUIRE_FALSE(reader.seek(25));
+        CATCH_REQUIRE_FALSE(reader.seek(100));
+
+        CATCH_REQUIRE(reader.seek(0));
+        CATCH_REQUIRE(read_id(reader) == 0);
+    }
+
+    CATCH_SECTION("split in ranges")
+    {
+        std::stringstream buffer;
+        write_records(buffer, 100);
+        std::size_t const size(buffer.str().length());
+
+        brs::record_reader<std::stringstream> reader(buffer);
+        for(std::size_t count(1); count <= 10; ++count)
+        {
+            brs::record_range_vector_t const ranges(reader.split(count));
+            CATCH_REQUIRE(ranges.size() <= count);
+            CATCH_REQUIRE_FALSE(ranges.empty());
+            CATCH_REQUIRE(ranges.front().f_start == sizeof(brs::magic_t));
+            CATCH_REQUIRE(ranges.back().f_end == size);
+
+            std::size_t total(0);
+            int expected_id(0);
+            for(std::size_t r(0); r < ranges.size(); ++r)
+            {
+                if(r > 0)
+                {
+                    CATCH_REQUIRE(ranges[r].f_start == ranges[r - 1].f_end);
+                }
+                total += ranges[r].f_records;
+
+                // each range can be read on its own
+                //
+                reader.seek_offset(ranges[r].f_start);
+                while(reader.tell() < ranges[r].f_end)
+                {
+                    CATCH_REQUIRE(read_id(reader) == expected_id);
+                    ++expected_id;
+                }
+                CATCH_REQUIRE(reader.tell() == ranges[r].f_end);
+            }
+            CATCH_REQUIRE(total == 100);
+            CATCH_REQUIRE(expected_id == 100);
+        }
+
+        CATCH_REQUIRE(reader.split(0).empty());
+    }
+
+    CATCH_SECTION("empty stream")
+    {
+        std::stringstream buffer;
+        write_records(buffer, 0);
+
+        brs::record_reader<std::stringstream> reader(buffer);
+        CATCH_REQUIRE(reader.count_records() == 0);
+        CATCH_REQUIRE(read_id(reader) == -1);
+        CATCH_REQUIRE(reader.split(4).empty());
+    }
+
+    CATCH_SECTION("truncated record")
+    {
+        std::stringstream buffer;
+        write_records(buffer, 3);
+        std::string data(buffer.str());
+        data.resize(data.length() - 3);
+
+        std::stringstream truncated(data);
+        brs::record_reader<std::stringstream> reader(truncated);
+        CATCH_REQUIRE(read_id(reader) == 0);
+        CATCH_REQUIRE(read_id(reader) == 1);
+
+        std::string hunks;
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  reader.next_record(hunks)
+                , brs::brs_invalid_record
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_record: record is truncated."));
+    }
+
+    CATCH_SECTION("truncated record in a file")
+    {
+        std::stringstream buffer;
+        write_records(buffer, 3);
+        std::string const data(buffer.str());
+
+        std::string const filename(SNAP_CATCH2_NAMESPACE::g_tmp_dir() + "/truncated-record.brs");
+        {
+            std::ofstream out(filename, std::ios_base::trunc | std::ios_base::binary);
+            out.write(data.data(), data.length() - 3);
+        }
+
+        // a file stream lets seekg() go past the end of the file
+        //
+        std::ifstream in(filename, std::ios_base::binary);
+        brs::record_reader<std::ifstream> reader(in);
+        CATCH_REQUIRE(reader.skip_record());
+        CATCH_REQUIRE(reader.skip_record());
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  reader.skip_record()
+                , brs::brs_invalid_record
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_invalid_record: record is truncated."));
+
+        reader.seek(0);
+        CATCH_REQUIRE_THROWS_AS(reader.count_records(), brs::brs_invalid_record);
+        CATCH_REQUIRE_THROWS_AS(reader.split(2), brs::brs_invalid_record);
+    }
+
+    CATCH_SECTION("record size limit")
+    {
+        std::stringstream buffer;
+        write_records(buffer, 1);
+        std::string data(buffer.str());
+
+        // a corrupted size does not get allocated before the data is found
+        //
+        brs::record_size_t const size(0xFFFFFFF0);
+        memcpy(data.data() + sizeof(brs::magic_t), &size, sizeof(size));
+        std::stringstream corrupted(data);
+        brs::record_reader<std::stringstream> reader(corrupted);
+        std::string hunks;
+        CATCH_REQUIRE_THROWS_AS(reader.next_record(hunks), brs::brs_invalid_record);
+
+        std::stringstream limited(buffer.str());
+        brs::record_reader<std::stringstream> limited_reader(limited);
+        brs::limits_t limits;
+        limits.f_max_total_bytes = 10;
+        limited_reader.set_limits(limits);
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  limited_reader.next_record(hunks)
+                , brs::brs_limit_exceeded
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_limit_exceeded: record size is 27, which is more than the limit of 10."));
+    }
+
+    CATCH_SECTION("invalid magic")
+    {
+        std::stringstream buffer;
+        brs::serializer out(buffer);
+
+        CATCH_REQUIRE_THROWS_MATCHES(
+                  brs::record_reader<std::stringstream>(buffer)
+                , brs::brs_magic_unsupported
+                , Catch::Matchers::ExceptionMessage(
+                          "brs_magic_unsupported: record stream magic unsupported."));
+    }
+}
+
+
+// vim: ts=4 sw=4 et
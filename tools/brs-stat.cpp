@@ -0,0 +1,523 @@
+// Copyright (c) 2022  Made to Order Software Corp.  All Rights Reserved
+//
+// https://snapwebsites.org/project/brs
+// contact@m2osw.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/** \file
+ * \brief Report where the bytes of a BRS file go.
+ *
+ * This tool reads a BRS file and prints the number of bytes used by
+ * each field path along with the number of hunks, the size of the
+ * headers versus the payload, the bytes used by the names, and a
+ * histogram of the sub-field depths.
+ *
+ * The file is streamed. The data of the fields is skipped, never loaded,
+ * so the memory used only depends on the number of distinct paths, not
+ * the size of the file. All the items of an array or a map share one
+ * path (i.e. `size[*]` and `color{*}`).
+ *
+ * The tool understands plain BRS files, record streams (see brs/record.h)
+ * and log files (see brs/log.h).
+ *
+ * Usage:
+ *
+ * \code
+ *     brs-stat <filename> ...
+ * \endcode
+ */
+
+// brs
+//
+#include    <brs/log.h>
+#include    <brs/version.h>
+
+
+// C++
+//
+#include    <algorithm>
+#include    <fstream>
+#include    <iomanip>
+#include    <iostream>
+#include    <map>
+
+
+
+namespace
+{
+
+
+
+/** \brief An input stream limited to a number of bytes.
+ *
+ * The records of a record stream or a log file do not end with an end
+ * marker. This class makes the deserializer see the end of a record as
+ * the end of the file so the records can be read directly from the file
+ * without first being loaded in memory.
+ */
+class limited_input
+{
+public:
+    typedef char        char_type;
+
+    limited_input(std::istream & in)
+        : f_in(in)
+    {
+    }
+
+    void set_limit(std::size_t limit)
+    {
+        f_remaining = limit;
+        f_eof = false;
+        f_gcount = 0;
+    }
+
+    limited_input & read(char_type * s, std::streamsize size)
+    {
+        std::streamsize const available(limit(size));
+        f_in.read(s, available);
+        consumed(size, available);
+        return *this;
+    }
+
+    limited_input & ignore(std::streamsize size)
+    {
+        std::streamsize const available(limit(size));
+        f_in.ignore(available);
+        consumed(size, available);
+        return *this;
+    }
+
+    std::streamsize gcount() const
+    {
+        return f_gcount;
+    }
+
+    bool eof() const
+    {
+        return f_eof || f_in.eof();
+    }
+
+    explicit operator bool () const
+    {
+        return !f_eof && static_cast<bool>(f_in);
+    }
+
+private:
+    std::streamsize limit(std::streamsize size) const
+    {
+        return static_cast<std::streamsize>(
+                std::min(static_cast<std::size_t>(size), f_remaining));
+    }
+
+    void consumed(std::streamsize size, std::streamsize available)
+    {
+        f_gcount = f_in.gcount();
+        f_remaining -= f_gcount;
+        if(available < size)
+        {
+            f_eof = true;
+        }
+    }
+
+    std::istream &      f_in;
+    std::size_t         f_remaining = std::numeric_limits<std::size_t>::max();
+    std::streamsize     f_gcount = 0;
+    bool                f_eof = false;
+};
+
+
+struct path_stats_t
+{
+    std::size_t         f_hunks = 0;
+    std::size_t         f_header_bytes = 0;
+    std::size_t         f_name_bytes = 0;
+    std::size_t         f_payload_bytes = 0;
+    std::size_t         f_total_bytes = 0;      // including the children of a sub-field
+};
+
+
+class file_stats
+{
+public:
+    typedef brs::deserializer<limited_input>    deserializer_t;
+
+                        file_stats(std::string const & filename);
+
+    bool                run();
+    void                print(std::ostream & out) const;
+
+private:
+    bool                read_hunks(std::size_t size);
+    bool                process_hunk(deserializer_t & in, brs::field_t const & field);
+    void                add_bytes(
+                              std::string const & path
+                            , std::size_t header_size
+                            , std::size_t name_size
+                            , std::size_t payload_size);
+
+    std::string                         f_filename = std::string();
+    std::ifstream                       f_file = std::ifstream();
+    std::vector<char>                   f_buffer = std::vector<char>(1024 * 1024);
+    limited_input                       f_input = limited_input(f_file);
+    char const *                        f_format = "brs";
+    std::size_t                         f_file_size = 0;
+    std::size_t                         f_framing_bytes = 0;
+    std::size_t                         f_records = 0;
+    std::size_t                         f_hunks[4] = {};
+    std::size_t                         f_subfields = 0;
+    std::size_t                         f_compressed = 0;
+    std::size_t                         f_end_markers = 0;
+    bool                                f_truncated = false;
+    std::size_t                         f_header_bytes = 0;
+    std::size_t                         f_name_bytes = 0;
+    std::size_t                         f_payload_bytes = 0;
+    std::vector<std::size_t>            f_depths = std::vector<std::size_t>();
+    std::vector<std::string>            f_path = std::vector<std::string>();
+    std::map<std::string, path_stats_t> f_paths = std::map<std::string, path_stats_t>();
+    deserializer_t                      f_deserializer = deserializer_t(f_input, false);
+    deserializer_t::process_hunk_t      f_callback = deserializer_t::process_hunk_t();
+};
+
+
+file_stats::file_stats(std::string const & filename)
+    : f_filename(filename)
+    , f_callback(std::bind(&file_stats::process_hunk, this, std::placeholders::_1, std::placeholders::_2))
+{
+    f_file.rdbuf()->pubsetbuf(f_buffer.data(), f_buffer.size());
+    f_file.open(filename, std::ios_base::in | std::ios_base::binary);
+
+    brs::limits_t limits;
+    limits.f_max_depth = 1000;
+    f_deserializer.set_limits(limits);
+}
+
+
+bool file_stats::run()
+{
+    if(!f_file.is_open())
+    {
+        std::cerr << "error: could not open \"" << f_filename << "\".\n";
+        return false;
+    }
+
+    f_file.seekg(0, std::ios_base::end);
+    f_file_size = f_file.tellg();
+    f_file.seekg(0, std::ios_base::beg);
+
+    brs::magic_t magic(0);
+    f_file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    if(!f_file || f_file.gcount() != sizeof(magic))
+    {
+        std::cerr << "error: \"" << f_filename << "\" is too small to be a BRS file.\n";
+        return false;
+    }
+    f_framing_bytes += sizeof(magic);
+
+    std::size_t record_header_size(0);
+    switch(magic)
+    {
+    case brs::BRS_MAGIC:
+        return read_hunks(std::numeric_limits<std::size_t>::max());
+
+    case brs::BRS_MAGIC_V1:
+        std::cerr << "error: \"" << f_filename << "\" uses version 1 of the format, its sub-fields cannot be found without a schema.\n";
+        return false;
+
+    case brs::BRS_RECORD_MAGIC:
+        f_format = "record";
+        record_header_size = sizeof(brs::record_size_t);
+        break;
+
+    case brs::BRS_LOG_MAGIC:
+        f_format = "log";
+        record_header_size = brs::LOG_RECORD_HEADER_SIZE;
+        break;
+
+    default:
+        std::cerr << "error: \"" << f_filename << "\" is not a BRS file or uses the wrong endianness.\n";
+        return false;
+
+    }
+
+    for(;;)
+    {
+        brs::record_size_t size(0);
+        f_file.read(reinterpret_cast<char *>(&size), sizeof(size));
+        if(f_file.gcount() == 0 && f_file.eof())
+        {
+            return true;
+        }
+        if(!f_file || f_file.gcount() != sizeof(size))
+        {
+            std::cerr << "error: \"" << f_filename << "\" ends with a truncated record.\n";
+            return false;
+        }
+        f_file.ignore(record_header_size - sizeof(size));
+        f_framing_bytes += record_header_size;
+        ++f_records;
+
+        if(!read_hunks(size))
+        {
+            return false;
+        }
+    }
+}
+
+
+bool file_stats::read_hunks(std::size_t size)
+{
+    f_input.set_limit(size);
+    f_deserializer.reset(f_input, false);
+    if(!f_deserializer.deserialize(f_callback)
+    || f_truncated)
+    {
+        std::cerr << "error: \"" << f_filename << "\" is truncated.\n";
+        return false;
+    }
+
+    if(size != std::numeric_limits<std::size_t>::max()
+    && !f_input.eof())
+    {
+        std::cerr << "error: a record of \"" << f_filename << "\" ends early.\n";
+        return false;
+    }
+
+    return true;
+}
+
+
+bool file_stats::process_hunk(deserializer_t & in, brs::field_t const & field)
+{
+    std::size_t const depth(f_path.size());
+    if(f_depths.size() <= depth)
+    {
+        f_depths.resize(depth + 1);
+    }
+    ++f_depths[depth];
+
+    std::string path(f_path.empty() ? std::string() : f_path.back() + '/');
+    path += field.f_name;
+    if(field.f_subfield)
+    {
+        ++f_hunks[brs::TYPE_EXTENDED];
+        ++f_subfields;
+    }
+    else if(!field.f_sub_name.empty())
+    {
+        ++f_hunks[brs::TYPE_MAP];
+        path += "{*}";
+    }
+    else if(field.f_index >= 0)
+    {
+        ++f_hunks[field.f_header_size == sizeof(brs::hunk_sizes_t) + sizeof(std::uint16_t)
+                        ? brs::TYPE_ARRAY
+                        : brs::TYPE_EXTENDED];
+        path += "[*]";
+    }
+    else if(field.f_compressed)
+    {
+        ++f_hunks[brs::TYPE_EXTENDED];
+        ++f_compressed;
+    }
+    else
+    {
+        ++f_hunks[brs::TYPE_FIELD];
+    }
+
+    ++f_paths[path].f_hunks;
+    add_bytes(
+          path
+        , field.f_header_size
+        , field.f_name.length()
+        , field.f_compressed ? field.f_compressed_size : field.f_size);
+
+    // the deserializer ignores the value returned by the callbacks so
+    // errors are saved in f_truncated
+    //
+    if(!field.f_subfield)
+    {
+        if(!in.skip_field())
+        {
+            f_truncated = true;
+        }
+        return !f_truncated;
+    }
+
+    // the end marker of the sub-field is counted as part of its header
+    //
+    f_path.push_back(path);
+    if(!in.deserialize(f_callback))
+    {
+        f_truncated = true;
+    }
+    f_path.pop_back();
+
+    ++f_end_markers;
+    add_bytes(path, sizeof(brs::hunk_sizes_t), 0, 0);
+
+    return !f_truncated;
+}
+
+
+void file_stats::add_bytes(
+      std::string const & path
+    , std::size_t header_size
+    , std::size_t name_size
+    , std::size_t payload_size)
+{
+    std::size_t const total(header_size + name_size + payload_size);
+
+    path_stats_t & s(f_paths[path]);
+    s.f_header_bytes += header_size;
+    s.f_name_bytes += name_size;
+    s.f_payload_bytes += payload_size;
+    s.f_total_bytes += total;
+
+    for(auto const & parent : f_path)
+    {
+        f_paths[parent].f_total_bytes += total;
+    }
+
+    f_header_bytes += header_size;
+    f_name_bytes += name_size;
+    f_payload_bytes += payload_size;
+}
+
+
+std::string percent(std::size_t bytes, std::size_t total)
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1)
+       << (total == 0 ? 0.0 : bytes * 100.0 / total) << '%';
+    return ss.str();
+}
+
+
+void file_stats::print(std::ostream & out) const
+{
+    // the deserializer skips the padding hunks (see serializer::set_aligned())
+    //
+    std::size_t const parsed(f_framing_bytes + f_header_bytes + f_name_bytes + f_payload_bytes);
+    std::size_t const padding(f_file_size > parsed ? f_file_size - parsed : 0);
+    std::size_t const total(parsed + padding);
+
+    out << "file: " << f_filename << '\n'
+        << "format: " << f_format << '\n';
+    if(f_records > 0)
+    {
+        out << "records: " << f_records << '\n';
+    }
+    out << "total bytes: " << total << '\n'
+        << "  framing: " << f_framing_bytes << " (" << percent(f_framing_bytes, total) << ")\n"
+        << "  headers: " << f_header_bytes << " (" << percent(f_header_bytes, total) << ")\n"
+        << "  names: " << f_name_bytes << " (" << percent(f_name_bytes, total) << ")\n"
+        << "  payload: " << f_payload_bytes << " (" << percent(f_payload_bytes, total) << ")\n"
+        << "  padding: " << padding << " (" << percent(padding, total) << ")\n"
+        << "hunks: " << f_hunks[0] + f_hunks[1] + f_hunks[2] + f_hunks[3] + f_end_markers << '\n'
+        << "  fields: " << f_hunks[brs::TYPE_FIELD] << '\n'
+        << "  array items: " << f_hunks[brs::TYPE_ARRAY] << '\n'
+        << "  map items: " << f_hunks[brs::TYPE_MAP] << '\n'
+        << "  extended: " << f_hunks[brs::TYPE_EXTENDED] << " (including " << f_subfields << " sub-fields, " << f_compressed << " compressed)\n"
+        << "  end markers: " << f_end_markers << '\n'
+        << "hunks per depth:\n";
+    for(std::size_t depth(0); depth < f_depths.size(); ++depth)
+    {
+        out << "  " << depth << ": " << f_depths[depth] << '\n';
+    }
+
+    std::vector<std::pair<std::string, path_stats_t>> paths(f_paths.begin(), f_paths.end());
+    std::stable_sort(
+          paths.begin()
+        , paths.end()
+        , [](auto const & a, auto const & b)
+          {
+              return a.second.f_total_bytes > b.second.f_total_bytes;
+          });
+
+    out << "paths:\n"
+        << std::setw(14) << "bytes" << std::setw(8) << ""
+        << std::setw(12) << "hunks"
+        << std::setw(14) << "headers"
+        << std::setw(14) << "names"
+        << std::setw(14) << "payload"
+        << "  path\n";
+    for(auto const & p : paths)
+    {
+        out << std::setw(14) << p.second.f_total_bytes
+            << std::setw(8) << percent(p.second.f_total_bytes, total)
+            << std::setw(12) << p.second.f_hunks
+            << std::setw(14) << p.second.f_header_bytes
+            << std::setw(14) << p.second.f_name_bytes
+            << std::setw(14) << p.second.f_payload_bytes
+            << "  " << p.first << '\n';
+    }
+}
+
+
+
+} // no name namespace
+
+
+
+int main(int argc, char * argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr << "Usage: brs-stat <filename> ...\n";
+        return 1;
+    }
+
+    int exit_code(0);
+    for(int i(1); i < argc; ++i)
+    {
+        std::string const arg(argv[i]);
+        if(arg == "--help" || arg == "-h")
+        {
+            std::cout << "Usage: brs-stat <filename> ...\n"
+                         "Report the bytes used by each field path of BRS files.\n";
+            return 0;
+        }
+        if(arg == "--version" || arg == "-V")
+        {
+            std::cout << BRS_VERSION_STRING << '\n';
+            return 0;
+        }
+
+        try
+        {
+            file_stats s(arg);
+            if(!s.run())
+            {
+                exit_code = 1;
+            }
+            if(i > 1)
+            {
+                std::cout << '\n';
+            }
+            s.print(std::cout);
+        }
+        catch(brs::brs_error const & e)
+        {
+            std::cerr << "error: \"" << arg << "\": " << e.what() << '\n';
+            exit_code = 1;
+        }
+    }
+
+    return exit_code;
+}
+
+
+// vim: ts=4 sw=4 et